@@ -0,0 +1,494 @@
+#include "ordered_task_queue.h"
+#include "priority_task_queue.h"
+#include "timer_wheel.h"
+#include "task_sort.h"
+#include "edf_task_queue.h"
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <array>
+#include <functional>
+#include <queue>
+#include <random>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// === ordered_task_queue contention: std::queue + mutex vs lock-free ring ===
+struct locked_ordered_task_queue
+{
+    bool try_push(ordered_task_queue::function&& task)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        queue_.push(std::move(task));
+        return true;
+    }
+
+    size_t run_one()
+    {
+        ordered_task_queue::function task;
+        {
+            std::lock_guard<std::mutex> lock(lock_);
+            if (queue_.empty())
+            {
+                return 0;
+            }
+            task = std::move(queue_.front());
+            queue_.pop();
+        }
+        task();
+        return 1;
+    }
+
+private:
+    std::mutex lock_;
+    std::queue<ordered_task_queue::function> queue_;
+};
+
+template<class queue_type>
+static double contention_run(size_t producers, size_t total)
+{
+    queue_type queue;
+    std::atomic<size_t> counter(0);
+    size_t per_producer = total / producers;
+    size_t expected = per_producer * producers;
+
+    auto start = bench_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, &counter, per_producer] {
+            for (size_t i = 0; i < per_producer; ++i)
+            {
+                while (!queue.try_push([&counter] { counter.fetch_add(1, std::memory_order_relaxed); }))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    size_t executed = 0;
+    while (executed < expected)
+    {
+        if (queue.run_one() == 0)
+        {
+            std::this_thread::yield();
+        }
+        else
+        {
+            ++executed;
+        }
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    return expected / seconds_since(start) / 1e6;
+}
+
+static void bench_contention()
+{
+    size_t const total = 1 << 20;
+    std::printf("== push/run_one contention, %zu tasks, one consumer (Mtasks/s)\n", total);
+    std::printf("%10s %16s %16s\n", "producers", "std::queue+mutex", "mpmc_ring");
+    for (size_t producers = 1; producers <= 64; producers *= 2)
+    {
+        double locked = contention_run<locked_ordered_task_queue>(producers, total);
+        double ring = contention_run<mpmc_ordered_task_queue<4096>>(producers, total);
+        std::printf("%10zu %16.2f %16.2f\n", producers, locked, ring);
+    }
+}
+
+// === task storage: std::function vs inline_task ===
+template<class queue_type, size_t CAPTURE>
+static double storage_run(size_t total)
+{
+    queue_type queue;
+    std::array<size_t, CAPTURE / sizeof(size_t)> payload{};
+    size_t sink = 0;
+    auto start = bench_clock::now();
+    for (size_t done = 0; done < total; done += 256)
+    {
+        for (size_t i = 0; i < 256; ++i)
+        {
+            payload[0] = i;
+            queue.push([payload, &sink] { sink += payload[0]; });
+        }
+        queue.run();
+    }
+    double result = total / seconds_since(start) / 1e6;
+    if (sink == 1)
+    {
+        std::printf("unreachable\n");
+    }
+    return result;
+}
+
+template<size_t CAPTURE>
+static void storage_row(size_t total)
+{
+    typedef basic_ordered_task_queue<queue_storage<std::function<void()>>> std_function_queue;
+    typedef basic_ordered_task_queue<queue_storage<inline_task<128>>> inline_128_queue;
+    std::printf("%14zu %16.2f %16.2f %16.2f\n", CAPTURE,
+        storage_run<std_function_queue, CAPTURE>(total),
+        storage_run<ordered_task_queue, CAPTURE>(total),
+        storage_run<inline_128_queue, CAPTURE>(total));
+}
+
+static void bench_task_storage()
+{
+    size_t const total = 1 << 22;
+    std::printf("== push+run throughput by capture size, %zu tasks (Mtasks/s)\n", total);
+    std::printf("%14s %16s %16s %16s\n", "capture bytes", "std::function", "inline_task<64>", "inline_task<128>");
+    storage_row<8>(total);
+    storage_row<24>(total);
+    storage_row<48>(total);
+    storage_row<96>(total);
+}
+
+// === batch push/drain vs one task at a time ===
+template<class queue_type>
+static void batch_row(char const* name, size_t total)
+{
+    for (size_t batch = 1; batch <= 4096; batch *= 16)
+    {
+        queue_type queue;
+        size_t sink = 0;
+        std::vector<ordered_task_queue::function> tasks(batch);
+
+        auto start = bench_clock::now();
+        for (size_t done = 0; done < total; done += batch)
+        {
+            for (size_t i = 0; i < batch; ++i)
+            {
+                tasks[i] = [&sink, i] { sink += i; };
+            }
+            for (size_t i = 0; i < batch; ++i)
+            {
+                queue.push(std::move(tasks[i]));
+            }
+            while (queue.run_one() != 0) {}
+        }
+        double single = total / seconds_since(start) / 1e6;
+
+        start = bench_clock::now();
+        for (size_t done = 0; done < total; done += batch)
+        {
+            for (size_t i = 0; i < batch; ++i)
+            {
+                tasks[i] = [&sink, i] { sink += i; };
+            }
+            queue.push_bulk(tasks.begin(), tasks.end());
+            queue.run_batch(batch);
+        }
+        double bulk = total / seconds_since(start) / 1e6;
+        std::printf("%12s %8zu %14.2f %14.2f\n", name, batch, single, bulk);
+        if (sink == 1)
+        {
+            std::printf("unreachable\n");
+        }
+    }
+}
+
+static void bench_batch()
+{
+    size_t const total = 1 << 22;
+    std::printf("== push/run_one vs push_bulk/run_batch, %zu tasks (Mtasks/s)\n", total);
+    std::printf("%12s %8s %14s %14s\n", "storage", "batch", "one by one", "batched");
+    batch_row<ordered_task_queue>("std::queue", total);
+    batch_row<mpmc_ordered_task_queue<4096>>("mpmc_ring", total);
+}
+
+// === timers: binary heap vs timing wheel at 10^6 pending ===
+static void bench_timers()
+{
+    size_t const count = 1000000;
+    uint64_t const horizon = 1 << 24;
+    std::mt19937_64 random(42);
+    std::vector<uint64_t> deadlines(count);
+    for (auto& deadline : deadlines)
+    {
+        deadline = random() % horizon;
+    }
+    std::printf("== %zu timers over %llu ticks, half cancelled (ms)\n", count,
+        static_cast<unsigned long long>(horizon));
+    std::printf("%14s %10s %10s %10s\n", "", "schedule", "cancel", "expire");
+
+    {
+        // The heap cannot erase, so cancellation is a tombstone checked when the timer fires.
+        size_t fired = 0;
+        std::vector<char> cancelled(count, 0);
+        priority_task_queue<uint64_t, std::greater<uint64_t>> heap;
+        auto start = bench_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            heap.push([&fired, &cancelled, i] { fired += !cancelled[i]; }, deadlines[i]);
+        }
+        double schedule = seconds_since(start) * 1e3;
+        start = bench_clock::now();
+        for (size_t i = 0; i < count; i += 2)
+        {
+            cancelled[i] = 1;
+        }
+        double cancel = seconds_since(start) * 1e3;
+        start = bench_clock::now();
+        heap.run();
+        double expire = seconds_since(start) * 1e3;
+        std::printf("%14s %10.1f %10.1f %10.1f\n", "heap", schedule, cancel, expire);
+    }
+
+    {
+        size_t fired = 0;
+        timer_wheel<> wheel;
+        std::vector<timer_wheel<>::handle> handles(count);
+        auto start = bench_clock::now();
+        for (size_t i = 0; i < count; ++i)
+        {
+            handles[i] = wheel.schedule_at(deadlines[i], [&fired] { ++fired; });
+        }
+        double schedule = seconds_since(start) * 1e3;
+        start = bench_clock::now();
+        for (size_t i = 0; i < count; i += 2)
+        {
+            wheel.cancel(handles[i]);
+        }
+        double cancel = seconds_since(start) * 1e3;
+        start = bench_clock::now();
+        for (uint64_t now = 0; now <= horizon; now += 1024)
+        {
+            wheel.advance(now);
+            wheel.run();
+        }
+        double expire = seconds_since(start) * 1e3;
+        std::printf("%14s %10.1f %10.1f %10.1f\n", "timer_wheel", schedule, cancel, expire);
+    }
+}
+
+// === priority queue: binary std::priority_queue vs indexed d-ary heap ===
+struct binary_task_queue
+{
+    typedef std::pair<inline_task<>, size_t> prior_pair;
+    struct comparer
+    {
+        bool operator()(prior_pair const& left, prior_pair const& right) const
+        {
+            return left.second > right.second;
+        }
+    };
+
+    void push(inline_task<>&& task, size_t priority)
+    {
+        queue_.push(std::make_pair(std::move(task), priority));
+    }
+
+    size_t run()
+    {
+        size_t result = 0;
+        while (!queue_.empty())
+        {
+            inline_task<> task = std::move(const_cast<prior_pair&>(queue_.top()).first);
+            queue_.pop();
+            task();
+            ++result;
+        }
+        return result;
+    }
+
+private:
+    std::priority_queue<prior_pair, std::vector<prior_pair>, comparer> queue_;
+};
+
+template<class queue_type>
+static double priority_run(queue_type& queue, std::vector<size_t> const& priorities)
+{
+    size_t sink = 0;
+    auto start = bench_clock::now();
+    for (size_t priority : priorities)
+    {
+        queue.push([&sink, priority] { sink += priority; }, priority);
+    }
+    queue.run();
+    return seconds_since(start) * 1e3;
+}
+
+static void bench_priority()
+{
+    std::mt19937_64 random(7);
+    std::printf("== push all + run all, random priorities (ms)\n");
+    std::printf("%10s %14s %14s %14s\n", "tasks", "binary heap", "4-ary indexed", "8-ary indexed");
+    for (size_t count = 1000; count <= 1000000; count *= 10)
+    {
+        std::vector<size_t> priorities(count);
+        for (auto& priority : priorities)
+        {
+            priority = random();
+        }
+        binary_task_queue binary;
+        priority_task_queue<size_t, std::greater<size_t>> quaternary;
+        priority_task_queue<size_t, std::greater<size_t>, inline_task<>, 8> octonary;
+        double binary_ms = priority_run(binary, priorities);
+        double quaternary_ms = priority_run(quaternary, priorities);
+        double octonary_ms = priority_run(octonary, priorities);
+        std::printf("%10zu %14.2f %14.2f %14.2f\n", count, binary_ms, quaternary_ms, octonary_ms);
+    }
+}
+
+// === sorting 10^7 elements: std::sort vs task_sort ===
+template<class T, class GEN>
+static void sort_row(char const* name, GEN generate)
+{
+    size_t const count = 10000000;
+    std::vector<T> data(count);
+    for (auto& value : data)
+    {
+        value = generate();
+    }
+    std::vector<T> copy(data);
+    auto start = bench_clock::now();
+    std::sort(copy.begin(), copy.end());
+    double std_ms = seconds_since(start) * 1e3;
+
+    copy = data;
+    start = bench_clock::now();
+    task_sort(copy.begin(), copy.end());
+    double task_ms = seconds_since(start) * 1e3;
+
+    copy = data;
+    start = bench_clock::now();
+    task_sort(copy.begin(), copy.end(), std::less<T>());
+    double merge_ms = seconds_since(start) * 1e3;
+    std::printf("%10s %12.1f %12.1f %12.1f\n", name, std_ms, task_ms, merge_ms);
+}
+
+static void bench_sort()
+{
+    std::mt19937_64 random(11);
+    std::printf("== sorting 10^7 elements on %zu workers (ms)\n", task_sort_detail::default_executor().concurrency());
+    std::printf("%10s %12s %12s %12s\n", "type", "std::sort", "task_sort", "merge sort");
+    sort_row<uint32_t>("uint32", [&random] { return static_cast<uint32_t>(random()); });
+    sort_row<int64_t>("int64", [&random] { return static_cast<int64_t>(random()); });
+    sort_row<double>("double", [&random] { return static_cast<double>(random() % 1000000) / 7; });
+}
+
+// === few distinct priorities: indexed heap vs FIFO lanes ===
+static void bench_lanes()
+{
+    size_t const count = 1000000;
+    std::mt19937_64 random(5);
+    std::printf("== push all + run all, %zu tasks (ms)\n", count);
+    std::printf("%10s %14s %14s\n", "priorities", "4-ary heap", "lanes");
+    for (size_t distinct = 4; distinct <= 16; distinct *= 2)
+    {
+        std::vector<size_t> priorities(count);
+        for (auto& priority : priorities)
+        {
+            priority = random() % distinct;
+        }
+        priority_task_queue<size_t> heap;
+        priority_task_queue<lane_priority<16>> lanes;
+        double heap_ms = priority_run(heap, priorities);
+        double lanes_ms = priority_run(lanes, priorities);
+        std::printf("%10zu %14.2f %14.2f\n", distinct, heap_ms, lanes_ms);
+    }
+}
+
+#if __cplusplus >= 202002L
+#include "coro_task_queue.h"
+
+// === coroutine resumption vs closure push ===
+static task<> bench_coroutine_loop(ordered_task_queue& queue, size_t iterations, size_t& sink)
+{
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        co_await schedule(queue);
+        sink += i;
+    }
+}
+
+static void bench_coroutines()
+{
+    size_t const total = 1 << 22;
+    size_t const coroutines = 256;
+    size_t sink = 0;
+    std::printf("== %zu resumptions from %zu coroutines vs closures (Mops/s)\n", total, coroutines);
+
+    ordered_task_queue queue;
+    std::vector<task<>> tasks;
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < coroutines; ++i)
+    {
+        tasks.push_back(bench_coroutine_loop(queue, total / coroutines, sink));
+        tasks.back().start();
+    }
+    queue.run();
+    double coroutine_rate = total / seconds_since(start) / 1e6;
+
+    start = bench_clock::now();
+    for (size_t done = 0; done < total; done += coroutines)
+    {
+        for (size_t i = 0; i < coroutines; ++i)
+        {
+            queue.push([&sink, i] { sink += i; });
+        }
+        queue.run();
+    }
+    double closure_rate = total / seconds_since(start) / 1e6;
+    std::printf("%14s %10.2f\n%14s %10.2f\n", "co_await", coroutine_rate, "closure push", closure_rate);
+    if (sink == 1)
+    {
+        std::printf("unreachable\n");
+    }
+}
+#endif
+
+// === EDF mode vs plain priorities ===
+static void bench_edf()
+{
+    size_t const count = 1000000;
+    std::mt19937_64 random(3);
+    std::vector<size_t> priorities(count);
+    for (auto& priority : priorities)
+    {
+        priority = random() % 1000000;
+    }
+    priority_task_queue<size_t, std::greater<size_t>> heap;
+    double heap_ms = priority_run(heap, priorities);
+
+    typedef edf_task_queue<> edf_queue;
+    edf_queue edf;
+    size_t sink = 0;
+    auto base = std::chrono::steady_clock::now() + std::chrono::hours(1);
+    auto start = bench_clock::now();
+    for (size_t priority : priorities)
+    {
+        edf.push([&sink, priority] { sink += priority; }, base + std::chrono::microseconds(priority),
+            std::chrono::microseconds(priority % 100));
+    }
+    edf.run();
+    double edf_ms = seconds_since(start) * 1e3;
+    std::printf("== push all + run all, %zu tasks (ms)\n%14s %10.1f\n%14s %10.1f (missed %zu)\n", count,
+        "4-ary heap", heap_ms, "edf", edf_ms, edf.statistics().missed);
+}
+
+int main()
+{
+    bench_contention();
+    bench_task_storage();
+    bench_batch();
+    bench_timers();
+    bench_priority();
+    bench_sort();
+    bench_lanes();
+    bench_edf();
+#if __cplusplus >= 202002L
+    bench_coroutines();
+#endif
+    return 0;
+}
@@ -0,0 +1,197 @@
+#pragma once
+/*
+ * C++20 coroutine adapter for the task queues.
+ *
+ *     task<int> work(ordered_task_queue& queue) {
+ *         co_await schedule(queue);   // resumed by whoever calls queue.run()
+ *         co_return 42;
+ *     }
+ *
+ * schedule(queue) suspends the coroutine and pushes its handle as a task, so
+ * resuming costs one queue slot holding a single pointer. task<T> is lazy:
+ * start() runs it up to its first suspension, and co_await'ing it from another
+ * task chains the two without going through the queue. The rest of the task
+ * queue headers keep building as C++11; only this one needs -std=c++20.
+ */
+#if __cplusplus < 202002L || !defined(__cpp_impl_coroutine)
+#error "coro_task_queue.h requires C++20 coroutines"
+#endif
+
+#include <stdlib.h>
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <optional>
+
+template<typename QUEUE>
+struct schedule_awaitable
+{
+	bool await_ready() const noexcept {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle) {
+		queue.push([handle]() { handle.resume(); });
+	}
+	void await_resume() const noexcept {
+	}
+
+	QUEUE& queue;
+};
+
+template<typename QUEUE, typename PRIOR>
+struct schedule_priority_awaitable
+{
+	bool await_ready() const noexcept {
+		return false;
+	}
+	void await_suspend(std::coroutine_handle<> handle) {
+		queue.push([handle]() { handle.resume(); }, priority);
+	}
+	void await_resume() const noexcept {
+	}
+
+	QUEUE& queue;
+	PRIOR priority;
+};
+
+// Suspends the calling coroutine until queue.run() / run_one() picks it up.
+template<typename QUEUE>
+schedule_awaitable<QUEUE> schedule(QUEUE& queue) {
+	return schedule_awaitable<QUEUE>{ queue };
+}
+
+template<typename QUEUE, typename PRIOR>
+schedule_priority_awaitable<QUEUE, PRIOR> schedule(QUEUE& queue, PRIOR priority) {
+	return schedule_priority_awaitable<QUEUE, PRIOR>{ queue, std::move(priority) };
+}
+
+namespace coro_detail
+{
+	struct promise_base {
+		struct final_awaiter {
+			bool await_ready() const noexcept {
+				return false;
+			}
+			template<typename PROMISE>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<PROMISE> handle) noexcept {
+				std::coroutine_handle<> continuation = handle.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() const noexcept {
+			}
+		};
+
+		std::suspend_always initial_suspend() const noexcept {
+			return {};
+		}
+		final_awaiter final_suspend() const noexcept {
+			return {};
+		}
+		void unhandled_exception() noexcept {
+			exception = std::current_exception();
+		}
+		void rethrow() const {
+			if(exception) {
+				std::rethrow_exception(exception);
+			}
+		}
+
+		std::coroutine_handle<> continuation;
+		std::exception_ptr exception;
+	};
+
+	template<typename T>
+	struct promise_value : promise_base {
+		template<typename U>
+		void return_value(U&& result) {
+			value.emplace(std::forward<U>(result));
+		}
+		T take() {
+			rethrow();
+			return std::move(*value);
+		}
+
+		std::optional<T> value;
+	};
+
+	template<>
+	struct promise_value<void> : promise_base {
+		void return_void() const noexcept {
+		}
+		void take() const {
+			rethrow();
+		}
+	};
+} // coro_detail
+
+template<typename T = void>
+class task
+{
+public:
+	struct promise_type : coro_detail::promise_value<T> {
+		task get_return_object() {
+			return task(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+	};
+
+	task(task&& other) noexcept
+		: handle_(std::exchange(other.handle_, nullptr)) {
+	}
+	task& operator=(task&& other) noexcept {
+		if(this != &other) {
+			destroy();
+			handle_ = std::exchange(other.handle_, nullptr);
+		}
+		return *this;
+	}
+	task(task const& other) = delete;
+	task& operator=(task const& other) = delete;
+	~task() {
+		destroy();
+	}
+
+	// Runs a top-level task until it first suspends (or finishes).
+	void start() {
+		if(handle_ && !handle_.done()) {
+			handle_.resume();
+		}
+	}
+	bool done() const {
+		return !handle_ || handle_.done();
+	}
+	// Value of a finished task; rethrows what the coroutine threw.
+	T result() {
+		return handle_.promise().take();
+	}
+
+	auto operator co_await() noexcept {
+		struct awaiter {
+			bool await_ready() const noexcept {
+				return handle.done();
+			}
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept {
+				handle.promise().continuation = continuation;
+				return handle;
+			}
+			T await_resume() {
+				return handle.promise().take();
+			}
+
+			std::coroutine_handle<promise_type> handle;
+		};
+		return awaiter{ handle_ };
+	}
+
+private:
+	explicit task(std::coroutine_handle<promise_type> handle)
+		: handle_(handle) {
+	}
+	void destroy() {
+		if(handle_) {
+			handle_.destroy();
+			handle_ = nullptr;
+		}
+	}
+
+	std::coroutine_handle<promise_type> handle_;
+};
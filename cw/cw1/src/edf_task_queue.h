@@ -0,0 +1,106 @@
+#pragma once
+#include <stdlib.h>
+#include <chrono>
+#include "priority_task_queue.h"
+
+/*
+ * Earliest-deadline-first mode of priority_task_queue.
+ *
+ * Every task carries a deadline and an estimated cost. The queue runs the task
+ * with the least slack (deadline - now - cost); since now is the same for every
+ * queued task that is the one with the earliest latest start time
+ * (deadline - cost), so the queue is an ordinary priority_task_queue keyed on
+ * it and push/pop keep the heap's cost. After each task the queue checks the
+ * clock and counts the deadlines which were missed.
+ */
+template<typename CLOCK = std::chrono::steady_clock, typename TASK = queued_task>
+struct edf_task_queue
+{
+	typedef TASK function;
+	typedef typename CLOCK::time_point time_point;
+	typedef typename CLOCK::duration duration;
+
+	struct priority {
+		time_point latest_start() const {
+			return deadline - cost;
+		}
+
+		time_point deadline;
+		duration cost;
+	};
+
+	// priority_task_queue runs the greatest element first, so less slack compares greater.
+	struct least_slack_last {
+		bool operator()(priority const& left, priority const& right) const {
+			if(left.latest_start() != right.latest_start()) {
+				return left.latest_start() > right.latest_start();
+			}
+			return left.deadline > right.deadline;
+		}
+	};
+
+	struct stats {
+		size_t executed;
+		size_t missed;
+		duration max_lateness;
+	};
+
+	typedef typename priority_task_queue<priority, least_slack_last, TASK>::handle handle;
+
+	edf_task_queue()
+		: stats_{ 0, 0, duration::zero() } {
+	}
+	edf_task_queue(edf_task_queue const& other) = delete;
+	edf_task_queue& operator=(edf_task_queue const& other) = delete;
+
+	handle push(function&& task, time_point deadline, duration cost = duration::zero()) {
+		return queue_.push(std::move(task), priority{ deadline, cost });
+	}
+	bool erase(handle task) {
+		return queue_.erase(task);
+	}
+	bool update(handle task, time_point deadline, duration cost) {
+		return queue_.update(task, priority{ deadline, cost });
+	}
+	size_t run_one() {
+		if(queue_.empty()) {
+			return 0;
+		}
+		time_point deadline = queue_.top().deadline;
+		queue_.run_one();
+		time_point finished = CLOCK::now();
+		++stats_.executed;
+		if(finished > deadline) {
+			++stats_.missed;
+			if(finished - deadline > stats_.max_lateness) {
+				stats_.max_lateness = finished - deadline;
+			}
+		}
+		return 1;
+	}
+	size_t run() {
+		size_t result = 0;
+		while(run_one() != 0) {
+			++result;
+		}
+
+		return result;
+	}
+	bool empty() const {
+		return queue_.empty();
+	}
+	size_t size() const {
+		return queue_.size();
+	}
+	// Slack of the next task at the given time; negative means it can no longer make it.
+	duration next_slack(time_point now) const {
+		return queue_.top().latest_start() - now;
+	}
+	stats const& statistics() const {
+		return stats_;
+	}
+
+private:
+	priority_task_queue<priority, least_slack_last, TASK> queue_;
+	stats stats_;
+};
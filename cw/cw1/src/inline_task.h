@@ -0,0 +1,150 @@
+#pragma once
+#include <stdlib.h>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+/*
+ * Move-only replacement of std::function<void()> for the task queues.
+ *
+ * Callables up to SIZE bytes with a nothrow move constructor are kept inside
+ * the task itself, so pushing a typical capturing lambda never touches the
+ * allocator. Bigger callables fall back to the heap.
+ */
+template<size_t SIZE = 64>
+class inline_task
+{
+	static_assert(SIZE >= sizeof(void*), "inline_task buffer should hold at least a pointer");
+
+	struct operations {
+		void (*invoke)(void* storage);
+		void (*move)(void* dst, void* src);
+		void (*destroy)(void* storage);
+	};
+
+	template<typename F>
+	struct fits_inline : std::integral_constant<bool,
+		sizeof(F) <= SIZE
+		&& alignof(F) <= alignof(std::max_align_t)
+		&& std::is_nothrow_move_constructible<F>::value> {
+	};
+
+	template<typename F>
+	struct inline_operations {
+		static void invoke(void* storage) {
+			(*static_cast<F*>(storage))();
+		}
+		static void move(void* dst, void* src) {
+			new (dst) F(std::move(*static_cast<F*>(src)));
+			static_cast<F*>(src)->~F();
+		}
+		static void destroy(void* storage) {
+			static_cast<F*>(storage)->~F();
+		}
+		static const operations table;
+	};
+
+	template<typename F>
+	struct heap_operations {
+		static void invoke(void* storage) {
+			(**static_cast<F**>(storage))();
+		}
+		static void move(void* dst, void* src) {
+			*static_cast<F**>(dst) = *static_cast<F**>(src);
+		}
+		static void destroy(void* storage) {
+			delete *static_cast<F**>(storage);
+		}
+		static const operations table;
+	};
+
+public:
+	static const size_t inline_size = SIZE;
+
+	inline_task() noexcept
+		: ops_(nullptr) {
+	}
+	inline_task(std::nullptr_t) noexcept
+		: ops_(nullptr) {
+	}
+	template<typename F, typename = typename std::enable_if<
+		!std::is_same<typename std::decay<F>::type, inline_task>::value>::type>
+	inline_task(F&& callable)
+		: ops_(nullptr) {
+		typedef typename std::decay<F>::type functor;
+		emplace<functor>(std::forward<F>(callable), fits_inline<functor>());
+	}
+	inline_task(inline_task&& other) noexcept
+		: ops_(other.ops_) {
+		if(ops_ != nullptr) {
+			ops_->move(&storage_, &other.storage_);
+			other.ops_ = nullptr;
+		}
+	}
+	inline_task& operator=(inline_task&& other) noexcept {
+		if(this != &other) {
+			reset();
+			if(other.ops_ != nullptr) {
+				other.ops_->move(&storage_, &other.storage_);
+				ops_ = other.ops_;
+				other.ops_ = nullptr;
+			}
+		}
+		return *this;
+	}
+	inline_task(inline_task const& other) = delete;
+	inline_task& operator=(inline_task const& other) = delete;
+	~inline_task() {
+		reset();
+	}
+
+	// Like std::function, calling is const even if the callable mutates its state.
+	void operator()() const {
+		ops_->invoke(&storage_);
+	}
+	explicit operator bool() const noexcept {
+		return ops_ != nullptr;
+	}
+	template<typename F>
+	static constexpr bool stored_inline() {
+		return fits_inline<typename std::decay<F>::type>::value;
+	}
+
+private:
+	template<typename F, typename ARG>
+	void emplace(ARG&& callable, std::true_type) {
+		new (&storage_) F(std::forward<ARG>(callable));
+		ops_ = &inline_operations<F>::table;
+	}
+	template<typename F, typename ARG>
+	void emplace(ARG&& callable, std::false_type) {
+		*reinterpret_cast<F**>(&storage_) = new F(std::forward<ARG>(callable));
+		ops_ = &heap_operations<F>::table;
+	}
+	void reset() noexcept {
+		if(ops_ != nullptr) {
+			ops_->destroy(&storage_);
+			ops_ = nullptr;
+		}
+	}
+
+	mutable typename std::aligned_storage<SIZE, alignof(std::max_align_t)>::type storage_;
+	operations const* ops_;
+};
+
+template<size_t SIZE>
+template<typename F>
+const typename inline_task<SIZE>::operations inline_task<SIZE>::inline_operations<F>::table = {
+	&inline_task<SIZE>::inline_operations<F>::invoke,
+	&inline_task<SIZE>::inline_operations<F>::move,
+	&inline_task<SIZE>::inline_operations<F>::destroy
+};
+
+template<size_t SIZE>
+template<typename F>
+const typename inline_task<SIZE>::operations inline_task<SIZE>::heap_operations<F>::table = {
+	&inline_task<SIZE>::heap_operations<F>::invoke,
+	&inline_task<SIZE>::heap_operations<F>::move,
+	&inline_task<SIZE>::heap_operations<F>::destroy
+};
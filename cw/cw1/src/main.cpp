@@ -3,10 +3,27 @@
 #include <cassert>
 #include <cstdlib>
 #include <algorithm>
+#include <string>
+#include <list>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <ctime>
+#include <stdexcept>
 
 #define TEST_TASK1
 #define TEST_TASK2
 #define TEST_TASK3
+#define TEST_WORK_STEALING
+#define TEST_MPMC
+#define TEST_INLINE_TASK
+#define TEST_BATCH
+#define TEST_TIMER_WHEEL
+#define TEST_PRIORITY_HANDLES
+#define TEST_METRICS
+#define TEST_LANES
+#define TEST_COROUTINES
+#define TEST_EDF
 
 #ifdef TEST_TASK1
 
@@ -73,7 +90,7 @@ void test_ordered_many_elements()
     }
     assert(iterations == queue.run());
     assert(queue.empty());
-    assert(result_loop = result_queue);
+    assert(result_loop == result_queue);
 }
 
 void test_ordered_move_constructor()
@@ -205,7 +222,7 @@ void test_priority_many_elements()
 #endif // TEST_TASK2
 
 #ifdef TEST_TASK3
-#include "priority_task_queue.h"
+#include "task_sort.h"
 
 template<class fwd_it>
 void sort_and_compare(fwd_it beg, fwd_it end)
@@ -243,8 +260,1084 @@ void test_sleep_sorting()
     generate(data.begin(), data.end(), rand);
     sort_and_compare(data);
 }
+
+void test_task_sort_large()
+{
+    srand(42);
+    std::vector<int> data(200000);
+    generate(data.begin(), data.end(), [] { return rand() - RAND_MAX / 2; });
+    sort_and_compare(data);
+
+    std::vector<unsigned long long> wide(100000);
+    generate(wide.begin(), wide.end(), [] { return (static_cast<unsigned long long>(rand()) << 33) ^ rand(); });
+    sort_and_compare(wide);
+
+    std::vector<std::string> strings(50000);
+    generate(strings.begin(), strings.end(), [] { return std::to_string(rand()); });
+    sort_and_compare(strings);
+
+    std::vector<double> reals(100000);
+    generate(reals.begin(), reals.end(), [] { return rand() / 3.0; });
+    std::vector<double> reference(reals);
+    std::sort(reference.begin(), reference.end(), std::greater<double>());
+    task_sort(reals.begin(), reals.end(), std::greater<double>());
+    assert(reals == reference);
+
+    std::list<short> list(1000);
+    generate(list.begin(), list.end(), rand);
+    std::vector<short> list_reference(list.begin(), list.end());
+    std::sort(list_reference.begin(), list_reference.end());
+    sleep_sort(list.begin(), list.end());
+    assert(std::equal(list_reference.begin(), list_reference.end(), list.begin()));
+}
+
+void test_task_sort_concurrent()
+{
+    // big sorts on several threads share the default executor
+    std::vector<std::vector<int>> inputs(4, std::vector<int>(100000));
+    std::vector<std::vector<std::string>> strings(2, std::vector<std::string>(40000));
+    srand(7);
+    for (auto& input : inputs)
+    {
+        generate(input.begin(), input.end(), rand);
+    }
+    for (auto& input : strings)
+    {
+        generate(input.begin(), input.end(), [] { return std::to_string(rand()); });
+    }
+    std::vector<std::thread> sorters;
+    for (auto& input : inputs)
+    {
+        sorters.emplace_back([&input] { task_sort(input.begin(), input.end()); });
+    }
+    for (auto& input : strings)
+    {
+        sorters.emplace_back([&input] { task_sort(input.begin(), input.end()); });
+    }
+    for (auto& sorter : sorters)
+    {
+        sorter.join();
+    }
+    for (auto& input : inputs)
+    {
+        assert(std::is_sorted(input.begin(), input.end()));
+    }
+    for (auto& input : strings)
+    {
+        assert(std::is_sorted(input.begin(), input.end()));
+    }
+}
+
+void test_task_sort_executor()
+{
+    work_stealing_task_queue executor(4);
+    std::vector<int> data(10000);
+    generate(data.begin(), data.end(), rand);
+    std::vector<int> reference(data);
+    std::sort(reference.begin(), reference.end());
+
+    std::vector<int> radix(data);
+    task_sort_detail::radix_sort(radix, &executor);
+    assert(radix == reference);
+
+    std::vector<int> merge(data);
+    task_sort_detail::merge_sort(merge, std::less<int>(), &executor);
+    assert(merge == reference);
+}
 #endif // TEST_TASK3
 
+#ifdef TEST_WORK_STEALING
+#include "work_stealing_task_queue.h"
+
+void test_work_stealing_empty()
+{
+    work_stealing_task_queue queue(4);
+    assert(queue.empty());
+    assert(queue.run_one() == 0);
+    assert(queue.run() == 0);
+}
+
+void test_work_stealing_many_elements()
+{
+    work_stealing_task_queue queue(4);
+    std::atomic<size_t> sum(0);
+    size_t iterations = 10000;
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        queue.push([&sum, i] { sum += i; });
+    }
+    assert(!queue.empty());
+    assert(queue.run() == iterations);
+    assert(queue.empty());
+    assert(sum == iterations * (iterations - 1) / 2);
+
+    queue.push([&sum] { sum = 0; });
+    assert(queue.run() == 1);
+    assert(sum == 0);
+}
+
+void test_work_stealing_nested_push()
+{
+    work_stealing_task_queue queue(4);
+    std::atomic<size_t> executed(0);
+    for (size_t i = 0; i < 100; ++i)
+    {
+        queue.push([&queue, &executed] {
+            for (size_t j = 0; j < 10; ++j)
+            {
+                queue.push([&executed] { ++executed; });
+            }
+            ++executed;
+        });
+    }
+    assert(queue.run() == 1100);
+    assert(executed == 1100);
+    assert(queue.empty());
+}
+
+void test_work_stealing_strand_ordering()
+{
+    std::vector<std::string> dst;
+    work_stealing_task_queue queue(4, work_stealing_task_queue::mode::strand);
+    auto push_str = [&dst](std::string str) {
+        dst.push_back(str);
+    };
+    queue.push(std::bind(push_str, "2"));
+    queue.push(std::bind(push_str, "1"));
+    queue.push(std::bind(push_str, "3"));
+    assert(queue.run() == 3);
+    assert(dst[0] == "2");
+    assert(dst[1] == "1");
+    assert(dst[2] == "3");
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        queue.push([&order, i] { order.push_back(i); });
+    }
+    while(queue.run_one()) {}
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        assert(order[i] == i);
+    }
+    assert(order.size() == 1000);
+
+    // a strand task may run the tasks after it, as with ordered_task_queue
+    order.clear();
+    queue.push([&queue, &order] {
+        order.push_back(0);
+        queue.push([&order] { order.push_back(2); });
+        queue.run_one();
+        queue.run();
+        order.push_back(3);
+    });
+    queue.push([&order] { order.push_back(1); });
+    assert(queue.run() == 1);
+    assert(queue.empty());
+    assert((order == std::vector<size_t>{ 0, 1, 2, 3 }));
+}
+
+void test_work_stealing_overlapping_runs()
+{
+    work_stealing_task_queue queue(4);
+    std::atomic<size_t> executed(0);
+    std::atomic<size_t> nested(0);
+    for (size_t round = 0; round < 50; ++round)
+    {
+        for (size_t i = 0; i < 200; ++i)
+        {
+            queue.push([&queue, &executed, &nested, i] {
+                ++executed;
+                if (i % 50 == 0)
+                {
+                    queue.push([&executed] { ++executed; });
+                    nested += queue.run();
+                }
+            });
+        }
+        std::atomic<size_t> reported(0);
+        std::vector<std::thread> runners;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            runners.emplace_back([&queue, &reported] { reported += queue.run(); });
+        }
+        for (auto& runner : runners)
+        {
+            runner.join();
+        }
+        assert(queue.empty());
+        assert(reported == 204);
+    }
+    assert(executed == 50 * 204);
+}
+
+void test_work_stealing_idle_workers()
+{
+    // helpers with nothing to take sleep instead of spinning while a long task runs
+    work_stealing_task_queue queue(4);
+    queue.push([] { std::this_thread::sleep_for(std::chrono::milliseconds(200)); });
+    std::clock_t start = std::clock();
+    assert(queue.run() == 1);
+    assert(std::clock() - start < CLOCKS_PER_SEC / 10);
+
+    work_stealing_task_queue strand(4, work_stealing_task_queue::mode::strand);
+    assert(strand.concurrency() == 1);
+}
+
+void test_work_stealing_exceptions()
+{
+    // parallel: the exception leaves run() once the helpers are done, the rest stays queued
+    for (size_t thrower : { size_t(0), size_t(500), size_t(999) })
+    {
+        work_stealing_task_queue queue(4);
+        std::atomic<size_t> executed(0);
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            queue.push([&executed, i, thrower] {
+                if (i == thrower)
+                {
+                    throw std::runtime_error("task failed");
+                }
+                ++executed;
+            });
+        }
+        bool thrown = false;
+        try
+        {
+            queue.run();
+        } catch (std::runtime_error const&)
+        {
+            thrown = true;
+        }
+        assert(thrown);
+        queue.run();
+        assert(queue.empty());
+        assert(executed == 999);
+    }
+
+    // strand: the queue is empty again after the caller catches
+    work_stealing_task_queue strand(4, work_stealing_task_queue::mode::strand);
+    strand.push([] { throw std::runtime_error("task failed"); });
+    bool thrown = false;
+    try
+    {
+        strand.run();
+    } catch (std::runtime_error const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    assert(strand.empty());
+}
+#endif // TEST_WORK_STEALING
+
+#ifdef TEST_MPMC
+void test_mpmc_ordering()
+{
+    std::vector<std::string> dst;
+    mpmc_ordered_task_queue<4> queue;
+    auto push_str = [&dst](std::string str) {
+        dst.push_back(str);
+    };
+    assert(queue.empty());
+    queue.push(std::bind(push_str, "2"));
+    queue.push(std::bind(push_str, "1"));
+    queue.push(std::bind(push_str, "3"));
+    queue.push(std::bind(push_str, "4"));
+    assert(!queue.try_push([]{}));
+
+    bool thrown = false;
+    try
+    {
+        queue.push([]{});
+    } catch (std::overflow_error const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    assert(queue.run() == 4);
+    assert(queue.empty());
+    assert(dst[0] == "2");
+    assert(dst[1] == "1");
+    assert(dst[2] == "3");
+    assert(dst[3] == "4");
+
+    mpmc_ordered_task_queue<4> moved = std::move(queue);
+    moved.push(std::bind(push_str, "5"));
+    assert(moved.run() == 1);
+    assert(dst.size() == 5);
+}
+
+void test_mpmc_concurrent()
+{
+    mpmc_ordered_task_queue<256> queue;
+    std::atomic<size_t> sum(0);
+    std::atomic<size_t> executed(0);
+    size_t const producers = 4;
+    size_t const per_producer = 10000;
+    size_t const total = producers * per_producer;
+
+    std::vector<std::thread> threads;
+    for (size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&queue, &sum, p, per_producer] {
+            for (size_t i = 0; i < per_producer; ++i)
+            {
+                size_t value = p * per_producer + i;
+                while (!queue.try_push([&sum, value] { sum += value; }))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+    for (size_t c = 0; c < 2; ++c)
+    {
+        threads.emplace_back([&queue, &executed, total] {
+            while (executed < total)
+            {
+                if (queue.run_one() == 0)
+                {
+                    std::this_thread::yield();
+                }
+                else
+                {
+                    ++executed;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    assert(queue.empty());
+    assert(sum == total * (total - 1) / 2);
+}
+
+void test_mpmc_throwing_task()
+{
+    // the rest of a claimed batch still runs when one of its tasks throws
+    mpmc_ordered_task_queue<256> queue;
+    std::vector<size_t> order;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        queue.push([&order, i] {
+            order.push_back(i);
+            if (i == 10 || i == 20)
+            {
+                throw std::runtime_error("task failed");
+            }
+        });
+    }
+    bool thrown = false;
+    try
+    {
+        queue.run();
+    } catch (std::runtime_error const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    queue.run();
+    assert(queue.empty());
+    assert(order.size() == 100);
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        assert(order[i] == i);
+    }
+}
+#endif // TEST_MPMC
+
+#ifdef TEST_INLINE_TASK
+#include <new>
+#include <array>
+
+static std::atomic<size_t> allocations(0);
+
+// noinline keeps g++ from pairing the malloc/free below with new/delete expressions.
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    ++allocations;
+    void* ptr = malloc(size);
+    if (!ptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+__attribute__((noinline)) void operator delete(void* ptr) noexcept
+{
+    free(ptr);
+}
+
+#ifdef __cpp_sized_deallocation
+__attribute__((noinline)) void operator delete(void* ptr, size_t) noexcept
+{
+    free(ptr);
+}
+#endif
+
+void test_inline_task_no_allocations()
+{
+    std::array<size_t, 6> payload{ { 1, 2, 3, 4, 5, 6 } };
+    size_t sum = 0;
+    auto task = [payload, &sum] {
+        for (size_t value : payload)
+        {
+            sum += value;
+        }
+    };
+    static_assert(inline_task<>::stored_inline<decltype(task)>(), "48 byte capture should be inline");
+
+    mpmc_ordered_task_queue<64> queue;
+    size_t before = allocations;
+    for (size_t i = 0; i < 64; ++i)
+    {
+        queue.push(task);
+    }
+    assert(queue.run() == 64);
+    assert(allocations == before);
+    assert(sum == 64 * 21);
+
+    before = allocations;
+    std::function<void()> heavy(task);
+    assert(allocations > before);
+}
+
+void test_inline_task_heap_fallback()
+{
+    std::array<size_t, 32> payload{};
+    payload[31] = 7;
+    size_t result = 0;
+    auto task = [payload, &result] { result = payload[31]; };
+    static_assert(!inline_task<>::stored_inline<decltype(task)>(), "256 byte capture should not be inline");
+    static_assert(inline_task<512>::stored_inline<decltype(task)>(), "256 byte capture should fit 512 bytes");
+
+    inline_task<> first(task);
+    inline_task<> second(std::move(first));
+    assert(!first);
+    assert(second);
+    second();
+    assert(result == 7);
+
+    priority_task_queue<int> queue;
+    queue.push(std::move(second), 1);
+    result = 0;
+    assert(queue.run() == 1);
+    assert(result == 7);
+}
+
+void test_inline_task_destruction()
+{
+    auto counter = std::make_shared<int>(0);
+    {
+        ordered_task_queue queue;
+        queue.push([counter] { ++*counter; });
+        queue.push([counter] { ++*counter; });
+        assert(counter.use_count() == 3);
+        assert(queue.run_one() == 1);
+        assert(counter.use_count() == 2);
+    }
+    assert(counter.use_count() == 1);
+    assert(*counter == 1);
+}
+#endif // TEST_INLINE_TASK
+
+#ifdef TEST_BATCH
+void test_batch_ordered()
+{
+    std::vector<size_t> order;
+    std::vector<ordered_task_queue::function> tasks;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        tasks.emplace_back([&order, i] { order.push_back(i); });
+    }
+    ordered_task_queue queue;
+    queue.push_bulk(tasks.begin(), tasks.end());
+    assert(!queue.empty());
+    assert(queue.run_batch(0) == 0);
+    assert(queue.run_batch(30) == 30);
+    assert(order.size() == 30);
+    assert(queue.run_batch(1000) == 70);
+    assert(queue.empty());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        assert(order[i] == i);
+    }
+}
+
+void test_batch_mpmc()
+{
+    std::vector<size_t> order;
+    std::vector<ordered_task_queue::function> tasks;
+    for (size_t i = 0; i < 20; ++i)
+    {
+        tasks.emplace_back([&order, i] { order.push_back(i); });
+    }
+    mpmc_ordered_task_queue<16> queue;
+    auto rest = queue.push_bulk(tasks.begin(), tasks.end());
+    assert(rest == tasks.begin() + 16);
+    assert(queue.run_batch(10) == 10);
+    assert(queue.push_bulk(rest, tasks.end()) == tasks.end());
+    assert(queue.run() == 10);
+    assert(order.size() == 20);
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        assert(order[i] == i);
+    }
+}
+
+void test_batch_work_stealing()
+{
+    std::atomic<size_t> executed(0);
+    std::vector<work_stealing_task_queue::function> tasks;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        tasks.emplace_back([&executed] { ++executed; });
+    }
+    work_stealing_task_queue queue(3);
+    queue.push_bulk(tasks.begin(), tasks.end());
+    assert(queue.run() == 1000);
+    assert(executed == 1000);
+}
+#endif // TEST_BATCH
+
+#ifdef TEST_TIMER_WHEEL
+#include "timer_wheel.h"
+
+void test_timer_wheel_ordering()
+{
+    timer_wheel<> wheel;
+    std::vector<int> dst;
+    assert(wheel.empty());
+    wheel.schedule_at(300, [&dst] { dst.push_back(300); });
+    wheel.schedule_at(5, [&dst] { dst.push_back(5); });
+    wheel.schedule_at(70000, [&dst] { dst.push_back(70000); });
+    wheel.schedule_at(5, [&dst] { dst.push_back(6); });
+    wheel.schedule_at(256, [&dst] { dst.push_back(256); });
+    assert(wheel.size() == 5);
+
+    assert(wheel.advance(4) == 0);
+    assert(wheel.run() == 0);
+    assert(wheel.advance(5) == 2);
+    assert(wheel.run() == 2);
+    assert(wheel.advance(1000) == 2);
+    assert(wheel.run_one() == 1);
+    assert(wheel.run_one() == 1);
+    assert(wheel.run_one() == 0);
+    assert(!wheel.empty());
+    wheel.advance(70000);
+    assert(wheel.run() == 1);
+    assert(wheel.empty());
+
+    std::vector<int> expected = { 5, 6, 256, 300, 70000 };
+    assert(dst == expected);
+}
+
+void test_timer_wheel_cancel()
+{
+    timer_wheel<> wheel(100);
+    int result = 0;
+    auto first = wheel.schedule_after(10, [&result] { result += 1; });
+    auto second = wheel.schedule_after(10, [&result] { result += 2; });
+    auto past = wheel.schedule_at(50, [&result] { result += 4; });
+    assert(wheel.ready() == 1);
+    assert(wheel.cancel(second));
+    assert(!wheel.cancel(second));
+    assert(wheel.cancel(past));
+    assert(wheel.size() == 1);
+
+    wheel.advance(110);
+    assert(wheel.run() == 1);
+    assert(result == 1);
+    assert(!wheel.cancel(first));
+    assert(!wheel.valid(first));
+
+    auto reused = wheel.schedule_after(1, [&result] { result = 0; });
+    assert(!wheel.valid(first));
+    assert(wheel.valid(reused));
+}
+
+void test_timer_wheel_far_future()
+{
+    timer_wheel<> wheel;
+    std::vector<uint64_t> fired;
+    std::vector<uint64_t> deadlines = { uint64_t(1) << 40, (uint64_t(1) << 32) + 7, 123456789, 1 };
+    for (uint64_t deadline : deadlines)
+    {
+        wheel.schedule_at(deadline, [&fired, &wheel, deadline] {
+            assert(wheel.now() >= deadline);
+            fired.push_back(deadline);
+        });
+    }
+    wheel.advance(uint64_t(1) << 32);
+    wheel.run();
+    assert(fired.size() == 2);
+    wheel.advance(uint64_t(1) << 41);
+    wheel.run();
+    std::vector<uint64_t> expected = { 1, 123456789, (uint64_t(1) << 32) + 7, uint64_t(1) << 40 };
+    assert(fired == expected);
+}
+
+void test_timer_wheel_random()
+{
+    timer_wheel<> wheel;
+    std::vector<uint64_t> fired;
+    srand(42);
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        uint64_t deadline = rand() % 200000;
+        wheel.schedule_at(deadline, [&fired, &wheel, deadline] {
+            assert(wheel.now() >= deadline);
+            fired.push_back(deadline);
+        });
+    }
+    for (uint64_t now = 0; now <= 200000; now += 777)
+    {
+        wheel.advance(now);
+        wheel.run();
+        for (uint64_t deadline : fired)
+        {
+            assert(deadline <= now);
+        }
+    }
+    wheel.advance(200000);
+    wheel.run();
+    assert(wheel.empty());
+    assert(fired.size() == 10000);
+    assert(std::is_sorted(fired.begin(), fired.end()));
+}
+#endif // TEST_TIMER_WHEEL
+
+#ifdef TEST_PRIORITY_HANDLES
+void test_priority_erase_update()
+{
+    std::vector<std::string> dst;
+    priority_task_queue<> queue;
+    auto push_str = [&dst](std::string str) {
+        dst.push_back(str);
+    };
+    auto a = queue.push(std::bind(push_str, "a"), 1);
+    auto b = queue.push(std::bind(push_str, "b"), 2);
+    auto c = queue.push(std::bind(push_str, "c"), 3);
+    auto d = queue.push(std::bind(push_str, "d"), 4);
+    assert(queue.size() == 4);
+
+    assert(queue.erase(c));
+    assert(!queue.erase(c));
+    assert(!queue.contains(c));
+    assert(queue.update(a, 10));
+    assert(queue.update(d, 0));
+    assert(queue.run_one() == 1);
+    assert(!queue.contains(a));
+    assert(!queue.update(a, 5));
+    assert(queue.run() == 2);
+    assert(queue.contains(b) == false);
+
+    std::vector<std::string> expected = { "a", "b", "d" };
+    assert(dst == expected);
+
+    auto e = queue.push(std::bind(push_str, "e"), 1);
+    assert(queue.contains(e));
+    assert(!queue.contains(a));
+}
+
+void test_priority_move_constructor()
+{
+    priority_task_queue<size_t> source;
+    size_t executed = 0;
+    auto erased = source.push([&executed] { ++executed; }, 1);
+    source.push([&executed] { ++executed; }, 2);
+    source.erase(erased);
+
+    priority_task_queue<size_t> queue(std::move(source));
+    assert(queue.size() == 1);
+    assert(source.empty());
+    // the moved-from queue must not reuse the free slot it handed over
+    source.push([&executed] { executed += 10; }, 3);
+    source.push([&executed] { executed += 10; }, 4);
+    assert(source.run() == 2);
+    assert(queue.run() == 1);
+    assert(executed == 21);
+}
+
+void test_priority_handles_random()
+{
+    priority_task_queue<int, std::greater<int>> queue;
+    std::vector<priority_task_queue<int, std::greater<int>>::handle> handles;
+    std::vector<int> priorities(1000);
+    std::vector<int> result;
+    srand(42);
+    for (size_t i = 0; i < priorities.size(); ++i)
+    {
+        priorities[i] = rand() % 500;
+        handles.push_back(queue.push([&result, &priorities, i] { result.push_back(priorities[i]); }, priorities[i]));
+    }
+    for (size_t i = 0; i < priorities.size(); i += 3)
+    {
+        assert(queue.erase(handles[i]));
+        priorities[i] = -1;
+    }
+    for (size_t i = 1; i < priorities.size(); i += 3)
+    {
+        priorities[i] = rand() % 500;
+        assert(queue.update(handles[i], priorities[i]));
+    }
+    queue.run();
+
+    std::vector<int> expected;
+    for (int priority : priorities)
+    {
+        if (priority >= 0)
+        {
+            expected.push_back(priority);
+        }
+    }
+    std::sort(expected.begin(), expected.end());
+    assert(result == expected);
+}
+#endif // TEST_PRIORITY_HANDLES
+
+#ifdef TEST_METRICS
+#include <sstream>
+
+void test_metrics_histogram()
+{
+    typedef task_metrics::histogram<> histogram;
+    for (uint64_t value : { 0ull, 1ull, 15ull, 16ull, 17ull, 100ull, 1000000ull, ~0ull })
+    {
+        size_t index = histogram::index_of(value);
+        assert(index < histogram::bucket_count);
+        assert(histogram::value_of(index) <= value);
+        assert(index + 1 == histogram::bucket_count || histogram::value_of(index + 1) > value);
+    }
+
+    histogram values;
+    assert(values.count() == 0);
+    assert(values.percentile(0.5) == 0);
+    for (uint64_t i = 1; i <= 1000; ++i)
+    {
+        values.record(i);
+    }
+    assert(values.count() == 1000);
+    uint64_t median = values.percentile(0.5);
+    assert(median <= 500 && median >= 500 - 500 / histogram::sub_buckets);
+    assert(values.percentile(1.0) <= 1000 && values.percentile(1.0) > 900);
+
+    std::ostringstream text;
+    values.print(text);
+    assert(text.str().find("1 1\n") == 0);
+}
+
+#ifdef TASK_QUEUE_METRICS
+void test_metrics_queues()
+{
+    ordered_task_queue queue;
+    for (size_t i = 0; i < 10; ++i)
+    {
+        queue.push([] {});
+    }
+    assert(queue.metrics().depth == 10);
+    assert(queue.run_one() == 1);
+    assert(queue.run() == 9);
+    assert(queue.metrics().depth == 0);
+    assert(queue.metrics().max_depth == 10);
+    assert(queue.metrics().wait_ns.count() == 10);
+    assert(queue.metrics().run_ns.count() == 10);
+
+    priority_task_queue<int> priority;
+    auto handle = priority.push([] {}, 1);
+    priority.push([] {}, 2);
+    priority.erase(handle);
+    assert(priority.metrics().depth == 1);
+    priority.run();
+    assert(priority.metrics().depth == 0);
+    assert(priority.metrics().run_ns.count() == 1);
+
+    // the wait starts at push, not when the task is built
+    std::vector<ordered_task_queue::function> tasks;
+    tasks.emplace_back([] {});
+    tasks.emplace_back([] {});
+    assert(task_metrics::enqueued_at(tasks[0]) == 0);
+    ordered_task_queue bulk;
+    bulk.push_bulk(tasks.begin(), tasks.end());
+    bulk.push([] {});
+    assert(bulk.metrics().depth == 3);
+    assert(bulk.run() == 3);
+    assert(bulk.metrics().wait_ns.count() == 3);
+
+    std::ostringstream text;
+    queue.metrics().print(text);
+    assert(text.str().find("wait_ns count 10") == 0);
+}
+
+void test_metrics_mpmc_depth()
+{
+    mpmc_ordered_task_queue<4> full;
+    for (size_t i = 0; i < 4; ++i)
+    {
+        full.push([] {});
+    }
+    assert(!full.try_push([] {}));
+    std::vector<mpmc_ordered_task_queue<4>::function> tasks;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        tasks.emplace_back([] {});
+    }
+    assert(full.push_bulk(tasks.begin(), tasks.end()) == tasks.begin());
+    assert(full.metrics().depth == 4);
+    assert(full.run() == 4);
+    assert(full.metrics().depth == 0);
+
+    // a consumer racing the producer must never pop a task before its push is counted
+    const size_t count = 20000;
+    mpmc_ordered_task_queue<64> queue;
+    std::atomic<size_t> ran(0);
+    std::thread consumer([&queue, &ran] {
+        while (ran.load() != count)
+        {
+            ran += queue.run_batch(8);
+        }
+    });
+    for (size_t i = 0; i < count; ++i)
+    {
+        while (!queue.try_push([] {}))
+        {
+            std::this_thread::yield();
+        }
+    }
+    consumer.join();
+    assert(queue.metrics().depth == 0);
+    assert(queue.metrics().max_depth <= 65);
+}
+#endif
+#endif // TEST_METRICS
+
+#ifdef TEST_LANES
+void test_lanes_ordering()
+{
+    std::vector<std::string> dst;
+    priority_task_queue<lane_priority<8>> queue;
+    auto push_str = [&dst](std::string str) {
+        dst.push_back(str);
+    };
+    assert(queue.empty());
+    queue.push(std::bind(push_str, "low1"), 1);
+    queue.push(std::bind(push_str, "high1"), 7);
+    queue.push(std::bind(push_str, "low2"), 1);
+    queue.push(std::bind(push_str, "mid"), 4);
+    queue.push(std::bind(push_str, "high2"), 7);
+    assert(queue.size() == 5);
+    assert(queue.run_one() == 1);
+    assert(queue.run() == 4);
+    assert(queue.empty());
+
+    std::vector<std::string> expected = { "high1", "high2", "mid", "low1", "low2" };
+    assert(dst == expected);
+
+    bool thrown = false;
+    try
+    {
+        queue.push([] {}, 8);
+    } catch (std::out_of_range const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+}
+
+void test_lanes_greater()
+{
+    std::vector<std::pair<size_t, size_t>> dst;
+    priority_task_queue<lane_priority<16>, std::greater<lane_priority<16>>> queue;
+    srand(42);
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        size_t lane = rand() % 16;
+        queue.push([&dst, lane, i] { dst.push_back(std::make_pair(lane, i)); }, lane);
+    }
+    assert(queue.run() == 1000);
+    assert(std::is_sorted(dst.begin(), dst.end()));
+}
+
+void test_lanes_handles()
+{
+    std::vector<int> dst;
+    priority_task_queue<lane_priority<8>> queue;
+    auto first = queue.push([&dst] { dst.push_back(1); }, 2);
+    auto second = queue.push([&dst] { dst.push_back(2); }, 2);
+    auto third = queue.push([&dst] { dst.push_back(3); }, 5);
+    assert(queue.top().value == 5);
+    assert(queue.erase(third));
+    assert(!queue.erase(third) && !queue.contains(third));
+    assert(queue.top().value == 2);
+    assert(queue.update(first, 6));
+    assert(queue.top().value == 6);
+    assert(queue.size() == 2);
+    assert(queue.run() == 2);
+    assert((dst == std::vector<int>{ 1, 2 }));
+    assert(!queue.contains(first) && !queue.contains(second));
+
+    // many updates of one queued task do not grow its lane without bound
+    auto kept = queue.push([&dst] { dst.push_back(4); }, 1);
+    auto moved = queue.push([&dst] { dst.push_back(5); }, 1);
+    for (size_t i = 0; i < 10000; ++i)
+    {
+        assert(queue.update(moved, 1 + i % 2));
+    }
+    assert(queue.contains(kept) && queue.size() == 2);
+    assert(queue.run() == 2);
+    assert((dst == std::vector<int>{ 1, 2, 5, 4 }));
+
+    priority_task_queue<lane_priority<8>> moved_to(std::move(queue));
+    assert(queue.empty() && moved_to.empty());
+    queue.push([&dst] { dst.push_back(6); }, 3);
+    assert(queue.run() == 1 && dst.back() == 6);
+}
+#endif // TEST_LANES
+
+#if defined(TEST_COROUTINES) && __cplusplus >= 202002L
+#include "coro_task_queue.h"
+
+static task<int> coro_add(ordered_task_queue& queue, std::vector<std::string>& dst, int a, int b)
+{
+    dst.push_back("add before");
+    co_await schedule(queue);
+    dst.push_back("add after");
+    co_return a + b;
+}
+
+static task<> coro_main(ordered_task_queue& queue, std::vector<std::string>& dst, int& result)
+{
+    dst.push_back("main");
+    result = co_await coro_add(queue, dst, 1, 2);
+    co_await schedule(queue);
+    dst.push_back("main done");
+}
+
+void test_coroutine_ordered()
+{
+    std::vector<std::string> dst;
+    ordered_task_queue queue;
+    int result = 0;
+    task<> main_task = coro_main(queue, dst, result);
+    assert(dst.empty());
+    main_task.start();
+    assert(!main_task.done());
+    assert(dst.size() == 2);
+    queue.push([&dst] { dst.push_back("closure"); });
+    assert(queue.run() == 3);
+    assert(main_task.done());
+    main_task.result();
+    assert(result == 3);
+
+    std::vector<std::string> expected = { "main", "add before", "add after", "closure", "main done" };
+    assert(dst == expected);
+}
+
+static task<> coro_priority(priority_task_queue<int>& queue, std::vector<int>& dst, int priority)
+{
+    co_await schedule(queue, priority);
+    dst.push_back(priority);
+}
+
+static task<int> coro_throw(ordered_task_queue& queue)
+{
+    co_await schedule(queue);
+    throw std::runtime_error("coroutine failed");
+}
+
+void test_coroutine_priority_and_exceptions()
+{
+    priority_task_queue<int> queue;
+    std::vector<int> dst;
+    std::vector<task<>> tasks;
+    for (int priority : { 2, 5, 1 })
+    {
+        tasks.push_back(coro_priority(queue, dst, priority));
+        tasks.back().start();
+    }
+    assert(queue.run() == 3);
+    std::vector<int> expected = { 5, 2, 1 };
+    assert(dst == expected);
+
+    ordered_task_queue ordered;
+    task<int> failing = coro_throw(ordered);
+    failing.start();
+    ordered.run();
+    assert(failing.done());
+    bool thrown = false;
+    try
+    {
+        failing.result();
+    } catch (std::runtime_error const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+}
+#endif // TEST_COROUTINES
+
+#ifdef TEST_EDF
+#include "edf_task_queue.h"
+
+struct manual_clock
+{
+    typedef std::chrono::milliseconds duration;
+    typedef std::chrono::time_point<manual_clock, duration> time_point;
+
+    static time_point now()
+    {
+        return current;
+    }
+
+    static time_point current;
+};
+
+manual_clock::time_point manual_clock::current;
+
+void test_edf_ordering_and_misses()
+{
+    typedef manual_clock::time_point time_point;
+    typedef std::chrono::milliseconds ms;
+    manual_clock::current = time_point(ms(0));
+
+    std::vector<std::string> dst;
+    edf_task_queue<manual_clock> queue;
+    auto work = [&dst](std::string name, int cost) {
+        return [&dst, name, cost] {
+            dst.push_back(name);
+            manual_clock::current += ms(cost);
+        };
+    };
+    // Latest starts: a = 90, b = 40, c = 45, d = 5.
+    queue.push(work("a", 10), time_point(ms(100)), ms(10));
+    queue.push(work("b", 10), time_point(ms(50)), ms(10));
+    auto c = queue.push(work("c", 5), time_point(ms(50)), ms(5));
+    queue.push(work("d", 20), time_point(ms(25)), ms(20));
+    assert(queue.size() == 4);
+    assert(queue.next_slack(time_point(ms(0))) == ms(5));
+    assert(queue.update(c, time_point(ms(60)), ms(5)));
+
+    assert(queue.run() == 4);
+    std::vector<std::string> expected = { "d", "b", "c", "a" };
+    assert(dst == expected);
+    assert(queue.statistics().executed == 4);
+    assert(queue.statistics().missed == 0);
+
+    dst.clear();
+    manual_clock::current = time_point(ms(70));
+    queue.push(work("late", 30), time_point(ms(80)), ms(10));
+    queue.push(work("later", 10), time_point(ms(90)), ms(10));
+    assert(queue.run() == 2);
+    assert(queue.statistics().missed == 2);
+    assert(queue.statistics().max_lateness == ms(20));
+}
+#endif // TEST_EDF
+
 int main()
 {
 #ifdef TEST_TASK1
@@ -264,5 +1357,72 @@ int main()
 
 #ifdef TEST_TASK3
     test_sleep_sorting();
+    test_task_sort_large();
+    test_task_sort_executor();
+    test_task_sort_concurrent();
+#endif
+
+#ifdef TEST_WORK_STEALING
+    test_work_stealing_empty();
+    test_work_stealing_many_elements();
+    test_work_stealing_nested_push();
+    test_work_stealing_strand_ordering();
+    test_work_stealing_overlapping_runs();
+    test_work_stealing_idle_workers();
+    test_work_stealing_exceptions();
+#endif
+
+#ifdef TEST_MPMC
+    test_mpmc_ordering();
+    test_mpmc_concurrent();
+    test_mpmc_throwing_task();
+#endif
+
+#ifdef TEST_INLINE_TASK
+    test_inline_task_no_allocations();
+    test_inline_task_heap_fallback();
+    test_inline_task_destruction();
+#endif
+
+#ifdef TEST_BATCH
+    test_batch_ordered();
+    test_batch_mpmc();
+    test_batch_work_stealing();
+#endif
+
+#ifdef TEST_TIMER_WHEEL
+    test_timer_wheel_ordering();
+    test_timer_wheel_cancel();
+    test_timer_wheel_far_future();
+    test_timer_wheel_random();
+#endif
+
+#ifdef TEST_PRIORITY_HANDLES
+    test_priority_erase_update();
+    test_priority_handles_random();
+    test_priority_move_constructor();
+#endif
+
+#ifdef TEST_LANES
+    test_lanes_ordering();
+    test_lanes_greater();
+    test_lanes_handles();
+#endif
+
+#if defined(TEST_COROUTINES) && __cplusplus >= 202002L
+    test_coroutine_ordered();
+    test_coroutine_priority_and_exceptions();
+#endif
+
+#ifdef TEST_EDF
+    test_edf_ordering_and_misses();
+#endif
+
+#ifdef TEST_METRICS
+    test_metrics_histogram();
+#ifdef TASK_QUEUE_METRICS
+    test_metrics_queues();
+    test_metrics_mpmc_depth();
+#endif
 #endif
 }
\ No newline at end of file
@@ -0,0 +1,217 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+
+/*
+ * Bounded lock-free multi-producer/multi-consumer queue
+ * (Dmitry Vyukov's sequence-per-cell ring).
+ *
+ * Every cell carries a sequence number telling whether it is ready to be written
+ * for the current lap or ready to be read. Producers and consumers claim a cell
+ * with a single CAS on their own position counter, so there is no lock and no
+ * allocation after construction. CAPACITY has to be a power of two.
+ */
+template<typename T, size_t CAPACITY = 1024>
+struct mpmc_ring_buffer
+{
+	typedef T value_type;
+
+	static_assert(CAPACITY >= 2 && (CAPACITY & (CAPACITY - 1)) == 0,
+		"mpmc_ring_buffer capacity should be a power of two");
+
+	mpmc_ring_buffer()
+		: cells_(new cell[CAPACITY])
+		, enqueue_pos_(0)
+		, dequeue_pos_(0) {
+		for(size_t i = 0; i < CAPACITY; ++i) {
+			cells_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+	}
+	mpmc_ring_buffer(mpmc_ring_buffer const& other) = delete;
+	mpmc_ring_buffer& operator=(mpmc_ring_buffer const& other) = delete;
+
+	bool try_push(T&& value) {
+		cell* target;
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		while(true) {
+			target = &cells_[pos & mask];
+			size_t seq = target->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+			if(diff == 0) {
+				if(enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if(diff < 0) {
+				return false;
+			}
+			else {
+				pos = enqueue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+
+		target->value = std::move(value);
+		target->sequence.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool try_pop(T& value) {
+		cell* target;
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		while(true) {
+			target = &cells_[pos & mask];
+			size_t seq = target->sequence.load(std::memory_order_acquire);
+			intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+			if(diff == 0) {
+				if(dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					break;
+				}
+			}
+			else if(diff < 0) {
+				return false;
+			}
+			else {
+				pos = dequeue_pos_.load(std::memory_order_relaxed);
+			}
+		}
+
+		value = std::move(target->value);
+		target->value = T();
+		target->sequence.store(pos + mask + 1, std::memory_order_release);
+		return true;
+	}
+
+	/*
+	 * Claims as many free cells as are available for [first, last) with a single CAS
+	 * and moves the values in. Returns the iterator past the last value pushed.
+	 */
+	template<typename FWD_IT>
+	FWD_IT try_push_bulk(FWD_IT first, FWD_IT last) {
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		size_t count;
+		while(true) {
+			count = 0;
+			for(FWD_IT it = first; it != last && count < CAPACITY; ++it, ++count) {
+				if(cells_[(pos + count) & mask].sequence.load(std::memory_order_acquire) != pos + count) {
+					break;
+				}
+			}
+			if(count == 0) {
+				size_t current = enqueue_pos_.load(std::memory_order_relaxed);
+				if(current == pos) {
+					return first;
+				}
+				pos = current;
+			}
+			else if(enqueue_pos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+
+		for(size_t i = 0; i < count; ++i, ++first) {
+			cell& target = cells_[(pos + i) & mask];
+			target.value = std::move(*first);
+			target.sequence.store(pos + i + 1, std::memory_order_release);
+		}
+		return first;
+	}
+
+	/*
+	 * Claims up to max ready cells with a single CAS and hands every value to consumer
+	 * in FIFO order. A cell is released before its value is consumed. The claimed slice
+	 * cannot be given back, so if consumer throws the rest of it is still consumed and
+	 * the first exception is rethrown afterwards.
+	 */
+	template<typename F>
+	size_t consume(size_t max, F&& consumer) {
+		size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+		size_t count;
+		while(true) {
+			count = 0;
+			while(count < max && count < CAPACITY
+				&& cells_[(pos + count) & mask].sequence.load(std::memory_order_acquire) == pos + count + 1) {
+				++count;
+			}
+			if(count == 0) {
+				size_t current = dequeue_pos_.load(std::memory_order_relaxed);
+				if(current == pos) {
+					return 0;
+				}
+				pos = current;
+			}
+			else if(dequeue_pos_.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+				break;
+			}
+		}
+
+		std::exception_ptr error;
+		for(size_t i = 0; i < count; ++i) {
+			T value(release(pos + i));
+			try {
+				consumer(value);
+			}
+			catch(...) {
+				if(!error) {
+					error = std::current_exception();
+				}
+			}
+		}
+		if(error) {
+			std::rethrow_exception(error);
+		}
+		return count;
+	}
+
+	// Only a snapshot when other threads are pushing or popping.
+	bool empty() const {
+		return size() == 0;
+	}
+	size_t size() const {
+		size_t dequeued = dequeue_pos_.load(std::memory_order_acquire);
+		size_t enqueued = enqueue_pos_.load(std::memory_order_acquire);
+		return enqueued > dequeued ? enqueued - dequeued : 0;
+	}
+	static size_t capacity() {
+		return CAPACITY;
+	}
+
+	// Not thread-safe: both rings should be quiescent.
+	void swap(mpmc_ring_buffer& other) {
+		std::swap(cells_, other.cells_);
+		size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+		enqueue_pos_.store(other.enqueue_pos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		other.enqueue_pos_.store(pos, std::memory_order_relaxed);
+		pos = dequeue_pos_.load(std::memory_order_relaxed);
+		dequeue_pos_.store(other.dequeue_pos_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		other.dequeue_pos_.store(pos, std::memory_order_relaxed);
+	}
+
+private:
+	T release(size_t pos) {
+		cell& target = cells_[pos & mask];
+		T value(std::move(target.value));
+		target.value = T();
+		target.sequence.store(pos + mask + 1, std::memory_order_release);
+		return value;
+	}
+
+	static const size_t mask = CAPACITY - 1;
+	static const size_t cache_line = 64;
+
+	struct cell {
+		std::atomic<size_t> sequence;
+		T value;
+	};
+
+	// Positions live on separate cache lines so producers and consumers do not share one.
+	std::unique_ptr<cell[]> cells_;
+	char pad0_[cache_line];
+	std::atomic<size_t> enqueue_pos_;
+	char pad1_[cache_line - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t> dequeue_pos_;
+	char pad2_[cache_line - sizeof(std::atomic<size_t>)];
+};
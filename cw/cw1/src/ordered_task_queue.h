@@ -2,33 +2,142 @@
 #include <stdlib.h>
 #include <queue>
 #include <functional>
+#include <stdexcept>
+#include <iterator>
+#include "mpmc_ring_buffer.h"
+#include "inline_task.h"
+#include "task_metrics.h"
 
-struct ordered_task_queue
+/*
+ * Default storage of ordered_task_queue: unbounded, single-threaded.
+ * A storage provides try_push(T&&), try_push_bulk(first, last), try_pop(T&),
+ * consume(max, consumer), empty() and swap().
+ */
+template<typename T>
+struct queue_storage
 {
-	typedef std::function<void()> function;
-	ordered_task_queue() = default;
-	ordered_task_queue(ordered_task_queue && other) {
-		std::swap(other.queue_, queue_);
+	typedef T value_type;
+
+	bool try_push(T&& value) {
+		queue_.push(std::move(value));
+		return true;
 	}
-	ordered_task_queue(ordered_task_queue const& other) = delete;
-	ordered_task_queue& operator=(ordered_task_queue const& other) = delete;
-	void push(function const& task){
-		queue_.push(task);
+	template<typename FWD_IT>
+	FWD_IT try_push_bulk(FWD_IT first, FWD_IT last) {
+		for(; first != last; ++first) {
+			queue_.push(std::move(*first));
+		}
+		return first;
+	}
+	bool try_pop(T& value) {
+		if(queue_.empty()) {
+			return false;
+		}
+		value = std::move(queue_.front());
+		queue_.pop();
+		return true;
+	}
+	template<typename F>
+	size_t consume(size_t max, F&& consumer) {
+		size_t count = 0;
+		for(; count < max && !queue_.empty(); ++count) {
+			T value(std::move(queue_.front()));
+			queue_.pop();
+			consumer(value);
+		}
+		return count;
+	}
+	bool empty() const {
+		return queue_.empty();
+	}
+	void swap(queue_storage& other) {
+		std::swap(queue_, other.queue_);
+	}
+
+private:
+	std::queue<T> queue_;
+};
+
+/*
+ * STORAGE = mpmc_ring_buffer<function, N> gives a bounded queue
+ * which producer and consumer threads may use without a mutex.
+ */
+template<typename STORAGE = queue_storage<queued_task>>
+struct basic_ordered_task_queue
+{
+	typedef typename STORAGE::value_type function;
+	basic_ordered_task_queue() = default;
+	basic_ordered_task_queue(basic_ordered_task_queue && other) {
+		queue_.swap(other.queue_);
+	}
+	basic_ordered_task_queue(basic_ordered_task_queue const& other) = delete;
+	basic_ordered_task_queue& operator=(basic_ordered_task_queue const& other) = delete;
+	void push(function&& task){
+		if(!try_push(std::move(task))) {
+			throw std::overflow_error("task queue is full");
+		}
+	}
+	// Same as push() but reports a full bounded queue instead of throwing.
+	bool try_push(function&& task){
+#ifdef TASK_QUEUE_METRICS
+		task_metrics::mark_enqueued(task);
+		metrics_.on_push();
+#endif
+		if(!queue_.try_push(std::move(task))) {
+#ifdef TASK_QUEUE_METRICS
+			metrics_.on_push_failed();
+#endif
+			return false;
+		}
+		return true;
+	}
+	/*
+	 * Moves [first, last) into the queue, as much of it as a bounded queue has room
+	 * for, and returns the iterator past the last task pushed: last unless the queue
+	 * filled up. It does not throw, so the caller knows which tasks were moved out.
+	 */
+	template<typename FWD_IT>
+	FWD_IT push_bulk(FWD_IT first, FWD_IT last){
+#ifdef TASK_QUEUE_METRICS
+		size_t count = 0;
+		for(FWD_IT task = first; task != last; ++task, ++count) {
+			task_metrics::mark_enqueued(*task);
+		}
+		metrics_.on_push(count);
+#endif
+		while(first != last) {
+			FWD_IT next = queue_.try_push_bulk(first, last);
+			if(next == first) {
+				break;
+			}
+			first = next;
+		}
+#ifdef TASK_QUEUE_METRICS
+		if(first != last) {
+			metrics_.on_push_failed(std::distance(first, last));
+		}
+#endif
+		return first;
 	}
 	size_t run_one() {
 		size_t result = 0;
-		if(!queue_.empty()) {
-			queue_.front()();
-			queue_.pop();
+		function task;
+		if(queue_.try_pop(task)) {
+			execute(task);
 			++result;
 		}
 
 		return result;
 	}
+	// Takes up to max_n tasks off the queue in one pass and runs them in order.
+	size_t run_batch(size_t max_n) {
+		return queue_.consume(max_n, [this](function& task) { execute(task); });
+	}
 	size_t run() {
 		size_t result = 0;
-		while(run_one() != 0) {
-			++result;
+		size_t executed;
+		while((executed = run_batch(run_batch_size)) != 0) {
+			result += executed;
 		}
 
 		return result;
@@ -36,7 +145,33 @@ struct ordered_task_queue
 	bool empty() const {
 		return queue_.empty();
 	}
+#ifdef TASK_QUEUE_METRICS
+	task_metrics::queue_metrics const& metrics() const {
+		return metrics_;
+	}
+#endif
 
 private:
-	std::queue<function> queue_;
-};
\ No newline at end of file
+	static const size_t run_batch_size = 64;
+
+	void execute(function& task) {
+#ifdef TASK_QUEUE_METRICS
+		metrics_.on_pop();
+		uint64_t started = task_metrics::now_ns();
+		task();
+		metrics_.on_run(task_metrics::enqueued_at(task), started, task_metrics::now_ns());
+#else
+		task();
+#endif
+	}
+
+	STORAGE queue_;
+#ifdef TASK_QUEUE_METRICS
+	task_metrics::queue_metrics metrics_;
+#endif
+};
+
+typedef basic_ordered_task_queue<> ordered_task_queue;
+
+template<size_t CAPACITY = 1024>
+using mpmc_ordered_task_queue = basic_ordered_task_queue<mpmc_ring_buffer<queued_task, CAPACITY>>;
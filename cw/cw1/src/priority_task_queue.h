@@ -1,48 +1,390 @@
 #pragma once
 #include <stdlib.h>
-#include <queue>
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <algorithm>
+#include <type_traits>
 #include <functional>
 #include <iostream>
+#include <stdexcept>
+#include "inline_task.h"
+#include "task_metrics.h"
 
-template<typename PRIOR=size_t, typename COMP=std::less<PRIOR>>
+/*
+ * Priority queue of tasks backed by an indexed ARITY-ary heap.
+ *
+ * The heap keeps (priority, slot) pairs only; tasks stay put in a slot table
+ * which also remembers each task's heap position. push() returns a handle to the
+ * slot, so a queued task can be erased or re-prioritized in O(log n).
+ * As with std::priority_queue, the task with the greatest priority
+ * according to COMP runs first. A 4-ary heap is half as deep as a binary one
+ * and compares the children of a node within a cache line or two.
+ */
+template<typename PRIOR=size_t, typename COMP=std::less<PRIOR>, typename TASK=queued_task, size_t ARITY=4>
 struct priority_task_queue
 {
+	static_assert(ARITY >= 2, "priority_task_queue heap should be at least binary");
+
+	typedef TASK function;
+
+	struct handle {
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	priority_task_queue(COMP const& cmp = COMP())
+		: comparator_(cmp)
+		, free_(npos)
+	{
+
+	}
+	// The moved-from queue is left empty, with no free slot list into its emptied table.
+	priority_task_queue(priority_task_queue && other)
+		: comparator_(std::move(other.comparator_))
+		, heap_(std::move(other.heap_))
+		, slots_(std::move(other.slots_))
+		, free_(other.free_)
+	{
+		other.heap_.clear();
+		other.slots_.clear();
+		other.free_ = npos;
+#ifdef TASK_QUEUE_METRICS
+		// the histograms stay behind; the depth moves with the tasks
+		metrics_.depth.store(heap_.size(), std::memory_order_relaxed);
+		other.metrics_.depth.store(0, std::memory_order_relaxed);
+#endif
+	}
+	priority_task_queue(priority_task_queue const& other) = delete;
+	priority_task_queue& operator=(priority_task_queue const& other) = delete;
+	handle push(function&& task, PRIOR priority){
+#ifdef TASK_QUEUE_METRICS
+		task_metrics::mark_enqueued(task);
+#endif
+		uint32_t index = allocate_slot();
+		slots_[index].task = std::move(task);
+		heap_.push_back(entry{ std::move(priority), index });
+		sift_up(heap_.size() - 1);
+#ifdef TASK_QUEUE_METRICS
+		metrics_.on_push();
+#endif
+		return handle{ index, slots_[index].generation };
+	}
+	// Returns false if the task has already run or been erased.
+	bool erase(handle task) {
+		if(!contains(task)) {
+			return false;
+		}
+		remove_at(slots_[task.index].position);
+		release_slot(task.index);
+#ifdef TASK_QUEUE_METRICS
+		metrics_.on_pop();
+#endif
+		return true;
+	}
+	bool update(handle task, PRIOR priority) {
+		if(!contains(task)) {
+			return false;
+		}
+		size_t position = slots_[task.index].position;
+		heap_[position].priority = std::move(priority);
+		restore(position);
+		return true;
+	}
+	bool contains(handle task) const {
+		return task.index < slots_.size()
+			&& slots_[task.index].generation == task.generation
+			&& slots_[task.index].position != npos_position;
+	}
+	size_t run_one() {
+		size_t result = 0;
+		if(!heap_.empty()) {
+			uint32_t index = heap_.front().slot;
+			function task = std::move(slots_[index].task);
+			remove_at(0);
+			release_slot(index);
+#ifdef TASK_QUEUE_METRICS
+			metrics_.on_pop();
+			uint64_t started = task_metrics::now_ns();
+			task();
+			metrics_.on_run(task_metrics::enqueued_at(task), started, task_metrics::now_ns());
+#else
+			task();
+#endif
+			++result;
+		}
+
+		return result;
+	}
+	size_t run() {
+		size_t result = 0;
+		while(run_one() != 0) {
+			++result;
+		}
+
+		return result;
+	}
+	bool empty() const {
+		return heap_.empty();
+	}
+	size_t size() const {
+		return heap_.size();
+	}
+	// Priority of the task run_one() would run next; the queue should not be empty.
+	PRIOR const& top() const {
+		return heap_.front().priority;
+	}
+#ifdef TASK_QUEUE_METRICS
+	task_metrics::queue_metrics const& metrics() const {
+		return metrics_;
+	}
+#endif
+
 private:
-	typedef std::function<void()> function;
-	typedef std::pair<std::function<void()>, PRIOR> prior_pair;
-	class comparer {
-	public:
-		comparer(COMP const & comp) 
-			: comparator_(comp){
-				
+	static const uint32_t npos = ~uint32_t(0);
+	static const size_t npos_position = ~size_t(0);
+
+	struct entry {
+		PRIOR priority;
+		uint32_t slot;
+	};
+
+	struct slot {
+		slot()
+			: position(npos_position)
+			, generation(0)
+			, next_free(npos) {
+		}
+
+		function task;
+		size_t position;
+		uint32_t generation;
+		uint32_t next_free;
+	};
+
+	uint32_t allocate_slot() {
+		if(free_ != npos) {
+			uint32_t index = free_;
+			free_ = slots_[index].next_free;
+			return index;
+		}
+		slots_.emplace_back();
+		return static_cast<uint32_t>(slots_.size() - 1);
+	}
+	void release_slot(uint32_t index) {
+		slot& released = slots_[index];
+		released.task = function();
+		released.position = npos_position;
+		++released.generation;
+		released.next_free = free_;
+		free_ = index;
+	}
+
+	// True if left should run before right.
+	bool before(PRIOR const& left, PRIOR const& right) {
+		return comparator_(right, left);
+	}
+	void set(size_t position, entry&& value) {
+		slots_[value.slot].position = position;
+		heap_[position] = std::move(value);
+	}
+
+	void sift_up(size_t position) {
+		entry moving = std::move(heap_[position]);
+		while(position > 0) {
+			size_t parent = (position - 1) / ARITY;
+			if(!before(moving.priority, heap_[parent].priority)) {
+				break;
+			}
+			set(position, std::move(heap_[parent]));
+			position = parent;
+		}
+		set(position, std::move(moving));
+	}
+	void sift_down(size_t position) {
+		size_t count = heap_.size();
+		entry moving = std::move(heap_[position]);
+		while(true) {
+			size_t first = position * ARITY + 1;
+			if(first >= count) {
+				break;
+			}
+			size_t last = first + ARITY < count ? first + ARITY : count;
+			size_t best = first;
+			for(size_t child = first + 1; child < last; ++child) {
+				if(before(heap_[child].priority, heap_[best].priority)) {
+					best = child;
+				}
 			}
-	
-		bool operator()(prior_pair const& left, prior_pair const& right) {
-			return comparator_(left.second, right.second);
+			if(!before(heap_[best].priority, moving.priority)) {
+				break;
+			}
+			set(position, std::move(heap_[best]));
+			position = best;
+		}
+		set(position, std::move(moving));
+	}
+	void restore(size_t position) {
+		if(position > 0 && before(heap_[position].priority, heap_[(position - 1) / ARITY].priority)) {
+			sift_up(position);
+		}
+		else {
+			sift_down(position);
+		}
+	}
+	void remove_at(size_t position) {
+		size_t last = heap_.size() - 1;
+		if(position != last) {
+			set(position, std::move(heap_[last]));
+			heap_.pop_back();
+			restore(position);
+		}
+		else {
+			heap_.pop_back();
 		}
-	private:
-		COMP comparator_;
+	}
+
+	COMP comparator_;
+	std::vector<entry> heap_;
+	std::vector<slot> slots_;
+	uint32_t free_;
+#ifdef TASK_QUEUE_METRICS
+	task_metrics::queue_metrics metrics_;
+#endif
+};
+
+/*
+ * Priority for queues with few distinct priorities: a value in [0, LANES).
+ * priority_task_queue<lane_priority<N>, ...> keeps one FIFO lane per value
+ * and a bitmap of non-empty lanes, so push and pop are O(1) and tasks of
+ * equal priority run in push order. It has the interface of the heap queue:
+ * push() returns a handle for erase() and update(), which are O(1) too.
+ */
+template<size_t LANES>
+struct lane_priority
+{
+	static_assert(LANES >= 1 && LANES <= 64, "lane_priority supports 1 to 64 lanes");
+	static const size_t lanes = LANES;
+
+	lane_priority(size_t value = 0)
+		: value(value) {
+	}
+	bool operator<(lane_priority const& other) const {
+		return value < other.value;
+	}
+	bool operator>(lane_priority const& other) const {
+		return value > other.value;
+	}
+
+	size_t value;
+};
+
+// std::less runs the highest lane first, std::greater the lowest one.
+template<size_t LANES, typename COMP, typename TASK, size_t ARITY>
+struct priority_task_queue<lane_priority<LANES>, COMP, TASK, ARITY>
+{
+	static_assert(std::is_same<COMP, std::less<lane_priority<LANES>>>::value
+		|| std::is_same<COMP, std::greater<lane_priority<LANES>>>::value,
+		"lane priority queues order by std::less or std::greater");
+
+	typedef TASK function;
+	typedef lane_priority<LANES> priority_type;
+
+	struct handle {
+		uint32_t index;
+		uint32_t generation;
 	};
-public:
-	
-	priority_task_queue(COMP const& cmp = COMP()) 
-		: queue_(std::priority_queue<std::pair<function, PRIOR>, std::vector<std::pair<function, PRIOR>>, comparer>(comparer(cmp)))	
+
+	priority_task_queue(COMP const& = COMP())
+		: occupied_(0)
+		, size_(0)
+		, free_(npos)
 	{
-		
+
 	}
-	priority_task_queue(ordered_task_queue && other) {
-		std::swap(other.queue_, queue_);
+	// The moved-from queue is left empty, with no free slot list into its emptied table.
+	priority_task_queue(priority_task_queue && other)
+		: slots_(std::move(other.slots_))
+		, occupied_(other.occupied_)
+		, size_(other.size_)
+		, free_(other.free_)
+	{
+		for(size_t lane = 0; lane < LANES; ++lane) {
+			lanes_[lane].swap(other.lanes_[lane]);
+			live_[lane] = other.live_[lane];
+			other.live_[lane] = 0;
+		}
+		other.slots_.clear();
+		other.occupied_ = 0;
+		other.size_ = 0;
+		other.free_ = npos;
+#ifdef TASK_QUEUE_METRICS
+		metrics_.depth.store(size_, std::memory_order_relaxed);
+		other.metrics_.depth.store(0, std::memory_order_relaxed);
+#endif
 	}
 	priority_task_queue(priority_task_queue const& other) = delete;
 	priority_task_queue& operator=(priority_task_queue const& other) = delete;
-	void push(function const& task, PRIOR priority){
-		queue_.push(std::make_pair(task, priority));
+	handle push(function&& task, priority_type priority){
+		check(priority);
+#ifdef TASK_QUEUE_METRICS
+		task_metrics::mark_enqueued(task);
+#endif
+		uint32_t index = allocate_slot();
+		slots_[index].task = std::move(task);
+		enqueue(index, priority.value);
+		++size_;
+#ifdef TASK_QUEUE_METRICS
+		metrics_.on_push();
+#endif
+		return handle{ index, slots_[index].generation };
+	}
+	// Returns false if the task has already run or been erased.
+	bool erase(handle task) {
+		if(!contains(task)) {
+			return false;
+		}
+		dequeue(task.index);
+		release_slot(task.index);
+		--size_;
+#ifdef TASK_QUEUE_METRICS
+		metrics_.on_pop();
+#endif
+		return true;
+	}
+	// Moves the task to the back of its new lane.
+	bool update(handle task, priority_type priority) {
+		check(priority);
+		if(!contains(task)) {
+			return false;
+		}
+		dequeue(task.index);
+		enqueue(task.index, priority.value);
+		return true;
+	}
+	bool contains(handle task) const {
+		return task.index < slots_.size()
+			&& slots_[task.index].generation == task.generation
+			&& slots_[task.index].lane != npos;
 	}
 	size_t run_one() {
 		size_t result = 0;
-		if(!queue_.empty()) {
-			queue_.top().first();
-			queue_.pop();
+		if(occupied_ != 0) {
+			size_t lane = next_lane();
+			uint32_t index = front(lane);
+			function task = std::move(slots_[index].task);
+			lanes_[lane].pop_front();
+			dequeue(index);
+			release_slot(index);
+			--size_;
+#ifdef TASK_QUEUE_METRICS
+			metrics_.on_pop();
+			uint64_t started = task_metrics::now_ns();
+			task();
+			metrics_.on_run(task_metrics::enqueued_at(task), started, task_metrics::now_ns());
+#else
+			task();
+#endif
 			++result;
 		}
 
@@ -57,21 +399,113 @@ public:
 		return result;
 	}
 	bool empty() const {
-		return queue_.empty();
+		return size_ == 0;
+	}
+	size_t size() const {
+		return size_;
 	}
+	// Priority of the task run_one() would run next; the queue should not be empty.
+	priority_type top() const {
+		return priority_type(next_lane());
+	}
+#ifdef TASK_QUEUE_METRICS
+	task_metrics::queue_metrics const& metrics() const {
+		return metrics_;
+	}
+#endif
 
 private:
-	std::priority_queue<std::pair<function, PRIOR>, std::vector<std::pair<function, PRIOR>>, comparer> queue_;
-};
+	static const uint32_t npos = ~uint32_t(0);
+
+	// A lane holds (slot, ticket) pairs; an erased or moved task leaves its pair behind with a stale ticket.
+	struct entry {
+		uint32_t slot;
+		uint32_t ticket;
+	};
+
+	struct slot {
+		slot()
+			: generation(0)
+			, ticket(0)
+			, lane(npos)
+			, next_free(npos) {
+		}
+
+		function task;
+		uint32_t generation;
+		uint32_t ticket;
+		uint32_t lane;
+		uint32_t next_free;
+	};
+
+	static void check(priority_type priority) {
+		if(priority.value >= LANES) {
+			throw std::out_of_range("lane priority is out of range");
+		}
+	}
+	size_t next_lane() const {
+		if(std::is_same<COMP, std::greater<priority_type>>::value) {
+			return __builtin_ctzll(occupied_);
+		}
+		return 63 - __builtin_clzll(occupied_);
+	}
+	// Drops stale pairs from the front of an occupied lane and returns its first task.
+	uint32_t front(size_t lane) {
+		std::deque<entry>& tasks = lanes_[lane];
+		while(slots_[tasks.front().slot].ticket != tasks.front().ticket) {
+			tasks.pop_front();
+		}
+		return tasks.front().slot;
+	}
+	void enqueue(uint32_t index, size_t lane) {
+		slot& queued = slots_[index];
+		queued.lane = static_cast<uint32_t>(lane);
+		std::deque<entry>& tasks = lanes_[lane];
+		if(tasks.size() > 2 * live_[lane] + 32) {
+			// mostly stale after many erase() or update() calls
+			tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [this](entry const& task) {
+				return slots_[task.slot].ticket != task.ticket;
+			}), tasks.end());
+		}
+		tasks.push_back(entry{ index, queued.ticket });
+		++live_[lane];
+		occupied_ |= uint64_t(1) << lane;
+	}
+	// Takes the task out of its lane's count; its pair, if still queued, goes stale.
+	void dequeue(uint32_t index) {
+		slot& queued = slots_[index];
+		size_t lane = queued.lane;
+		++queued.ticket;
+		queued.lane = npos;
+		if(--live_[lane] == 0) {
+			lanes_[lane].clear();
+			occupied_ &= ~(uint64_t(1) << lane);
+		}
+	}
+	uint32_t allocate_slot() {
+		if(free_ != npos) {
+			uint32_t index = free_;
+			free_ = slots_[index].next_free;
+			return index;
+		}
+		slots_.emplace_back();
+		return static_cast<uint32_t>(slots_.size() - 1);
+	}
+	void release_slot(uint32_t index) {
+		slot& released = slots_[index];
+		released.task = function();
+		++released.generation;
+		released.next_free = free_;
+		free_ = index;
+	}
 
-template<class fwd_it>
-void sleep_sort(fwd_it begin, fwd_it end) {
-	auto it = begin;
-	priority_task_queue<typename fwd_it::value_type> queue{};
-	while(begin != end) {
-		auto value = *begin;
-		queue.push([&it, value]() { *it = value; ++it; }, *begin); ++begin;
-	}
-	
-	queue.run();
-}
\ No newline at end of file
+	std::deque<entry> lanes_[LANES];
+	size_t live_[LANES] = {};
+	std::vector<slot> slots_;
+	uint64_t occupied_;
+	size_t size_;
+	uint32_t free_;
+#ifdef TASK_QUEUE_METRICS
+	task_metrics::queue_metrics metrics_;
+#endif
+};
@@ -0,0 +1,207 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <utility>
+#include "inline_task.h"
+
+/*
+ * Opt-in instrumentation of the task queues.
+ *
+ * Building with -DTASK_QUEUE_METRICS makes queued tasks remember when they were
+ * pushed and gives ordered_task_queue and priority_task_queue a metrics() member
+ * recording enqueue-to-start latency, run time and queue depth. Without the
+ * define none of this code is compiled into the queues.
+ */
+namespace task_metrics
+{
+	inline uint64_t now_ns() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	/*
+	 * Log-linear (HDR-style) histogram: every power of two is split into
+	 * 2^SUB_BITS equal buckets, so any recorded value is known within 1/2^SUB_BITS.
+	 * Recording is a single relaxed atomic increment.
+	 */
+	template<size_t SUB_BITS = 4>
+	struct histogram
+	{
+		static const size_t sub_buckets = size_t(1) << SUB_BITS;
+		static const size_t bucket_count = (64 - SUB_BITS + 1) * sub_buckets;
+
+		histogram() {
+			reset();
+		}
+		histogram(histogram const& other) = delete;
+		histogram& operator=(histogram const& other) = delete;
+
+		void record(uint64_t value) {
+			counts_[index_of(value)].fetch_add(1, std::memory_order_relaxed);
+		}
+		void reset() {
+			for(auto& count : counts_) {
+				count.store(0, std::memory_order_relaxed);
+			}
+		}
+		uint64_t count() const {
+			uint64_t total = 0;
+			for(auto const& count : counts_) {
+				total += count.load(std::memory_order_relaxed);
+			}
+			return total;
+		}
+		// Lower bound of the bucket holding the given fraction (0..1] of the values.
+		uint64_t percentile(double fraction) const {
+			uint64_t total = count();
+			if(total == 0) {
+				return 0;
+			}
+			uint64_t wanted = static_cast<uint64_t>(fraction * total + 0.5);
+			wanted = wanted == 0 ? 1 : wanted;
+			uint64_t seen = 0;
+			for(size_t index = 0; index < bucket_count; ++index) {
+				seen += counts_[index].load(std::memory_order_relaxed);
+				if(seen >= wanted) {
+					return value_of(index);
+				}
+			}
+			return value_of(bucket_count - 1);
+		}
+
+		// One "<bucket lower bound> <count>" line per non-empty bucket.
+		void print(std::ostream& os) const {
+			for(size_t index = 0; index < bucket_count; ++index) {
+				uint64_t count = counts_[index].load(std::memory_order_relaxed);
+				if(count != 0) {
+					os << value_of(index) << ' ' << count << '\n';
+				}
+			}
+		}
+
+		static size_t index_of(uint64_t value) {
+			if(value < sub_buckets) {
+				return static_cast<size_t>(value);
+			}
+			size_t shift = 63 - __builtin_clzll(value) - SUB_BITS;
+			return (shift + 1) * sub_buckets + static_cast<size_t>((value >> shift) & (sub_buckets - 1));
+		}
+		static uint64_t value_of(size_t index) {
+			if(index < sub_buckets) {
+				return index;
+			}
+			size_t shift = index / sub_buckets - 1;
+			return (uint64_t(sub_buckets) + index % sub_buckets) << shift;
+		}
+
+	private:
+		std::atomic<uint64_t> counts_[bucket_count];
+	};
+
+	struct queue_metrics
+	{
+		queue_metrics()
+			: depth(0)
+			, max_depth(0) {
+		}
+
+		// Counted before the task is visible to consumers, so on_pop never runs first.
+		void on_push(size_t count = 1) {
+			size_t current = depth.fetch_add(count, std::memory_order_relaxed) + count;
+			size_t seen = max_depth.load(std::memory_order_relaxed);
+			while(current > seen && !max_depth.compare_exchange_weak(seen, current, std::memory_order_relaxed)) {
+			}
+		}
+		void on_pop() {
+			depth.fetch_sub(1, std::memory_order_relaxed);
+		}
+		// Takes back an on_push() for tasks a full queue did not accept.
+		void on_push_failed(size_t count = 1) {
+			depth.fetch_sub(count, std::memory_order_relaxed);
+		}
+		// enqueued is 0 for tasks which do not carry a timestamp.
+		void on_run(uint64_t enqueued, uint64_t started, uint64_t finished) {
+			if(enqueued != 0) {
+				wait_ns.record(started - enqueued);
+			}
+			run_ns.record(finished - started);
+		}
+
+		void print(std::ostream& os) const {
+			print_summary(os, "wait_ns", wait_ns);
+			print_summary(os, "run_ns", run_ns);
+			os << "depth " << depth.load(std::memory_order_relaxed)
+				<< " max_depth " << max_depth.load(std::memory_order_relaxed) << '\n';
+			os << "# wait_ns buckets\n";
+			wait_ns.print(os);
+			os << "# run_ns buckets\n";
+			run_ns.print(os);
+		}
+
+		histogram<> wait_ns;
+		histogram<> run_ns;
+		std::atomic<size_t> depth;
+		std::atomic<size_t> max_depth;
+
+	private:
+		static void print_summary(std::ostream& os, char const* name, histogram<> const& values) {
+			os << name << " count " << values.count()
+				<< " p50 " << values.percentile(0.5)
+				<< " p90 " << values.percentile(0.9)
+				<< " p99 " << values.percentile(0.99)
+				<< " p999 " << values.percentile(0.999)
+				<< " max " << values.percentile(1.0) << '\n';
+		}
+	};
+
+	// A task which remembers when it was pushed; the queues stamp it with mark_enqueued().
+	template<typename TASK>
+	struct timed_task
+	{
+		timed_task()
+			: enqueued(0) {
+		}
+		template<typename F, typename = typename std::enable_if<
+			!std::is_same<typename std::decay<F>::type, timed_task>::value>::type>
+		timed_task(F&& callable)
+			: task(std::forward<F>(callable))
+			, enqueued(0) {
+		}
+		void operator()() const {
+			task();
+		}
+		explicit operator bool() const {
+			return static_cast<bool>(task);
+		}
+
+		TASK task;
+		uint64_t enqueued;
+	};
+
+	template<typename TASK>
+	void mark_enqueued(timed_task<TASK>& task) {
+		task.enqueued = now_ns();
+	}
+	template<typename TASK>
+	void mark_enqueued(TASK&) {
+	}
+
+	template<typename TASK>
+	uint64_t enqueued_at(timed_task<TASK> const& task) {
+		return task.enqueued;
+	}
+	template<typename TASK>
+	uint64_t enqueued_at(TASK const&) {
+		return 0;
+	}
+} // task_metrics
+
+// Default element type of the task queues.
+#ifdef TASK_QUEUE_METRICS
+typedef task_metrics::timed_task<inline_task<>> queued_task;
+#else
+typedef inline_task<> queued_task;
+#endif
@@ -0,0 +1,226 @@
+#pragma once
+#include <stdlib.h>
+#include <array>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <functional>
+#include <type_traits>
+#include <mutex>
+#include "work_stealing_task_queue.h"
+
+/*
+ * Sorting on top of work_stealing_task_queue.
+ *
+ * Integral keys go through an LSD radix sort (one byte per pass; each pass builds
+ * per-chunk histograms and then scatters chunks in parallel). Anything else, or
+ * any explicit comparator, goes through a merge sort: chunks are std::sort'ed in
+ * parallel and merged pairwise, with every merge split into independent pieces
+ * once there are fewer pairs than workers.
+ *
+ * The range is moved into a buffer and back, so forward iterators are enough;
+ * the value type has to be default constructible. Small ranges are sorted on
+ * the calling thread, big ones on a shared executor; concurrent calls on big
+ * ranges take turns on it, each one with all of its workers.
+ */
+namespace task_sort_detail
+{
+	const size_t parallel_threshold = 1 << 15;
+	const size_t chunks_per_worker = 4;
+
+	inline work_stealing_task_queue& default_executor() {
+		static work_stealing_task_queue executor;
+		return executor;
+	}
+
+	// Held for a whole sort on default_executor(), so that one sort's run() never waits on another's tasks.
+	inline std::mutex& default_executor_lock() {
+		static std::mutex lock;
+		return lock;
+	}
+
+	template<typename F>
+	void for_each_chunk(work_stealing_task_queue* executor, size_t chunks, F const& body) {
+		if(executor == nullptr || chunks == 1) {
+			for(size_t chunk = 0; chunk < chunks; ++chunk) {
+				body(chunk);
+			}
+			return;
+		}
+		for(size_t chunk = 0; chunk < chunks; ++chunk) {
+			executor->push([&body, chunk]() { body(chunk); });
+		}
+		executor->run();
+	}
+
+	template<typename T>
+	struct is_radix_key : std::integral_constant<bool,
+		std::is_integral<T>::value && !std::is_same<T, bool>::value> {
+	};
+
+	template<typename T>
+	void radix_sort(std::vector<T>& data, work_stealing_task_queue* executor) {
+		typedef typename std::make_unsigned<T>::type key_type;
+		const size_t radix = 256;
+		const key_type flip = std::is_signed<T>::value ? key_type(key_type(1) << (sizeof(T) * 8 - 1)) : key_type(0);
+
+		size_t count = data.size();
+		size_t chunks = executor == nullptr ? 1 : executor->concurrency();
+		size_t chunk_size = (count + chunks - 1) / chunks;
+		std::vector<T> buffer(count);
+		std::vector<std::array<size_t, radix>> offsets(chunks);
+
+		for(size_t shift = 0; shift < sizeof(T) * 8; shift += 8) {
+			auto digit = [flip, shift](T value) {
+				return static_cast<size_t>((static_cast<key_type>(value) ^ flip) >> shift) & (radix - 1);
+			};
+			for_each_chunk(executor, chunks, [&](size_t chunk) {
+				std::array<size_t, radix>& histogram = offsets[chunk];
+				histogram.fill(0);
+				size_t end = std::min(count, (chunk + 1) * chunk_size);
+				for(size_t i = chunk * chunk_size; i < end; ++i) {
+					++histogram[digit(data[i])];
+				}
+			});
+
+			// A byte shared by every key does not change the order.
+			bool trivial = false;
+			size_t position = 0;
+			for(size_t bucket = 0; bucket < radix; ++bucket) {
+				size_t total = 0;
+				for(size_t chunk = 0; chunk < chunks; ++chunk) {
+					size_t in_chunk = offsets[chunk][bucket];
+					offsets[chunk][bucket] = position;
+					position += in_chunk;
+					total += in_chunk;
+				}
+				trivial = trivial || total == count;
+			}
+			if(trivial) {
+				continue;
+			}
+
+			for_each_chunk(executor, chunks, [&](size_t chunk) {
+				std::array<size_t, radix>& next = offsets[chunk];
+				size_t end = std::min(count, (chunk + 1) * chunk_size);
+				for(size_t i = chunk * chunk_size; i < end; ++i) {
+					buffer[next[digit(data[i])]++] = std::move(data[i]);
+				}
+			});
+			data.swap(buffer);
+		}
+	}
+
+	template<typename T, typename COMP>
+	void merge_sort(std::vector<T>& data, COMP comp, work_stealing_task_queue* executor) {
+		size_t count = data.size();
+		size_t workers = executor == nullptr ? 1 : executor->concurrency();
+		size_t runs = workers == 1 ? 1 : workers * chunks_per_worker;
+		size_t run_size = (count + runs - 1) / runs;
+		std::vector<size_t> bounds;
+		for(size_t begin = 0; begin < count; begin += run_size) {
+			bounds.push_back(begin);
+		}
+		bounds.push_back(count);
+
+		for_each_chunk(executor, bounds.size() - 1, [&](size_t run) {
+			std::sort(data.begin() + bounds[run], data.begin() + bounds[run + 1], comp);
+		});
+
+		std::vector<T> buffer(count);
+		while(bounds.size() > 2) {
+			struct piece {
+				size_t left_begin, left_end, right_begin, right_end, out;
+			};
+			std::vector<piece> pieces;
+			std::vector<size_t> merged;
+			size_t pairs = (bounds.size() - 1) / 2;
+			size_t parts = std::max<size_t>(1, workers / std::max<size_t>(1, pairs));
+			for(size_t run = 0; run + 1 < bounds.size(); run += 2) {
+				merged.push_back(bounds[run]);
+				if(run + 2 >= bounds.size()) {
+					pieces.push_back(piece{ bounds[run], bounds[run + 1], bounds[run + 1], bounds[run + 1], bounds[run] });
+					continue;
+				}
+				size_t left = bounds[run];
+				size_t middle = bounds[run + 1];
+				size_t right_end = bounds[run + 2];
+				size_t previous_left = left;
+				size_t previous_right = middle;
+				for(size_t part = 1; part <= parts; ++part) {
+					size_t split_left = part == parts ? middle : left + (middle - left) * part / parts;
+					size_t split_right = part == parts ? right_end
+						: std::lower_bound(data.begin() + previous_right, data.begin() + right_end,
+							data[split_left], comp) - data.begin();
+					pieces.push_back(piece{ previous_left, split_left, previous_right, split_right,
+						previous_left + (previous_right - middle) });
+					previous_left = split_left;
+					previous_right = split_right;
+				}
+			}
+			merged.push_back(count);
+
+			for_each_chunk(executor, pieces.size(), [&](size_t index) {
+				piece const& p = pieces[index];
+				std::merge(std::make_move_iterator(data.begin() + p.left_begin),
+					std::make_move_iterator(data.begin() + p.left_end),
+					std::make_move_iterator(data.begin() + p.right_begin),
+					std::make_move_iterator(data.begin() + p.right_end),
+					buffer.begin() + p.out, comp);
+			});
+			data.swap(buffer);
+			bounds.swap(merged);
+		}
+	}
+
+	template<typename fwd_it, typename SORT>
+	void sort_through_buffer(fwd_it begin, fwd_it end, SORT sort) {
+		typedef typename std::iterator_traits<fwd_it>::value_type value_type;
+		std::vector<value_type> data(std::make_move_iterator(begin), std::make_move_iterator(end));
+		if(data.size() < parallel_threshold) {
+			sort(data, nullptr);
+		}
+		else {
+			std::lock_guard<std::mutex> lock(default_executor_lock());
+			sort(data, &default_executor());
+		}
+		std::move(data.begin(), data.end(), begin);
+	}
+
+	template<typename fwd_it>
+	void task_sort(fwd_it begin, fwd_it end, std::true_type) {
+		typedef typename std::iterator_traits<fwd_it>::value_type value_type;
+		sort_through_buffer(begin, end, [](std::vector<value_type>& data, work_stealing_task_queue* executor) {
+			radix_sort(data, executor);
+		});
+	}
+
+	template<typename fwd_it>
+	void task_sort(fwd_it begin, fwd_it end, std::false_type) {
+		typedef typename std::iterator_traits<fwd_it>::value_type value_type;
+		sort_through_buffer(begin, end, [](std::vector<value_type>& data, work_stealing_task_queue* executor) {
+			merge_sort(data, std::less<value_type>(), executor);
+		});
+	}
+} // task_sort_detail
+
+template<class fwd_it, class COMP>
+void task_sort(fwd_it begin, fwd_it end, COMP comp) {
+	typedef typename std::iterator_traits<fwd_it>::value_type value_type;
+	task_sort_detail::sort_through_buffer(begin, end,
+		[&comp](std::vector<value_type>& data, work_stealing_task_queue* executor) {
+			task_sort_detail::merge_sort(data, comp, executor);
+		});
+}
+
+template<class fwd_it>
+void task_sort(fwd_it begin, fwd_it end) {
+	typedef typename std::iterator_traits<fwd_it>::value_type value_type;
+	task_sort_detail::task_sort(begin, end, task_sort_detail::is_radix_key<value_type>());
+}
+
+// Former priority-queue sort, kept as the entry point existing callers use.
+template<class fwd_it>
+void sleep_sort(fwd_it begin, fwd_it end) {
+	task_sort(begin, end);
+}
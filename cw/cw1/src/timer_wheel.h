@@ -0,0 +1,306 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+#include <utility>
+#include "inline_task.h"
+
+/*
+ * Hierarchical timing wheel.
+ *
+ * Time is measured in ticks of the caller's choosing (e.g. milliseconds).
+ * LEVELS wheels of 2^SLOT_BITS slots each cover 2^(LEVELS * SLOT_BITS) ticks
+ * ahead of now(); later deadlines wait in an overflow list. A timer lives in the
+ * lowest level whose slot still shares all higher bits with now() and moves one
+ * level down whenever the clock crosses the boundary of its slot.
+ *
+ * schedule_at() and cancel() are O(1): timers are intrusive doubly-linked list
+ * nodes indexed by a handle. advance(now) moves the clock, jumping over empty
+ * slots with per-level occupancy bitmaps, and turns the timers which are due into
+ * ready tasks, which run() / run_one() execute in deadline order.
+ */
+template<typename TASK = inline_task<>, size_t LEVELS = 4, size_t SLOT_BITS = 8>
+struct timer_wheel
+{
+	typedef TASK function;
+	typedef uint64_t tick;
+
+	struct handle {
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	explicit timer_wheel(tick now = 0)
+		: now_(now)
+		, pending_(0)
+		, ready_count_(0)
+		, free_(npos) {
+		static_assert(SLOT_BITS >= 6, "timer_wheel occupancy bitmap needs at least 64 slots per level");
+		static_assert(LEVELS * SLOT_BITS < 64, "timer_wheel range should fit into a tick");
+		nodes_.resize(list_count);
+		for(uint32_t i = 0; i < list_count; ++i) {
+			nodes_[i].prev = nodes_[i].next = i;
+		}
+		for(auto& level : occupied_) {
+			for(auto& word : level) {
+				word = 0;
+			}
+		}
+	}
+	timer_wheel(timer_wheel const& other) = delete;
+	timer_wheel& operator=(timer_wheel const& other) = delete;
+
+	// A deadline which is not in the future makes the task ready right away.
+	handle schedule_at(tick deadline, function&& task) {
+		uint32_t index = allocate_node();
+		node& timer = nodes_[index];
+		timer.task = std::move(task);
+		timer.deadline = deadline;
+		place(index);
+		++pending_;
+		return handle{ index, timer.generation };
+	}
+	handle schedule_after(tick delay, function&& task) {
+		return schedule_at(now_ + delay, std::move(task));
+	}
+
+	// Returns false if the timer has already run or been cancelled.
+	bool cancel(handle timer) {
+		if(!valid(timer)) {
+			return false;
+		}
+		if(nodes_[timer.index].list == ready_list) {
+			--ready_count_;
+		}
+		unlink(timer.index);
+		release_node(timer.index);
+		--pending_;
+		return true;
+	}
+	bool valid(handle timer) const {
+		return timer.index >= list_count && timer.index < nodes_.size()
+			&& nodes_[timer.index].generation == timer.generation
+			&& nodes_[timer.index].list != npos;
+	}
+
+	// Moves the clock forward; returns how many timers became ready.
+	size_t advance(tick now) {
+		size_t before = ready_count_;
+		while(now_ < now) {
+			if(pending_ == ready_count_) {
+				now_ = now;
+				break;
+			}
+			now_ = next_event(now);
+			if(slot_of(0, now_) == 0) {
+				cascade(1);
+			}
+			expire(list_of(0, slot_of(0, now_)));
+		}
+		return ready_count_ - before;
+	}
+
+	size_t run_one() {
+		uint32_t index = nodes_[ready_list].next;
+		if(index == ready_list) {
+			return 0;
+		}
+		function task = std::move(nodes_[index].task);
+		unlink(index);
+		release_node(index);
+		--ready_count_;
+		--pending_;
+		task();
+		return 1;
+	}
+	size_t run() {
+		size_t result = 0;
+		while(run_one() != 0) {
+			++result;
+		}
+
+		return result;
+	}
+
+	// True when there are neither ready nor scheduled timers.
+	bool empty() const {
+		return pending_ == 0;
+	}
+	size_t size() const {
+		return pending_;
+	}
+	size_t ready() const {
+		return ready_count_;
+	}
+	tick now() const {
+		return now_;
+	}
+
+private:
+	static const uint32_t npos = ~uint32_t(0);
+	static const size_t slots = size_t(1) << SLOT_BITS;
+	static const tick slot_mask = slots - 1;
+	static const uint32_t overflow_list = LEVELS * slots;
+	static const uint32_t ready_list = overflow_list + 1;
+	static const uint32_t list_count = ready_list + 1;
+	static const size_t word_bits = 64;
+	static const size_t words = slots / word_bits;
+
+	struct node {
+		node()
+			: deadline(0)
+			, prev(npos)
+			, next(npos)
+			, list(npos)
+			, generation(0) {
+		}
+
+		function task;
+		tick deadline;
+		uint32_t prev;
+		uint32_t next;
+		uint32_t list;
+		uint32_t generation;
+	};
+
+	static size_t slot_of(size_t level, tick time) {
+		return (time >> (level * SLOT_BITS)) & slot_mask;
+	}
+	static uint32_t list_of(size_t level, size_t slot) {
+		return static_cast<uint32_t>(level * slots + slot);
+	}
+
+	uint32_t allocate_node() {
+		if(free_ != npos) {
+			uint32_t index = free_;
+			free_ = nodes_[index].next;
+			return index;
+		}
+		nodes_.emplace_back();
+		return static_cast<uint32_t>(nodes_.size() - 1);
+	}
+	void release_node(uint32_t index) {
+		node& timer = nodes_[index];
+		timer.task = function();
+		timer.list = npos;
+		++timer.generation;
+		timer.next = free_;
+		free_ = index;
+	}
+
+	void link(uint32_t index, uint32_t list) {
+		node& timer = nodes_[index];
+		node& head = nodes_[list];
+		timer.list = list;
+		timer.prev = head.prev;
+		timer.next = list;
+		nodes_[head.prev].next = index;
+		head.prev = index;
+		if(list < overflow_list) {
+			occupied_[list / slots][(list % slots) / word_bits] |= uint64_t(1) << (list % word_bits);
+		}
+	}
+	void unlink(uint32_t index) {
+		node& timer = nodes_[index];
+		nodes_[timer.prev].next = timer.next;
+		nodes_[timer.next].prev = timer.prev;
+		if(timer.list < overflow_list && nodes_[timer.list].next == timer.list) {
+			occupied_[timer.list / slots][(timer.list % slots) / word_bits] &= ~(uint64_t(1) << (timer.list % word_bits));
+		}
+		timer.list = npos;
+	}
+
+	void place(uint32_t index) {
+		tick deadline = nodes_[index].deadline;
+		if(deadline <= now_) {
+			link(index, ready_list);
+			++ready_count_;
+			return;
+		}
+		for(size_t level = 0; level < LEVELS; ++level) {
+			size_t upper = (level + 1) * SLOT_BITS;
+			if((deadline >> upper) == (now_ >> upper)) {
+				link(index, list_of(level, slot_of(level, deadline)));
+				return;
+			}
+		}
+		link(index, overflow_list);
+	}
+
+	// Re-places the timers of the slot the clock has just entered on this level.
+	void cascade(size_t level) {
+		uint32_t list;
+		if(level == LEVELS) {
+			list = overflow_list;
+		}
+		else {
+			size_t slot = slot_of(level, now_);
+			if(slot == 0) {
+				cascade(level + 1);
+			}
+			list = list_of(level, slot);
+		}
+		uint32_t index = nodes_[list].next;
+		while(index != list) {
+			uint32_t next = nodes_[index].next;
+			unlink(index);
+			place(index);
+			index = next;
+		}
+	}
+
+	void expire(uint32_t list) {
+		uint32_t index = nodes_[list].next;
+		while(index != list) {
+			uint32_t next = nodes_[index].next;
+			unlink(index);
+			link(index, ready_list);
+			++ready_count_;
+			index = next;
+		}
+	}
+
+	// First occupied slot of the level at or after from, or slots if there is none.
+	size_t next_occupied(size_t level, size_t from) const {
+		for(size_t word = from / word_bits; word < words; ++word) {
+			uint64_t bits = occupied_[level][word];
+			if(word == from / word_bits && from % word_bits != 0) {
+				bits &= ~((uint64_t(1) << (from % word_bits)) - 1);
+			}
+			if(bits != 0) {
+				return word * word_bits + __builtin_ctzll(bits);
+			}
+		}
+		return slots;
+	}
+
+	/*
+	 * The next tick, but not after limit, where the clock enters an occupied slot.
+	 * Timers of a level always lie ahead within the current slot of the level above,
+	 * so the lowest level with an occupied slot ahead gives the answer.
+	 */
+	tick next_event(tick limit) const {
+		tick next = 0;
+		size_t level = 0;
+		for(; level < LEVELS; ++level) {
+			size_t slot = next_occupied(level, slot_of(level, now_) + 1);
+			if(slot < slots) {
+				size_t upper = (level + 1) * SLOT_BITS;
+				next = ((now_ >> upper) << upper) + (tick(slot) << (level * SLOT_BITS));
+				break;
+			}
+		}
+		if(level == LEVELS) {
+			size_t upper = LEVELS * SLOT_BITS;
+			next = ((now_ >> upper) + 1) << upper;
+		}
+		return next < limit ? next : limit;
+	}
+
+	tick now_;
+	size_t pending_;
+	size_t ready_count_;
+	uint32_t free_;
+	std::vector<node> nodes_;
+	uint64_t occupied_[LEVELS][slots / word_bits];
+};
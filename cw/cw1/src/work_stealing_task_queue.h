@@ -0,0 +1,350 @@
+#pragma once
+#include <stdlib.h>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <functional>
+#include "inline_task.h"
+
+/*
+ * Multi-threaded companion of ordered_task_queue.
+ *
+ * Every worker owns a deque of tasks. A worker takes its own tasks from the back
+ * and, when it runs dry, steals from the front of the other workers' deques.
+ * The thread calling run() takes part as worker 0, so run() has the same
+ * contract as ordered_task_queue::run(): it returns when no task is left
+ * (including tasks pushed by other tasks) and reports how many were executed.
+ *
+ * Workers with nothing to take sleep until a task is pushed or the run ends.
+ *
+ * In strand mode tasks go into a single FIFO and run one at a time on the
+ * threads calling run(), with no helper threads, which keeps the ordering
+ * guarantees of ordered_task_queue; like there, a task may call run() or
+ * run_one() to execute the tasks after it.
+ *
+ * Overlapping run() calls from different threads are serialized: a later
+ * call waits for the running one and then drains whatever is left. A run()
+ * from inside a task of a parallel run executes tasks on the calling worker
+ * until it finds none to take and leaves the rest to the outer run().
+ *
+ * A task that throws counts as done. As with ordered_task_queue the exception
+ * leaves run(): a parallel run stops taking tasks, waits for the helpers and
+ * rethrows the first exception; the tasks not yet taken stay queued.
+ */
+struct work_stealing_task_queue
+{
+	typedef inline_task<> function;
+	enum class mode { parallel, strand };
+
+	explicit work_stealing_task_queue(size_t threads = std::thread::hardware_concurrency(),
+		mode run_mode = mode::parallel)
+		: mode_(run_mode)
+		, workers_(threads == 0 || run_mode == mode::strand ? 1 : threads)
+		, pending_(0)
+		, queued_(0)
+		, sleepers_(0)
+		, next_worker_(0)
+		, generation_(0)
+		, busy_helpers_(0)
+		, executed_(0)
+		, failed_(false)
+		, stopped_(false) {
+		for(size_t i = 0; i < workers_.size(); ++i) {
+			workers_[i].reset(new worker());
+		}
+		for(size_t i = 1; i < workers_.size(); ++i) {
+			helpers_.emplace_back([this, i]() { helper_loop(i); });
+		}
+	}
+	work_stealing_task_queue(work_stealing_task_queue const& other) = delete;
+	work_stealing_task_queue& operator=(work_stealing_task_queue const& other) = delete;
+	~work_stealing_task_queue() {
+		{
+			std::lock_guard<std::mutex> lock(run_lock_);
+			stopped_ = true;
+		}
+		run_cv_.notify_all();
+		for(auto& helper : helpers_) {
+			helper.join();
+		}
+	}
+
+	void push(function&& task) {
+		pending_.fetch_add(1, std::memory_order_relaxed);
+		queued_.fetch_add(1);
+		{
+			worker& target = *workers_[target_worker()];
+			std::lock_guard<std::mutex> lock(target.lock);
+			target.tasks.push_back(std::move(task));
+		}
+		wake(false);
+	}
+	// Spreads [first, last) over the workers, taking each worker's lock once.
+	template<typename FWD_IT>
+	void push_bulk(FWD_IT first, FWD_IT last) {
+		size_t count = std::distance(first, last);
+		pending_.fetch_add(count, std::memory_order_relaxed);
+		queued_.fetch_add(count);
+		size_t own = current_worker();
+		size_t parts = (mode_ == mode::strand || own < workers_.size()) ? 1 : workers_.size();
+		size_t chunk = (count + parts - 1) / parts;
+		while(first != last) {
+			worker& target = *workers_[target_worker()];
+			std::lock_guard<std::mutex> lock(target.lock);
+			for(size_t i = 0; i < chunk && first != last; ++i, ++first) {
+				target.tasks.push_back(std::move(*first));
+			}
+		}
+		wake(true);
+	}
+	size_t run_one() {
+		return run_task(current_worker() < workers_.size() ? current_worker() : 0) ? 1 : 0;
+	}
+	size_t run() {
+		if(empty()) {
+			return 0;
+		}
+		if(mode_ == mode::strand || workers_.size() == 1) {
+			size_t result = 0;
+			while(run_one() != 0) {
+				++result;
+			}
+			return result;
+		}
+
+		size_t own = current_worker();
+		if(own < workers_.size()) {
+			size_t result = 0;
+			while(run_task(own)) {
+				++result;
+			}
+			executed_.fetch_add(result, std::memory_order_relaxed);
+			return result;
+		}
+
+		std::lock_guard<std::mutex> serial(serial_lock_);
+		std::unique_lock<std::mutex> lock(run_lock_);
+		executed_.store(0, std::memory_order_relaxed);
+		failed_.store(false, std::memory_order_relaxed);
+		error_ = nullptr;
+		busy_helpers_ = helpers_.size();
+		++generation_;
+		lock.unlock();
+		run_cv_.notify_all();
+
+		work(0);
+
+		lock.lock();
+		done_cv_.wait(lock, [this]() { return busy_helpers_ == 0; });
+		if(error_) {
+			std::exception_ptr error = error_;
+			error_ = nullptr;
+			std::rethrow_exception(error);
+		}
+		return executed_.load(std::memory_order_relaxed);
+	}
+	bool empty() const {
+		return pending_.load(std::memory_order_acquire) == 0;
+	}
+	size_t concurrency() const {
+		return workers_.size();
+	}
+
+private:
+	struct worker {
+		std::mutex lock;
+		std::deque<function> tasks;
+	};
+
+	struct thread_slot {
+		work_stealing_task_queue const* owner = nullptr;
+		size_t index = 0;
+	};
+
+	static thread_slot& slot() {
+		static thread_local thread_slot current;
+		return current;
+	}
+
+	// Index of the calling thread's worker or workers_.size() for foreign threads.
+	size_t current_worker() const {
+		thread_slot const& current = slot();
+		return current.owner == this ? current.index : workers_.size();
+	}
+
+	size_t target_worker() {
+		if(mode_ == mode::strand) {
+			return 0;
+		}
+		size_t own = current_worker();
+		if(own < workers_.size()) {
+			return own;
+		}
+		return next_worker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+	}
+
+	bool take(size_t index, function& task) {
+		if(mode_ == mode::strand) {
+			worker& strand = *workers_[0];
+			std::lock_guard<std::mutex> lock(strand.lock);
+			if(strand.tasks.empty()) {
+				return false;
+			}
+			task = std::move(strand.tasks.front());
+			strand.tasks.pop_front();
+			queued_.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		{
+			worker& own = *workers_[index];
+			std::lock_guard<std::mutex> lock(own.lock);
+			if(!own.tasks.empty()) {
+				task = std::move(own.tasks.back());
+				own.tasks.pop_back();
+				queued_.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		for(size_t i = 1; i < workers_.size(); ++i) {
+			worker& victim = *workers_[(index + i) % workers_.size()];
+			std::lock_guard<std::mutex> lock(victim.lock);
+			if(!victim.tasks.empty()) {
+				task = std::move(victim.tasks.front());
+				victim.tasks.pop_front();
+				queued_.fetch_sub(1, std::memory_order_relaxed);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// A taken task is done once it returns or throws; the last one ends the run for sleeping workers.
+	struct finish_guard {
+		work_stealing_task_queue& queue;
+		~finish_guard() {
+			if(queue.pending_.fetch_sub(1) == 1) {
+				queue.wake(true);
+			}
+		}
+	};
+
+	bool run_task(size_t index) {
+		function task;
+		if(mode_ == mode::strand) {
+			std::lock_guard<std::recursive_mutex> strand_lock(strand_lock_);
+			if(!take(index, task)) {
+				return false;
+			}
+			finish_guard finish = { *this };
+			task();
+		}
+		else {
+			if(!take(index, task)) {
+				return false;
+			}
+			finish_guard finish = { *this };
+			task();
+		}
+		return true;
+	}
+
+	// Runs tasks until none is left or one throws; the first exception is kept for run().
+	void work(size_t index) {
+		thread_slot saved = slot();
+		slot().owner = this;
+		slot().index = index;
+		try {
+			while(!empty() && !failed_.load(std::memory_order_relaxed)) {
+				if(run_task(index)) {
+					executed_.fetch_add(1, std::memory_order_relaxed);
+				}
+				else {
+					idle();
+				}
+			}
+		}
+		catch(...) {
+			std::lock_guard<std::mutex> lock(run_lock_);
+			if(!error_) {
+				error_ = std::current_exception();
+			}
+			failed_.store(true);
+		}
+		wake(true);
+		slot() = saved;
+	}
+
+	/*
+	 * Sleeps until a task is queued, the run ends or fails. A pusher raises
+	 * queued_ before it reads sleepers_ and a worker raises sleepers_ before
+	 * it reads queued_, so one of them sees the other.
+	 */
+	void idle() {
+		std::unique_lock<std::mutex> lock(idle_lock_);
+		sleepers_.fetch_add(1);
+		idle_cv_.wait(lock, [this]() { return queued_.load() != 0 || pending_.load() == 0 || failed_.load(); });
+		sleepers_.fetch_sub(1);
+	}
+
+	void wake(bool all) {
+		if(sleepers_.load() == 0) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(idle_lock_);
+		if(all) {
+			idle_cv_.notify_all();
+		}
+		else {
+			idle_cv_.notify_one();
+		}
+	}
+
+	void helper_loop(size_t index) {
+		size_t seen = 0;
+		std::unique_lock<std::mutex> lock(run_lock_);
+		while(true) {
+			run_cv_.wait(lock, [this, &seen]() { return stopped_ || generation_ != seen; });
+			if(stopped_) {
+				return;
+			}
+			seen = generation_;
+			lock.unlock();
+
+			work(index);
+
+			lock.lock();
+			if(--busy_helpers_ == 0) {
+				done_cv_.notify_one();
+			}
+		}
+	}
+
+	mode mode_;
+	std::vector<std::unique_ptr<worker>> workers_;
+	std::vector<std::thread> helpers_;
+	std::atomic<size_t> pending_;	// pushed and not finished
+	std::atomic<size_t> queued_;	// pushed and not taken
+	std::atomic<size_t> sleepers_;
+	std::mutex idle_lock_;
+	std::condition_variable idle_cv_;
+	std::atomic<size_t> next_worker_;
+	std::recursive_mutex strand_lock_;	// held by the running strand task, which may run more
+
+	std::mutex serial_lock_;	// one parallel run() at a time
+	std::mutex run_lock_;
+	std::condition_variable run_cv_;
+	std::condition_variable done_cv_;
+	size_t generation_;
+	size_t busy_helpers_;
+	std::atomic<size_t> executed_;
+	std::atomic<bool> failed_;
+	std::exception_ptr error_;	// first exception of the current run, under run_lock_
+	bool stopped_;
+};
@@ -0,0 +1,570 @@
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cstdio>
+#include <stdint.h>
+
+#include "reflection.h"
+#include "binary_serialization.h"
+#include "mapped_file.h"
+#include "compact_serialization.h"
+#include "chunked_serialization.h"
+#include "json_stream.h"
+#include "json_serialization.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+struct pod_struct
+{
+    int a;
+    double b;
+};
+
+// === bulk copy of trivially copyable containers vs element by element ===
+static void bench_bulk_vector()
+{
+    const size_t count = 1000000;
+    const int rounds = 10;
+    std::vector<pod_struct> data(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        data[i] = pod_struct{ int(i), i * 0.5 };
+    }
+    double megabytes = double(count * sizeof(pod_struct)) * rounds / (1 << 20);
+
+    std::string bytes;
+    {
+        double write_time = 0, read_time = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            std::stringstream stream;
+            auto start = bench_clock::now();
+            serialization::write(stream, data);
+            write_time += seconds_since(start);
+
+            std::vector<pod_struct> result;
+            start = bench_clock::now();
+            serialization::read(stream, result);
+            read_time += seconds_since(start);
+            if (result.size() != count || result[count - 1].a != int(count - 1))
+            {
+                std::printf("bulk round trip failed\n");
+            }
+            bytes = stream.str();
+        }
+        std::printf("vector<pod> bulk:        write %8.1f MB/s  read %8.1f MB/s  (%zu bytes)\n",
+                megabytes / write_time, megabytes / read_time, bytes.size());
+    }
+    {
+        double write_time = 0, read_time = 0;
+        for (int round = 0; round < rounds; ++round)
+        {
+            std::stringstream stream;
+            auto start = bench_clock::now();
+            uint64_t size = data.size();
+            serialization::write(stream, size);
+            for (auto& element : data)
+            {
+                serialization::write(stream, element);
+            }
+            write_time += seconds_since(start);
+
+            std::vector<pod_struct> result;
+            start = bench_clock::now();
+            serialization::read(stream, size);
+            result.resize(size);
+            for (auto& element : result)
+            {
+                serialization::read(stream, element);
+            }
+            read_time += seconds_since(start);
+            if (stream.str() != bytes)
+            {
+                std::printf("per element format differs\n");
+            }
+        }
+        std::printf("vector<pod> per element: write %8.1f MB/s  read %8.1f MB/s\n",
+                megabytes / write_time, megabytes / read_time);
+    }
+}
+
+// === 20 scalar fields through reflection: std::stream vs buffer_writer/buffer_reader ===
+struct wide_record
+{
+    wide_record()
+        : i0(0), i1(0), i2(0), i3(0), i4(0), i5(0), i6(0), i7(0), i8(0), i9(0)
+        , d0(0), d1(0), d2(0), d3(0), d4(0), f0(0), f1(0), c0(0), c1(0), b0(false)
+    {}
+
+    int i0, i1, i2, i3, i4, i5, i6, i7, i8, i9;
+    double d0, d1, d2, d3, d4;
+    float f0, f1;
+    char c0, c1;
+    bool b0;
+};
+
+template<class proc>
+void reflect_type(proc& p, wide_record& r)
+{
+    using namespace reflection;
+    reflect_field(p, r.i0, "i0");
+    reflect_field(p, r.i1, "i1");
+    reflect_field(p, r.i2, "i2");
+    reflect_field(p, r.i3, "i3");
+    reflect_field(p, r.i4, "i4");
+    reflect_field(p, r.i5, "i5");
+    reflect_field(p, r.i6, "i6");
+    reflect_field(p, r.i7, "i7");
+    reflect_field(p, r.i8, "i8");
+    reflect_field(p, r.i9, "i9");
+    reflect_field(p, r.d0, "d0");
+    reflect_field(p, r.d1, "d1");
+    reflect_field(p, r.d2, "d2");
+    reflect_field(p, r.d3, "d3");
+    reflect_field(p, r.d4, "d4");
+    reflect_field(p, r.f0, "f0");
+    reflect_field(p, r.f1, "f1");
+    reflect_field(p, r.c0, "c0");
+    reflect_field(p, r.c1, "c1");
+    reflect_field(p, r.b0, "b0");
+}
+
+static void bench_buffer_stream()
+{
+    const size_t count = 1000000;
+    std::vector<wide_record> records(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i].i0 = int(i);
+        records[i].d4 = i * 0.25;
+        records[i].c1 = char(i);
+    }
+    std::vector<wide_record> result(count);
+
+    std::stringstream stream;
+    auto start = bench_clock::now();
+    for (auto& record : records)
+    {
+        serialization::write(stream, record);
+    }
+    double stream_write = seconds_since(start);
+    start = bench_clock::now();
+    for (auto& record : result)
+    {
+        serialization::read(stream, record);
+    }
+    double stream_read = seconds_since(start);
+
+    // the second pass reuses the buffer grown by the first one
+    serialization::buffer_writer writer;
+    double buffer_write[2];
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        writer.clear();
+        start = bench_clock::now();
+        for (auto& record : records)
+        {
+            serialization::write(writer, record);
+        }
+        buffer_write[pass] = seconds_since(start);
+    }
+    serialization::buffer_reader reader(writer.data(), writer.size());
+    start = bench_clock::now();
+    for (auto& record : result)
+    {
+        serialization::read(reader, record);
+    }
+    double buffer_read = seconds_since(start);
+    if (!reader || result[count - 1].i0 != int(count - 1) || result[count - 1].d4 != (count - 1) * 0.25)
+    {
+        std::printf("buffer round trip failed\n");
+    }
+
+    double ns = 1e9 / count;
+    std::printf("wide_record (20 fields, %zu bytes) ns/record:\n", writer.size() / count);
+    std::printf("  std::stream    write %7.1f  read %7.1f\n", stream_write * ns, stream_read * ns);
+    std::printf("  buffer         write %7.1f  read %7.1f  (write into a reused buffer %.1f)\n",
+            buffer_write[0] * ns, buffer_read * ns, buffer_write[1] * ns);
+}
+
+// === raw binary vs tagged varint format, sparse and fully populated records ===
+static void bench_compact()
+{
+    const size_t count = 1000000;
+    std::vector<wide_record> sparse(count), dense(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        sparse[i].i0 = int(i);
+        sparse[i].d4 = i * 0.25;
+        sparse[i].c1 = char(i);
+
+        wide_record& r = dense[i];
+        r.i0 = int(i); r.i1 = int(i % 100); r.i2 = -int(i % 1000); r.i3 = 7; r.i4 = int(i) * 1000;
+        r.i5 = 1; r.i6 = 2; r.i7 = 3; r.i8 = -4; r.i9 = int(i >> 4);
+        r.d0 = i / 3.0; r.d1 = 1.5; r.d2 = -2.25; r.d3 = i * 0.001; r.d4 = i * 0.25;
+        r.f0 = i * 0.1f; r.f1 = 0.5f; r.c0 = 'a' + i % 26; r.c1 = char(i); r.b0 = true;
+    }
+
+    std::vector<wide_record> result(count);
+    const char* names[] = { "sparse", "dense" };
+    std::vector<wide_record>* inputs[] = { &sparse, &dense };
+    double ns = 1e9 / count;
+    for (int k = 0; k < 2; ++k)
+    {
+        std::vector<wide_record>& records = *inputs[k];
+        serialization::buffer_writer raw;
+        raw.reserve(count * sizeof(wide_record));
+        auto start = bench_clock::now();
+        for (auto& record : records)
+        {
+            serialization::write(raw, record);
+        }
+        double raw_write = seconds_since(start);
+        serialization::buffer_reader raw_reader(raw.data(), raw.size());
+        start = bench_clock::now();
+        for (auto& record : result)
+        {
+            serialization::read(raw_reader, record);
+        }
+        double raw_read = seconds_since(start);
+
+        serialization::buffer_writer compact;
+        compact.reserve(count * sizeof(wide_record) * 2);
+        start = bench_clock::now();
+        for (auto& record : records)
+        {
+            serialization::write_compact(compact, record);
+        }
+        double compact_write = seconds_since(start);
+        serialization::buffer_reader compact_reader(compact.data(), compact.size());
+        start = bench_clock::now();
+        for (auto& record : result)
+        {
+            serialization::read_compact(compact_reader, record);
+        }
+        double compact_read = seconds_since(start);
+        if (!compact_reader || result[count - 1].i0 != int(count - 1) || result[count - 1].d4 != records[count - 1].d4)
+        {
+            std::printf("compact round trip failed\n");
+        }
+
+        std::printf("wide_record %-6s raw     %5.1f bytes/record  write %6.1f  read %6.1f ns/record\n",
+                names[k], double(raw.size()) / count, raw_write * ns, raw_read * ns);
+        std::printf("wide_record %-6s compact %5.1f bytes/record  write %6.1f  read %6.1f ns/record\n",
+                names[k], double(compact.size()) / count, compact_write * ns, compact_read * ns);
+    }
+}
+
+// === a vector of non-trivial records: one stream vs chunks on 1..16 threads ===
+struct chunk_record
+{
+    chunk_record()
+        : id(0), score(0)
+    {}
+
+    int id;
+    double score;
+    std::string name;
+    std::vector<int> values;
+};
+
+template<class proc>
+void reflect_type(proc& p, chunk_record& r)
+{
+    using namespace reflection;
+    reflect_field(p, r.id, "id");
+    reflect_field(p, r.score, "score");
+    reflect_field(p, r.name, "name");
+    reflect_field(p, r.values, "values");
+}
+
+static void bench_chunked()
+{
+    const size_t count = 500000;
+    std::vector<chunk_record> records(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i].id = int(i);
+        records[i].score = i * 0.5;
+        records[i].name = "record " + std::to_string(i);
+        records[i].values.assign(i % 16, int(i));
+    }
+
+    serialization::buffer_writer sequential;
+    auto start = bench_clock::now();
+    serialization::write(sequential, records);
+    double sequential_write = seconds_since(start);
+    std::vector<chunk_record> result;
+    serialization::buffer_reader sequential_reader(sequential.data(), sequential.size());
+    start = bench_clock::now();
+    serialization::read(sequential_reader, result);
+    double sequential_read = seconds_since(start);
+    double megabytes = double(sequential.size()) / (1 << 20);
+    std::printf("chunked, %zu records, %.0f MB, %u hardware threads:\n", count, megabytes, std::thread::hardware_concurrency());
+    std::printf("  one stream      write %7.1f MB/s  read %7.1f MB/s\n",
+            megabytes / sequential_write, megabytes / sequential_read);
+
+    for (unsigned threads = 1; threads <= 16; threads *= 2)
+    {
+        serialization::buffer_writer writer;
+        start = bench_clock::now();
+        serialization::write_chunked(writer, records, 4096, threads);
+        double write_time = seconds_since(start);
+        result.clear();
+        result.shrink_to_fit();
+        serialization::buffer_reader reader(writer.data(), writer.size());
+        start = bench_clock::now();
+        serialization::read_chunked(reader, result, threads);
+        double read_time = seconds_since(start);
+        if (!reader || result.size() != count || result[count - 1].name != records[count - 1].name)
+        {
+            std::printf("chunked round trip failed\n");
+        }
+        std::printf("  %2u threads      write %7.1f MB/s  read %7.1f MB/s\n",
+                threads, megabytes / write_time, megabytes / read_time);
+    }
+}
+
+// === snapshot load: std::ifstream + read vs mapped views touching 1% ===
+struct snapshot
+{
+    std::vector<pod_struct> samples;
+    std::vector<wide_record> records;
+};
+
+template<class proc>
+void reflect_type(proc& p, snapshot& s)
+{
+    using namespace reflection;
+    reflect_field(p, s.samples, "samples");
+    reflect_field(p, s.records, "records");
+}
+
+static void bench_mapped_snapshot()
+{
+    snapshot data;
+    data.samples.resize(4000000);
+    data.records.resize(200000);
+    for (size_t i = 0; i < data.records.size(); ++i)
+    {
+        data.records[i].i0 = int(i);
+    }
+
+    char path[] = "/tmp/cw2_bench_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+    {
+        std::ofstream file(path, std::ios::binary);
+        serialization::write(file, data);
+    }
+
+    auto start = bench_clock::now();
+    snapshot loaded;
+    {
+        std::ifstream file(path, std::ios::binary);
+        serialization::read(file, loaded);
+    }
+    double stream_time = seconds_since(start);
+
+    start = bench_clock::now();
+    long long checksum = 0;
+    {
+        serialization::mapped_file file(path);
+        serialization::buffer_reader reader = file.reader();
+        auto samples = serialization::view<std::vector<pod_struct>>(reader);
+        auto records = serialization::view<std::vector<wide_record>>(reader);
+        for (size_t i = 0; i < samples.size(); i += 100)
+        {
+            checksum += samples[i].a;
+        }
+        for (size_t i = 0; i < records.size(); i += 100)
+        {
+            checksum += records[i].i0;
+        }
+    }
+    double mapped_time = seconds_since(start);
+    unlink(path);
+
+    std::printf("snapshot (%zu MB) ifstream + read %7.1f ms, mapped views touching 1%% %7.1f ms (checksum %lld)\n",
+            (data.samples.size() * sizeof(pod_struct) + data.records.size() * sizeof(wide_record)) >> 20,
+            stream_time * 1e3, mapped_time * 1e3, checksum);
+}
+
+// === JSON: json_value_t tree vs streaming json_writer ===
+static void bench_json_writer()
+{
+    const size_t count = 200000;
+    std::vector<wide_record> records(count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        records[i].i0 = int(i);
+        records[i].d0 = i / 3.0;
+        records[i].f0 = i * 0.1f;
+        records[i].c0 = 'a' + i % 26;
+    }
+
+    auto start = bench_clock::now();
+    size_t tree_nodes = 0;
+    for (auto& record : records)
+    {
+        serialization::json_value_t jvalue;
+        serialization::write(jvalue, record);
+        tree_nodes += jvalue.mapping_.size();
+    }
+    double tree_time = seconds_since(start);
+
+    serialization::buffer_writer writer;
+    start = bench_clock::now();
+    for (auto& record : records)
+    {
+        serialization::write_json(writer, record);
+    }
+    double stream_time = seconds_since(start);
+
+    double ns = 1e9 / count;
+    std::printf("json wide_record ns/record: json_value_t tree %7.1f (%zu nodes, no text yet), "
+            "json_writer to text %7.1f (%zu bytes)\n",
+            tree_time * ns, tree_nodes, stream_time * ns, writer.size());
+}
+
+// === JSON: json_reader_t over a json_value_t tree vs pull parsing 100 MB of text ===
+static void bench_json_reader()
+{
+    const size_t target = size_t(100) << 20;
+    char path[] = "/tmp/cw2_bench_XXXXXX";
+    int fd = mkstemp(path);
+    close(fd);
+
+    size_t count = 0;
+    {
+        std::ofstream file(path, std::ios::binary);
+        serialization::buffer_writer writer;
+        writer.write("[", 1);
+        wide_record record;
+        for (size_t written = 0; written < target; ++count)
+        {
+            record.i0 = int(count);
+            record.d0 = count / 3.0;
+            record.f0 = count * 0.1f;
+            record.c0 = 'a' + count % 26;
+            if (count != 0)
+            {
+                writer.write(",", 1);
+            }
+            serialization::write_json(writer, record);
+            if (writer.size() > (1 << 20))
+            {
+                written += writer.size();
+                file.write(writer.data(), writer.size());
+                writer.clear();
+            }
+        }
+        writer.write("]", 1);
+        file.write(writer.data(), writer.size());
+    }
+
+    long long checksum = 0;
+    wide_record record;
+    auto sum = [&checksum](wide_record const& r) { checksum += r.i0; };
+
+    auto start = bench_clock::now();
+    double mapped_time = 0;
+    size_t size = 0;
+    {
+        serialization::mapped_file file(path);
+        size = file.size();
+        serialization::json_pull_reader reader(file.data(), file.size());
+        if (!serialization::for_each_json_element(reader, record, sum))
+        {
+            std::printf("mapped json parse failed\n");
+        }
+        mapped_time = seconds_since(start);
+
+        start = bench_clock::now();
+        serialization::json_pull_reader indexed(file.data(), file.size(), true);
+        serialization::for_each_json_element(indexed, record, sum);
+        double indexed_time = seconds_since(start);
+        std::printf("json pull from mapped file with structural index %6.1f MB/s\n",
+                double(size) / (1 << 20) / indexed_time);
+
+        // stage 1 alone, one 64 KB chunk at a time as the reader does it
+        const char* names[] = { "scalar", "sse2", "avx2" };
+        serialization::json_scan::kernel kernels[] = { serialization::json_scan::scalar_kernel,
+            serialization::json_scan::sse2_kernel, serialization::json_scan::avx2_kernel };
+        std::vector<uint32_t> index((1 << 16) + 64);
+        for (int k = 0; k < 3; ++k)
+        {
+            if (!serialization::json_scan::supported(kernels[k]))
+            {
+                continue;
+            }
+            serialization::json_scanner scanner(kernels[k]);
+            size_t structurals = 0;
+            start = bench_clock::now();
+            for (size_t offset = 0; offset < size; offset += 1 << 16)
+            {
+                structurals += scanner.scan(file.data() + offset, std::min(size - offset, size_t(1) << 16), index.data());
+            }
+            double scan_time = seconds_since(start);
+            std::printf("json stage 1 %-6s %5.2f GB/s (%zu token starts)\n",
+                    names[k], double(size) / scan_time / 1e9, structurals);
+        }
+    }
+
+    start = bench_clock::now();
+    {
+        std::ifstream file(path, std::ios::binary);
+        serialization::json_pull_reader reader(file);
+        if (!serialization::for_each_json_element(reader, record, sum))
+        {
+            std::printf("streamed json parse failed\n");
+        }
+    }
+    double stream_time = seconds_since(start);
+    unlink(path);
+
+    // the tree reader, starting from already built trees
+    const size_t tree_count = 100000;
+    std::vector<serialization::json_value_t> trees(tree_count);
+    for (size_t i = 0; i < tree_count; ++i)
+    {
+        record.i0 = int(i);
+        serialization::write(trees[i], record);
+    }
+    start = bench_clock::now();
+    for (auto& tree : trees)
+    {
+        serialization::read(tree, record);
+        checksum += record.i0;
+    }
+    double tree_time = seconds_since(start);
+
+    double megabytes = double(size) / (1 << 20);
+    std::printf("json %.0f MB, %zu records: pull from mapped file %6.1f MB/s (%.0f ns/record), "
+            "from ifstream, 64 KB window %6.1f MB/s; json_reader_t from a tree %.0f ns/record (checksum %lld)\n",
+            megabytes, count, megabytes / mapped_time, mapped_time * 1e9 / count,
+            megabytes / stream_time, tree_time * 1e9 / tree_count, checksum);
+}
+
+int main()
+{
+    bench_bulk_vector();
+    bench_buffer_stream();
+    bench_compact();
+    bench_chunked();
+    bench_mapped_snapshot();
+    bench_json_writer();
+    bench_json_reader();
+    return 0;
+}
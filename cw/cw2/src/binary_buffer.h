@@ -0,0 +1,203 @@
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <vector>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+
+namespace serialization
+{
+    /*
+     * Binary output into a contiguous byte buffer: every field is a plain
+     * memcpy, without the sentry and streambuf call of std::ostream::write.
+     * The buffer is either owned and grows as needed, or supplied by the
+     * caller with a fixed capacity; writing past the end of a fixed buffer
+     * stops the writer and leaves it failed, like a stream.
+     */
+    struct buffer_writer {
+        buffer_writer()
+            : data_(nullptr)
+            , size_(0)
+            , capacity_(0)
+            , growable_(true)
+            , good_(true) {
+        }
+
+        buffer_writer(char* data, size_t capacity)
+            : data_(data)
+            , size_(0)
+            , capacity_(capacity)
+            , growable_(false)
+            , good_(true) {
+        }
+
+        buffer_writer(buffer_writer const& other) = delete;
+        buffer_writer& operator=(buffer_writer const& other) = delete;
+
+        void write(const void* bytes, size_t count) {
+            if(!good_ || (count > capacity_ - size_ && !reserve(size_ + count))) {
+                return;
+            }
+            memcpy(data_ + size_, bytes, count);
+            size_ += count;
+        }
+
+        bool reserve(size_t capacity) {
+            if(capacity <= capacity_) {
+                return good_;
+            }
+            if(!growable_) {
+                good_ = false;
+                return false;
+            }
+            storage_.resize(capacity_ * 2 > capacity ? capacity_ * 2 : capacity);
+            data_ = storage_.data();
+            capacity_ = storage_.size();
+            return good_;
+        }
+
+        // Room for count more bytes, to be filled in place and then commit()ed; nullptr if they do not fit.
+        char* space(size_t count) {
+            if(!good_ || (count > capacity_ - size_ && (!growable_ || !reserve(size_ + count)))) {
+                return nullptr;
+            }
+            return data_ + size_;
+        }
+
+        void commit(size_t count) {
+            size_ += count;
+        }
+
+        // Starts over, keeping the buffer.
+        void clear() {
+            size_ = 0;
+            good_ = true;
+        }
+
+        const char* data() const {
+            return data_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        explicit operator bool() const {
+            return good_;
+        }
+
+    private:
+        char* data_;
+        size_t size_;
+        size_t capacity_;
+        bool growable_;
+        bool good_;
+        std::vector<char> storage_;
+    };
+
+    /*
+     * Binary input from a contiguous byte buffer owned by the caller.
+     * Reading past the end fails the reader and leaves the target untouched.
+     */
+    struct buffer_reader {
+        buffer_reader(const char* data, size_t size)
+            : data_(data)
+            , size_(size)
+            , position_(0)
+            , good_(true) {
+        }
+
+        void read(void* bytes, size_t count) {
+            if(!good_ || count > size_ - position_) {
+                good_ = false;
+                return;
+            }
+            memcpy(bytes, data_ + position_, count);
+            position_ += count;
+        }
+
+        void skip(size_t count) {
+            if(!good_ || count > size_ - position_) {
+                good_ = false;
+                return;
+            }
+            position_ += count;
+        }
+
+        void fail() {
+            good_ = false;
+        }
+
+        const char* current() const {
+            return data_ + position_;
+        }
+
+        size_t position() const {
+            return position_;
+        }
+
+        size_t remaining() const {
+            return size_ - position_;
+        }
+
+        explicit operator bool() const {
+            return good_;
+        }
+
+    private:
+        const char* data_;
+        size_t size_;
+        size_t position_;
+        bool good_;
+    };
+
+    // Byte targets: std::ostream / std::istream and the memcpy-based buffer_writer / buffer_reader.
+    template<class output>
+    struct is_binary_output : std::integral_constant<bool,
+        std::is_base_of<std::ostream, output>::value || std::is_same<output, buffer_writer>::value> {
+    };
+
+    template<class input>
+    struct is_binary_input : std::integral_constant<bool,
+        std::is_base_of<std::istream, input>::value || std::is_same<input, buffer_reader>::value> {
+    };
+
+    inline void write_bytes(std::ostream& os, const void* bytes, size_t count) {
+        os.write(reinterpret_cast<const char*>(bytes), count);
+    }
+
+    inline void write_bytes(buffer_writer& os, const void* bytes, size_t count) {
+        os.write(bytes, count);
+    }
+
+    inline void read_bytes(std::istream& is, void* bytes, size_t count) {
+        is.read(reinterpret_cast<char*>(bytes), count);
+    }
+
+    inline void read_bytes(buffer_reader& is, void* bytes, size_t count) {
+        is.read(bytes, count);
+    }
+
+    inline void fail(std::istream& is) {
+        is.setstate(std::ios::failbit);
+    }
+
+    inline void fail(buffer_reader& is) {
+        is.fail();
+    }
+
+    // A sequence grows by at most this many bytes per step while it is read from a stream.
+    const size_t read_step_bytes = 1 << 20;
+
+    // How many elements of element_size bytes the input can still hold; unbounded for streams.
+    inline uint64_t readable_elements(std::istream&, size_t) {
+        return UINT64_MAX;
+    }
+
+    inline uint64_t readable_elements(buffer_reader& is, size_t element_size) {
+        return is.remaining() / element_size;
+    }
+
+} // serialization
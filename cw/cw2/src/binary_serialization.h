@@ -1,73 +1,181 @@
-#pragma once
-#include <type_traits>
-namespace serialization
-{
-    template<class type>
-    typename std::enable_if<std::is_pod<type>::value>::type write(std::ostream& os, type& obj);
-
-    template<class type>
-    typename std::enable_if<std::is_pod<type>::value>::type read(std::istream& is, type& obj);
-
-    template<class type>
-    typename std::enable_if<!std::is_pod<type>::value>::type read(std::istream& is, type& obj); 
-
-    template<class type>
-    typename std::enable_if<!std::is_pod<type>::value>::type write(std::ostream& os, type& obj);
-
-    // Task 1.
-    struct iserializer_t {
-        iserializer_t(std::istream& is)
-            : stream(is) {
-        }
-
-        template<class field_type>
-        void operator()(field_type& value, const char* key) {
-            read(stream, value);
-        }
-
-    private:
-        std::istream& stream;
-    };
-
-    struct oserializer_t {
-        oserializer_t(std::ostream& is)
-            : stream(is) {
-        }
-
-        template<class field_type>
-        void operator()(field_type& value, const char* key) {
-            write(stream, value);
-        }
-
-    private:
-        std::ostream& stream;
-    };
-
-    template<typename T>
-    void serialize(...) {
-        static_assert(std::is_pod<T>::value, "Type is not serializable");
-    }
-
-    template<class type>
-    typename std::enable_if<std::is_pod<type>::value>::type write(std::ostream& os, type& obj) {
-        os.write(reinterpret_cast<const char*>(&obj), sizeof(type));
-    }
-
-    template<class type>
-    typename std::enable_if<std::is_pod<type>::value>::type read(std::istream& is, type& obj) {
-        is.read(reinterpret_cast<char*>(&obj), sizeof(type));
-    }
-
-    template<class type>
-    typename std::enable_if<!std::is_pod<type>::value>::type read(std::istream& is, type& obj) {
-        iserializer_t proc(is);
-        reflect_type(proc, obj);
-    }
-
-    template<class type>
-    typename std::enable_if<!std::is_pod<type>::value>::type write(std::ostream& os, type& obj) {
-        oserializer_t proc(os);
-        reflect_type(proc, obj);
-    }
-
-} // serialization
+#pragma once
+#include <type_traits>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include "binary_buffer.h"
+namespace serialization
+{
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && std::is_pod<type>::value>::type write(output& os, type& obj);
+
+    template<class input, class type>
+    typename std::enable_if<is_binary_input<input>::value && std::is_pod<type>::value>::type read(input& is, type& obj);
+
+    template<class input, class type>
+    typename std::enable_if<is_binary_input<input>::value && !std::is_pod<type>::value>::type read(input& is, type& obj); 
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && !std::is_pod<type>::value>::type write(output& os, type& obj);
+
+    template<class output, class type, class alloc>
+    typename std::enable_if<is_binary_output<output>::value>::type write(output& os, std::vector<type, alloc>& vec);
+
+    template<class input, class type, class alloc>
+    typename std::enable_if<is_binary_input<input>::value>::type read(input& is, std::vector<type, alloc>& vec);
+
+    template<class output, class type, class traits, class alloc>
+    typename std::enable_if<is_binary_output<output>::value>::type write(output& os, std::basic_string<type, traits, alloc>& str);
+
+    template<class input, class type, class traits, class alloc>
+    typename std::enable_if<is_binary_input<input>::value>::type read(input& is, std::basic_string<type, traits, alloc>& str);
+
+    // Task 1.
+    template<class input>
+    struct basic_iserializer_t {
+        basic_iserializer_t(input& is)
+            : stream(is) {
+        }
+
+        template<class field_type>
+        void operator()(field_type& value, const char* key) {
+            read(stream, value);
+        }
+
+    private:
+        input& stream;
+    };
+
+    template<class output>
+    struct basic_oserializer_t {
+        basic_oserializer_t(output& is)
+            : stream(is) {
+        }
+
+        template<class field_type>
+        void operator()(field_type& value, const char* key) {
+            write(stream, value);
+        }
+
+    private:
+        output& stream;
+    };
+
+    typedef basic_iserializer_t<std::istream> iserializer_t;
+    typedef basic_oserializer_t<std::ostream> oserializer_t;
+
+    template<typename T>
+    void serialize(...) {
+        static_assert(std::is_pod<T>::value, "Type is not serializable");
+    }
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && std::is_pod<type>::value>::type write(output& os, type& obj) {
+        write_bytes(os, &obj, sizeof(type));
+    }
+
+    template<class input, class type>
+    typename std::enable_if<is_binary_input<input>::value && std::is_pod<type>::value>::type read(input& is, type& obj) {
+        read_bytes(is, &obj, sizeof(type));
+    }
+
+    template<class input, class type>
+    typename std::enable_if<is_binary_input<input>::value && !std::is_pod<type>::value>::type read(input& is, type& obj) {
+        basic_iserializer_t<input> proc(is);
+        reflect_type(proc, obj);
+    }
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && !std::is_pod<type>::value>::type write(output& os, type& obj) {
+        basic_oserializer_t<output> proc(os);
+        reflect_type(proc, obj);
+    }
+
+    // Contiguous containers: element count, then the elements.
+    // Trivially copyable elements go as a single block.
+    template<class output, class type>
+    void write_elements(output& os, type* data, size_t count, std::true_type) {
+        write_bytes(os, data, count * sizeof(type));
+    }
+
+    template<class output, class type>
+    void write_elements(output& os, type* data, size_t count, std::false_type) {
+        for(size_t i = 0; i < count; ++i) {
+            write(os, data[i]);
+        }
+    }
+
+    template<class input, class type>
+    void read_elements(input& is, type* data, size_t count, std::true_type) {
+        read_bytes(is, data, count * sizeof(type));
+    }
+
+    template<class input, class type>
+    void read_elements(input& is, type* data, size_t count, std::false_type) {
+        for(size_t i = 0; i < count && is; ++i) {
+            read(is, data[i]);
+        }
+    }
+
+    /*
+     * Reads count elements into seq. A count that cannot fit the rest of a
+     * buffer fails the reader at once; otherwise, and for streams, the
+     * sequence grows a bounded step at a time, so a corrupt count runs out of
+     * input instead of allocating memory for all of it up front.
+     */
+    template<class input, class sequence>
+    void read_counted(input& is, sequence& seq, uint64_t count) {
+        typedef typename sequence::value_type type;
+        typedef std::is_trivially_copyable<type> bulk;
+        uint64_t bound = readable_elements(is, sizeof(type));
+        if(bulk::value && count > bound) {
+            fail(is);
+            return;
+        }
+        uint64_t step = bulk::value && bound != UINT64_MAX ? count : (read_step_bytes + sizeof(type) - 1) / sizeof(type);
+        for(uint64_t done = 0; done < count && is;) {
+            size_t next = static_cast<size_t>(count - done < step ? count - done : step);
+            seq.resize(static_cast<size_t>(done) + next);
+            read_elements(is, &seq[static_cast<size_t>(done)], next, bulk());
+            done += next;
+        }
+        if(count == 0) {
+            seq.clear();
+        }
+    }
+
+    template<class output, class type, class alloc>
+    typename std::enable_if<is_binary_output<output>::value>::type write(output& os, std::vector<type, alloc>& vec) {
+        uint64_t size = vec.size();
+        write(os, size);
+        write_elements(os, vec.data(), vec.size(), std::is_trivially_copyable<type>());
+    }
+
+    template<class input, class type, class alloc>
+    typename std::enable_if<is_binary_input<input>::value>::type read(input& is, std::vector<type, alloc>& vec) {
+        uint64_t size = 0;
+        read(is, size);
+        if(!is) {
+            return;
+        }
+        read_counted(is, vec, size);
+    }
+
+    template<class output, class type, class traits, class alloc>
+    typename std::enable_if<is_binary_output<output>::value>::type write(output& os, std::basic_string<type, traits, alloc>& str) {
+        uint64_t size = str.size();
+        write(os, size);
+        write_elements(os, &str[0], str.size(), std::true_type());
+    }
+
+    template<class input, class type, class traits, class alloc>
+    typename std::enable_if<is_binary_input<input>::value>::type read(input& is, std::basic_string<type, traits, alloc>& str) {
+        uint64_t size = 0;
+        read(is, size);
+        if(!is) {
+            return;
+        }
+        read_counted(is, str, size);
+    }
+
+} // serialization
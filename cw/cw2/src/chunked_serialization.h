@@ -0,0 +1,235 @@
+#pragma once
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <thread>
+#include <vector>
+#include <type_traits>
+#include "binary_serialization.h"
+
+namespace serialization
+{
+    /*
+     * A large vector written as independent chunks of consecutive elements,
+     * each serialized on its own thread into its own buffer:
+     *
+     *     uint64 element count, uint64 chunk count,
+     *     per chunk: uint64 element count, uint64 byte size,
+     *     the chunks, one after the other, each in the format of write().
+     *
+     * The index in front lets read_chunked() decode the chunks in parallel as
+     * well, and chunk_index find any one chunk without decoding the others.
+     * Reading needs the input in memory: a buffer_reader, e.g. from a
+     * mapped_file.
+     */
+    struct chunk_entry {
+        uint64_t first;
+        uint64_t count;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Runs f(chunk) for every chunk on up to threads threads (0: one per core); rethrows the first exception.
+    template<class F>
+    void for_each_chunk(size_t chunks, unsigned threads, F f) {
+        if(threads == 0) {
+            threads = std::thread::hardware_concurrency();
+        }
+        if(threads > chunks) {
+            threads = static_cast<unsigned>(chunks);
+        }
+        if(threads <= 1) {
+            for(size_t chunk = 0; chunk < chunks; ++chunk) {
+                f(chunk);
+            }
+            return;
+        }
+
+        std::atomic<size_t> next(0);
+        std::exception_ptr error;
+        std::atomic<bool> failed(false);
+        auto worker = [&]() {
+            try {
+                for(size_t chunk = next++; chunk < chunks && !failed; chunk = next++) {
+                    f(chunk);
+                }
+            }
+            catch(...) {
+                if(!failed.exchange(true)) {
+                    error = std::current_exception();
+                }
+            }
+        };
+        std::vector<std::thread> pool;
+        for(unsigned i = 1; i < threads; ++i) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for(auto& thread : pool) {
+            thread.join();
+        }
+        if(error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    template<class output, class type, class alloc>
+    typename std::enable_if<is_binary_output<output>::value>::type write_chunked(output& os, std::vector<type, alloc>& vec,
+            size_t chunk_elements = 4096, unsigned threads = 0) {
+        if(chunk_elements == 0) {
+            chunk_elements = 1;
+        }
+        size_t chunks = (vec.size() + chunk_elements - 1) / chunk_elements;
+        std::deque<buffer_writer> buffers(chunks);
+        for_each_chunk(chunks, threads, [&](size_t chunk) {
+            size_t first = chunk * chunk_elements;
+            size_t count = std::min(chunk_elements, vec.size() - first);
+            write_elements(buffers[chunk], vec.data() + first, count, std::is_trivially_copyable<type>());
+        });
+
+        uint64_t size = vec.size();
+        uint64_t chunk_count = chunks;
+        write(os, size);
+        write(os, chunk_count);
+        for(size_t chunk = 0; chunk < chunks; ++chunk) {
+            uint64_t entry[2] = { std::min(chunk_elements, vec.size() - chunk * chunk_elements), buffers[chunk].size() };
+            write(os, entry);
+        }
+        for(auto& buffer : buffers) {
+            write_bytes(os, buffer.data(), buffer.size());
+        }
+    }
+
+    // The index of a chunked vector at the reader's position; the reader moves past the whole vector.
+    struct chunk_index {
+        explicit chunk_index(buffer_reader& is)
+            : payload_(nullptr)
+            , elements_(0) {
+            uint64_t chunks = 0;
+            read(is, elements_);
+            read(is, chunks);
+            if(!is || chunks > is.remaining() / (2 * sizeof(uint64_t))) {
+                is.fail();
+                return;
+            }
+            entries_.resize(static_cast<size_t>(chunks));
+            uint64_t first = 0;
+            uint64_t offset = 0;
+            for(auto& entry : entries_) {
+                uint64_t fields[2];
+                read(is, fields);
+                if(!is || fields[0] > elements_ - first || fields[1] > is.remaining() - offset) {
+                    is.fail();
+                    break;
+                }
+                entry.first = first;
+                entry.count = fields[0];
+                entry.offset = offset;
+                entry.size = fields[1];
+                first += entry.count;
+                offset += entry.size;
+            }
+            if(!is || first != elements_ || offset > is.remaining()) {
+                entries_.clear();
+                elements_ = 0;
+                is.fail();
+                return;
+            }
+            payload_ = is.current();
+            is.skip(static_cast<size_t>(offset));
+        }
+
+        bool valid() const {
+            return payload_ != nullptr;
+        }
+
+        // Number of elements in all chunks.
+        uint64_t elements() const {
+            return elements_;
+        }
+
+        size_t size() const {
+            return entries_.size();
+        }
+
+        const chunk_entry& operator[](size_t chunk) const {
+            return entries_[chunk];
+        }
+
+        // The encoded elements of one chunk.
+        buffer_reader reader(size_t chunk) const {
+            return buffer_reader(payload_ + entries_[chunk].offset, static_cast<size_t>(entries_[chunk].size));
+        }
+
+    private:
+        const char* payload_;
+        uint64_t elements_;
+        std::vector<chunk_entry> entries_;
+    };
+
+    // Fewest bytes an element takes in the format of write(): its own size if it is copied as is.
+    template<class type>
+    size_t least_element_size(std::true_type) {
+        return sizeof(type);
+    }
+
+    // Otherwise the size of a default constructed one, whose containers are empty.
+    template<class type>
+    size_t least_element_size(std::false_type) {
+        buffer_writer os;
+        type probe;
+        write_elements(os, &probe, 1, std::false_type());
+        return os.size();
+    }
+
+    // Whether a chunk's byte size can hold its element count, checked before anything is allocated for them.
+    template<class type>
+    bool chunk_fits(chunk_index const& index, size_t chunk) {
+        static const size_t least = least_element_size<type>(std::is_trivially_copyable<type>());
+        return least == 0 || index[chunk].count <= index[chunk].size / least;
+    }
+
+    // Decodes one chunk into data[0, count); false if it is not exactly that many elements.
+    template<class type>
+    bool read_chunk(chunk_index const& index, size_t chunk, type* data) {
+        buffer_reader is = index.reader(chunk);
+        read_elements(is, data, static_cast<size_t>(index[chunk].count), std::is_trivially_copyable<type>());
+        return is && is.remaining() == 0;
+    }
+
+    template<class type, class alloc>
+    bool read_chunk(chunk_index const& index, size_t chunk, std::vector<type, alloc>& vec) {
+        if(!chunk_fits<type>(index, chunk)) {
+            return false;
+        }
+        vec.resize(static_cast<size_t>(index[chunk].count));
+        return read_chunk(index, chunk, vec.data());
+    }
+
+    template<class type, class alloc>
+    void read_chunked(buffer_reader& is, std::vector<type, alloc>& vec, unsigned threads = 0) {
+        chunk_index index(is);
+        if(!index.valid()) {
+            return;
+        }
+        for(size_t chunk = 0; chunk < index.size(); ++chunk) {
+            if(!chunk_fits<type>(index, chunk)) {
+                is.fail();
+                return;
+            }
+        }
+        vec.resize(static_cast<size_t>(index.elements()));
+        std::atomic<bool> good(true);
+        for_each_chunk(index.size(), threads, [&](size_t chunk) {
+            if(!read_chunk(index, chunk, vec.data() + index[chunk].first)) {
+                good = false;
+            }
+        });
+        if(!good) {
+            is.fail();
+        }
+    }
+
+} // serialization
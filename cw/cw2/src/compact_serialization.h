@@ -0,0 +1,773 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <type_traits>
+#include "reflection.h"
+#include "binary_buffer.h"
+
+namespace serialization
+{
+    /*
+     * Compact binary format over the same reflect_type() as write()/read(),
+     * independent of padding and byte order and tolerant of schema changes.
+     *
+     * A reflected struct is a list of fields, each a varint key
+     * (tag << 3 | wire type) followed by the value, and ends with a zero key.
+     * The tag is derived from the field's name (tag_of()), so fields may be
+     * added, removed and reordered, but renaming one changes its tag; two
+     * names of a type that get the same tag are refused with
+     * std::logic_error the first time the type is used. Fields equal to their
+     * default value are left out. A reader skips tags it does not know and fields whose wire
+     * type no longer matches, and default constructs the fields it does not
+     * find, as read_json() does.
+     *
+     * Values by wire type:
+     *     varint    integers, bool, char and enums as LEB128, signed ones zig-zag encoded;
+     *               char is taken as unsigned and wchar_t as 32 bit unsigned on every platform
+     *     fixed64   double, little endian
+     *     fixed32   float, little endian
+     *     bytes     varint byte count, then the bytes: strings and POD types without reflect_type()
+     *     sequence  varint (count << 3 | element wire type), then the elements: vectors
+     *     group     fields up to a zero key: types with reflect_type(), POD or not
+     */
+    namespace compact
+    {
+        enum wire_type {
+            varint_wire = 0,
+            fixed64_wire = 1,
+            bytes_wire = 2,
+            sequence_wire = 3,
+            group_wire = 4,
+            fixed32_wire = 5
+        };
+
+        // Limits the recursion of skipping values of unknown shape.
+        const unsigned max_depth = 64;
+
+        template<class value>
+        struct is_integer : std::integral_constant<bool, std::is_integral<value>::value || std::is_enum<value>::value> {
+        };
+
+        template<class value>
+        struct is_fixed : std::integral_constant<bool, std::is_floating_point<value>::value && (sizeof(value) == 4 || sizeof(value) == 8)> {
+        };
+
+        struct resetter {
+            template<class field_type>
+            void operator()(field_type& value, const char* key) {
+                value = field_type();
+            }
+        };
+
+        // Types with a reflect_type(), POD or not: they are written field by field.
+        template<class value>
+        auto reflects(int) -> decltype(reflect_type(std::declval<resetter&>(), std::declval<value&>()), std::true_type());
+
+        template<class value>
+        std::false_type reflects(...);
+
+        template<class value>
+        struct is_reflected : decltype(reflects<value>(0)) {
+        };
+
+        // Other POD types go as their bytes.
+        template<class value>
+        struct is_raw : std::integral_constant<bool, std::is_pod<value>::value && !is_integer<value>::value
+            && !is_fixed<value>::value && !is_reflected<value>::value> {
+        };
+
+        template<class value, class enable = void>
+        struct wire_of : std::integral_constant<unsigned, group_wire> {
+        };
+
+        template<class value>
+        struct wire_of<value, typename std::enable_if<is_integer<value>::value>::type> : std::integral_constant<unsigned, varint_wire> {
+        };
+
+        template<class value>
+        struct wire_of<value, typename std::enable_if<is_fixed<value>::value>::type>
+            : std::integral_constant<unsigned, sizeof(value) == 8 ? fixed64_wire : fixed32_wire> {
+        };
+
+        template<class value>
+        struct wire_of<value, typename std::enable_if<is_raw<value>::value>::type> : std::integral_constant<unsigned, bytes_wire> {
+        };
+
+        template<class value, class traits, class alloc>
+        struct wire_of<std::basic_string<value, traits, alloc>> : std::integral_constant<unsigned, bytes_wire> {
+        };
+
+        template<class value, class alloc>
+        struct wire_of<std::vector<value, alloc>> : std::integral_constant<unsigned, sequence_wire> {
+        };
+
+        // Arrays of fixed width values are stored as they are in memory on little endian targets.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        template<class value>
+        struct is_bulk : is_fixed<value> {
+        };
+#else
+        template<class value>
+        struct is_bulk : std::false_type {
+        };
+#endif
+
+        // The integer a value is encoded as: char and wchar_t, whose signedness and width vary by platform, get fixed ones.
+        template<class value, bool = std::is_enum<value>::value>
+        struct integer_of {
+            typedef value type;
+        };
+
+        template<class value>
+        struct integer_of<value, true> : integer_of<typename std::underlying_type<value>::type> {
+        };
+
+        template<>
+        struct integer_of<char, false> {
+            typedef unsigned char type;
+        };
+
+        template<>
+        struct integer_of<wchar_t, false> {
+            typedef uint32_t type;
+        };
+
+        // Tags are below 2^18, so that a key takes at most three bytes.
+        const uint64_t tag_limit = uint64_t(1) << 18;
+
+        // A field's tag: the 32 bit FNV-1a hash of its name, folded into [1, tag_limit).
+        inline uint64_t tag_of(const char* name) {
+            uint32_t hash = 2166136261u;
+            for(; *name != '\0'; ++name) {
+                hash = (hash ^ static_cast<unsigned char>(*name)) * 16777619u;
+            }
+            return hash % (tag_limit - 1) + 1;
+        }
+
+        /*
+         * Tags of a type's fields, in reflect_type() order, computed on first
+         * use, and the way back from a tag to the field's position for fields
+         * that do not come in that order.
+         */
+        template<class type>
+        struct tag_table {
+            static tag_table const& get() {
+                static const tag_table table;
+                return table;
+            }
+
+            const uint64_t* tags() const {
+                return tags_.data();
+            }
+
+            // Position of the field with the given tag, or npos.
+            size_t find(uint64_t tag) const {
+                auto at = std::lower_bound(sorted_.begin(), sorted_.end(), std::make_pair(tag, size_t(0)));
+                if(at == sorted_.end() || at->first != tag) {
+                    return npos;
+                }
+                return at->second;
+            }
+
+            static const size_t npos = size_t(-1);
+
+        private:
+            struct collector {
+                template<class field_type>
+                void operator()(field_type& value, const char* key) {
+                    tags.push_back(tag_of(key));
+                    names.push_back(key);
+                }
+
+                std::vector<uint64_t> tags;
+                std::vector<const char*> names;
+            };
+
+            tag_table() {
+                type probe;
+                collector collect;
+                reflect_type(collect, probe);
+                tags_ = collect.tags;
+                for(size_t i = 0; i < tags_.size(); ++i) {
+                    sorted_.push_back(std::make_pair(tags_[i], i));
+                }
+                std::sort(sorted_.begin(), sorted_.end());
+                for(size_t i = 1; i < sorted_.size(); ++i) {
+                    if(sorted_[i].first == sorted_[i - 1].first) {
+                        throw std::logic_error(std::string("compact: fields ") + collect.names[sorted_[i - 1].second]
+                            + " and " + collect.names[sorted_[i].second] + " have the same tag");
+                    }
+                }
+            }
+
+            std::vector<uint64_t> tags_;
+            std::vector<std::pair<uint64_t, size_t>> sorted_;
+        };
+
+        inline uint64_t zigzag(int64_t value) {
+            return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        }
+
+        inline int64_t unzigzag(uint64_t bits) {
+            return static_cast<int64_t>((bits >> 1) ^ (~(bits & 1) + 1));
+        }
+
+        template<class value>
+        uint64_t encode_integer(value obj, std::true_type) {
+            return zigzag(static_cast<int64_t>(obj));
+        }
+
+        template<class value>
+        uint64_t encode_integer(value obj, std::false_type) {
+            return static_cast<uint64_t>(obj);
+        }
+
+        template<class value>
+        uint64_t encode_integer(value obj) {
+            typedef typename integer_of<value>::type integer;
+            return encode_integer(static_cast<integer>(obj), std::is_signed<integer>());
+        }
+
+        template<class value>
+        value decode_integer(uint64_t bits) {
+            typedef typename integer_of<value>::type integer;
+            return static_cast<value>(std::is_signed<integer>::value ? static_cast<integer>(unzigzag(bits)) : static_cast<integer>(bits));
+        }
+
+        inline void skip_bytes(std::istream& is, uint64_t count) {
+            if(count > static_cast<uint64_t>(std::numeric_limits<std::streamsize>::max())) {
+                fail(is);
+                return;
+            }
+            is.ignore(static_cast<std::streamsize>(count));
+            if(static_cast<uint64_t>(is.gcount()) != count) {
+                fail(is);
+            }
+        }
+
+        inline void skip_bytes(buffer_reader& is, uint64_t count) {
+            if(count > is.remaining()) {
+                is.fail();
+                return;
+            }
+            is.skip(static_cast<size_t>(count));
+        }
+
+        /*
+         * Whether count bytes can still follow: a bound on what a length prefix
+         * may allocate. A stream cannot tell, so only its state is checked;
+         * what is read from it grows in bounded steps instead (read_steps()).
+         */
+        inline bool available(std::istream& is, uint64_t) {
+            return static_cast<bool>(is);
+        }
+
+        inline bool available(buffer_reader& is, uint64_t count) {
+            if(!is || count > is.remaining()) {
+                is.fail();
+                return false;
+            }
+            return true;
+        }
+
+        template<class output>
+        void write_varint(output& os, uint64_t bits) {
+            uint8_t bytes[10];
+            size_t size = 0;
+            while(bits >= 0x80) {
+                bytes[size++] = static_cast<uint8_t>(bits) | 0x80;
+                bits >>= 7;
+            }
+            bytes[size++] = static_cast<uint8_t>(bits);
+            write_bytes(os, bytes, size);
+        }
+
+        // Encodes straight into the buffer when the longest varint fits.
+        inline void write_varint(buffer_writer& os, uint64_t bits) {
+            uint8_t* at = reinterpret_cast<uint8_t*>(os.space(10));
+            if(at == nullptr) {
+                write_varint<buffer_writer>(os, bits);
+                return;
+            }
+            size_t size = 0;
+            while(bits >= 0x80) {
+                at[size++] = static_cast<uint8_t>(bits) | 0x80;
+                bits >>= 7;
+            }
+            at[size++] = static_cast<uint8_t>(bits);
+            os.commit(size);
+        }
+
+        template<class input>
+        bool read_varint(input& is, uint64_t& bits) {
+            bits = 0;
+            for(unsigned shift = 0; shift < 70; shift += 7) {
+                uint8_t byte = 0;
+                read_bytes(is, &byte, 1);
+                if(!is) {
+                    return false;
+                }
+                bits |= static_cast<uint64_t>(byte & 0x7f) << shift;
+                if(byte < 0x80) {
+                    return true;
+                }
+            }
+            fail(is);
+            return false;
+        }
+
+        inline bool read_varint(buffer_reader& is, uint64_t& bits) {
+            if(!is) {
+                return false;
+            }
+            const uint8_t* at = reinterpret_cast<const uint8_t*>(is.current());
+            size_t limit = is.remaining() < 10 ? is.remaining() : 10;
+            bits = 0;
+            for(size_t i = 0; i < limit; ++i) {
+                bits |= static_cast<uint64_t>(at[i] & 0x7f) << (7 * i);
+                if(at[i] < 0x80) {
+                    is.skip(i + 1);
+                    return true;
+                }
+            }
+            is.fail();
+            return false;
+        }
+
+        template<class output>
+        void write_fixed(output& os, uint64_t bits, size_t size) {
+            uint8_t bytes[8];
+            for(size_t i = 0; i < size; ++i) {
+                bytes[i] = static_cast<uint8_t>(bits >> (8 * i));
+            }
+            write_bytes(os, bytes, size);
+        }
+
+        template<class input>
+        bool read_fixed(input& is, uint64_t& bits, size_t size) {
+            uint8_t bytes[8];
+            read_bytes(is, bytes, size);
+            if(!is) {
+                return false;
+            }
+            bits = 0;
+            for(size_t i = 0; i < size; ++i) {
+                bits |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+            }
+            return true;
+        }
+
+        template<class output, class type>
+        typename std::enable_if<is_integer<type>::value>::type write_value(output& os, type& obj);
+
+        template<class output, class type>
+        typename std::enable_if<is_fixed<type>::value>::type write_value(output& os, type& obj);
+
+        template<class output, class type>
+        typename std::enable_if<is_raw<type>::value>::type write_value(output& os, type& obj);
+
+        template<class output, class type>
+        typename std::enable_if<is_reflected<type>::value>::type write_value(output& os, type& obj);
+
+        template<class output, class type, class traits, class alloc>
+        void write_value(output& os, std::basic_string<type, traits, alloc>& str);
+
+        template<class output, class type, class alloc>
+        void write_value(output& os, std::vector<type, alloc>& vec);
+
+        template<class input, class type>
+        typename std::enable_if<is_integer<type>::value>::type read_value(input& is, type& obj, unsigned depth);
+
+        template<class input, class type>
+        typename std::enable_if<is_fixed<type>::value>::type read_value(input& is, type& obj, unsigned depth);
+
+        template<class input, class type>
+        typename std::enable_if<is_raw<type>::value>::type read_value(input& is, type& obj, unsigned depth);
+
+        template<class input, class type>
+        typename std::enable_if<is_reflected<type>::value>::type read_value(input& is, type& obj, unsigned depth);
+
+        template<class input, class type, class traits, class alloc>
+        void read_value(input& is, std::basic_string<type, traits, alloc>& str, unsigned depth);
+
+        template<class input, class type, class alloc>
+        void read_value(input& is, std::vector<type, alloc>& vec, unsigned depth);
+
+        // Values equal to a default constructed one, which are not written as fields.
+        template<class type>
+        bool is_default(type& obj, typename std::enable_if<is_integer<type>::value>::type* = nullptr) {
+            return obj == type();
+        }
+
+        // Floating point zero only when all bits are: -0.0 is written.
+        template<class type>
+        bool is_default(type& obj, typename std::enable_if<is_fixed<type>::value>::type* = nullptr) {
+            type zero = type();
+            return memcmp(&obj, &zero, sizeof(type)) == 0;
+        }
+
+        template<class type>
+        bool is_default(type& obj, typename std::enable_if<!is_integer<type>::value && !is_fixed<type>::value>::type* = nullptr) {
+            return false;
+        }
+
+        template<class type, class traits, class alloc>
+        bool is_default(std::basic_string<type, traits, alloc>& str) {
+            return str.empty();
+        }
+
+        template<class type, class alloc>
+        bool is_default(std::vector<type, alloc>& vec) {
+            return vec.empty();
+        }
+
+        template<class input>
+        void skip_value(input& is, unsigned wire, unsigned depth);
+
+        template<class input>
+        void skip_sequence(input& is, uint64_t count, unsigned wire, unsigned depth) {
+            if(wire == fixed64_wire || wire == fixed32_wire) {
+                uint64_t width = wire == fixed64_wire ? 8 : 4;
+                if(count > std::numeric_limits<uint64_t>::max() / width) {
+                    fail(is);
+                    return;
+                }
+                skip_bytes(is, count * width);
+                return;
+            }
+            for(uint64_t i = 0; i < count && is; ++i) {
+                skip_value(is, wire, depth);
+            }
+        }
+
+        template<class input>
+        void skip_value(input& is, unsigned wire, unsigned depth) {
+            if(depth > max_depth) {
+                fail(is);
+                return;
+            }
+            uint64_t bits = 0;
+            switch(wire) {
+            case varint_wire:
+                read_varint(is, bits);
+                break;
+            case fixed64_wire:
+                skip_bytes(is, 8);
+                break;
+            case fixed32_wire:
+                skip_bytes(is, 4);
+                break;
+            case bytes_wire:
+                if(read_varint(is, bits)) {
+                    skip_bytes(is, bits);
+                }
+                break;
+            case sequence_wire:
+                if(read_varint(is, bits)) {
+                    skip_sequence(is, bits >> 3, static_cast<unsigned>(bits & 7), depth + 1);
+                }
+                break;
+            case group_wire:
+                while(read_varint(is, bits) && bits != 0) {
+                    skip_value(is, static_cast<unsigned>(bits & 7), depth + 1);
+                }
+                break;
+            default:
+                fail(is);
+            }
+        }
+
+        template<class output>
+        struct writer {
+            writer(output& os, const uint64_t* tags)
+                : stream(os)
+                , tag(tags) {
+            }
+
+            template<class field_type>
+            void operator()(field_type& value, const char* key) {
+                uint64_t field = *tag++;
+                if(is_default(value)) {
+                    return;
+                }
+                write_varint(stream, field << 3 | wire_of<field_type>::value);
+                write_value(stream, value);
+            }
+
+        private:
+            output& stream;
+            const uint64_t* tag;
+        };
+
+        template<class input>
+        struct read_context {
+            input& stream;
+            unsigned wire;
+            unsigned depth;
+        };
+
+        // What a field table entry does with the field: read the current value into it if its wire type still matches, else drop it.
+        template<class input>
+        struct read_binding {
+            typedef read_context<input> context;
+
+            template<class field_type>
+            static void apply(context& ctx, field_type& value) {
+                if(ctx.wire == wire_of<field_type>::value) {
+                    read_value(ctx.stream, value, ctx.depth);
+                }
+                else {
+                    value = field_type();
+                    skip_value(ctx.stream, ctx.wire, ctx.depth);
+                }
+            }
+        };
+
+        /*
+         * Reads the fields that come in reflect_type() order, as they are
+         * written, in one pass: a field whose tag is not next is missing and
+         * gets its default value. What is left afterwards (unknown tags, fields
+         * out of order) goes through the tag and field tables.
+         */
+        template<class input>
+        struct reader {
+            reader(input& is, unsigned depth, const uint64_t* tags)
+                : stream(is)
+                , depth(depth)
+                , field(tags)
+                , key(0)
+                , more(false) {
+                next();
+            }
+
+            template<class field_type>
+            void operator()(field_type& value, const char* name) {
+                if(more && tag() == *field++) {
+                    read_context<input> ctx = { stream, wire(), depth };
+                    read_binding<input>::apply(ctx, value);
+                    next();
+                }
+                else {
+                    value = field_type();
+                }
+            }
+
+            bool next() {
+                more = read_varint(stream, key) && key != 0;
+                return more;
+            }
+
+            bool pending() const {
+                return more;
+            }
+
+            uint64_t tag() const {
+                return key >> 3;
+            }
+
+            unsigned wire() const {
+                return static_cast<unsigned>(key & 7);
+            }
+
+        private:
+            input& stream;
+            unsigned depth;
+            const uint64_t* field;
+            uint64_t key;
+            bool more;
+        };
+
+        template<class output, class type>
+        typename std::enable_if<is_integer<type>::value>::type write_value(output& os, type& obj) {
+            write_varint(os, encode_integer(obj));
+        }
+
+        template<class output, class type>
+        typename std::enable_if<is_fixed<type>::value>::type write_value(output& os, type& obj) {
+            typename std::conditional<sizeof(type) == 8, uint64_t, uint32_t>::type bits;
+            memcpy(&bits, &obj, sizeof(type));
+            write_fixed(os, bits, sizeof(type));
+        }
+
+        template<class output, class type>
+        typename std::enable_if<is_raw<type>::value>::type write_value(output& os, type& obj) {
+            write_varint(os, sizeof(type));
+            write_bytes(os, &obj, sizeof(type));
+        }
+
+        template<class output, class type>
+        typename std::enable_if<is_reflected<type>::value>::type write_value(output& os, type& obj) {
+            writer<output> proc(os, tag_table<type>::get().tags());
+            reflect_type(proc, obj);
+            write_varint(os, 0);
+        }
+
+        template<class output, class type, class traits, class alloc>
+        void write_value(output& os, std::basic_string<type, traits, alloc>& str) {
+            write_varint(os, str.size() * sizeof(type));
+            write_bytes(os, str.data(), str.size() * sizeof(type));
+        }
+
+        template<class output, class type>
+        void write_sequence(output& os, type* data, size_t count, std::true_type) {
+            write_bytes(os, data, count * sizeof(type));
+        }
+
+        template<class output, class type>
+        void write_sequence(output& os, type* data, size_t count, std::false_type) {
+            for(size_t i = 0; i < count; ++i) {
+                write_value(os, data[i]);
+            }
+        }
+
+        template<class output, class type, class alloc>
+        void write_value(output& os, std::vector<type, alloc>& vec) {
+            write_varint(os, static_cast<uint64_t>(vec.size()) << 3 | wire_of<type>::value);
+            write_sequence(os, vec.data(), vec.size(), is_bulk<type>());
+        }
+
+        template<class input, class type>
+        typename std::enable_if<is_integer<type>::value>::type read_value(input& is, type& obj, unsigned depth) {
+            uint64_t bits;
+            if(read_varint(is, bits)) {
+                obj = decode_integer<type>(bits);
+            }
+        }
+
+        template<class input, class type>
+        typename std::enable_if<is_fixed<type>::value>::type read_value(input& is, type& obj, unsigned depth) {
+            uint64_t bits;
+            if(read_fixed(is, bits, sizeof(type))) {
+                typename std::conditional<sizeof(type) == 8, uint64_t, uint32_t>::type narrow = bits;
+                memcpy(&obj, &narrow, sizeof(type));
+            }
+        }
+
+        // A size that does not match the type's is taken as a changed field and skipped.
+        template<class input, class type>
+        typename std::enable_if<is_raw<type>::value>::type read_value(input& is, type& obj, unsigned depth) {
+            uint64_t size;
+            if(!read_varint(is, size)) {
+                return;
+            }
+            if(size != sizeof(type)) {
+                skip_bytes(is, size);
+                return;
+            }
+            read_bytes(is, &obj, sizeof(type));
+        }
+
+        template<class input, class type>
+        typename std::enable_if<is_reflected<type>::value>::type read_value(input& is, type& obj, unsigned depth) {
+            if(depth > max_depth) {
+                fail(is);
+                return;
+            }
+            tag_table<type> const& tags = tag_table<type>::get();
+            reader<input> proc(is, depth + 1, tags.tags());
+            reflect_type(proc, obj);
+            if(!proc.pending()) {
+                return;
+            }
+            typedef reflection::field_table<type, read_binding<input>> fields;
+            fields const& table = fields::get();
+            read_context<input> ctx = { is, 0, depth + 1 };
+            do {
+                ctx.wire = proc.wire();
+                size_t field = tags.find(proc.tag());
+                if(field != tag_table<type>::npos) {
+                    table.apply(table[field], ctx, obj);
+                }
+                else {
+                    skip_value(is, ctx.wire, depth + 1);
+                }
+            } while(proc.next());
+        }
+
+        template<class input, class type>
+        void read_sequence(input& is, type* data, size_t count, unsigned depth, std::true_type) {
+            read_bytes(is, data, count * sizeof(type));
+        }
+
+        template<class input, class type>
+        void read_sequence(input& is, type* data, size_t count, unsigned depth, std::false_type) {
+            for(size_t i = 0; i < count && is; ++i) {
+                read_value(is, data[i], depth);
+            }
+        }
+
+        /*
+         * Reads count elements into seq, which the caller checked with
+         * available(). That is exact for a buffer, which is read in one go; a
+         * stream's sequence grows read_step_bytes at a time, so a corrupt
+         * count runs out of input before it allocates much.
+         */
+        template<class input, class sequence, class bulk>
+        void read_steps(input& is, sequence& seq, uint64_t count, unsigned depth, bulk) {
+            typedef typename sequence::value_type type;
+            uint64_t step = readable_elements(is, 1) != UINT64_MAX ? count : (read_step_bytes + sizeof(type) - 1) / sizeof(type);
+            if(count == 0) {
+                seq.clear();
+            }
+            for(uint64_t done = 0; done < count && is;) {
+                size_t next = static_cast<size_t>(count - done < step ? count - done : step);
+                seq.resize(static_cast<size_t>(done) + next);
+                read_sequence(is, &seq[static_cast<size_t>(done)], next, depth, bulk());
+                done += next;
+            }
+        }
+
+        template<class input, class type, class traits, class alloc>
+        void read_value(input& is, std::basic_string<type, traits, alloc>& str, unsigned depth) {
+            uint64_t size;
+            if(!read_varint(is, size)) {
+                return;
+            }
+            if(size % sizeof(type) != 0 || !available(is, size)) {
+                fail(is);
+                return;
+            }
+            read_steps(is, str, size / sizeof(type), depth, std::true_type());
+        }
+
+        // Every element takes at least one byte, which bounds the count before anything is allocated.
+        template<class input, class type, class alloc>
+        void read_value(input& is, std::vector<type, alloc>& vec, unsigned depth) {
+            uint64_t header;
+            if(!read_varint(is, header)) {
+                return;
+            }
+            uint64_t count = header >> 3;
+            unsigned wire = static_cast<unsigned>(header & 7);
+            if(wire != wire_of<type>::value) {
+                vec.clear();
+                skip_sequence(is, count, wire, depth + 1);
+                return;
+            }
+            if(!available(is, count) || (is_fixed<type>::value && !available(is, count * sizeof(type)))) {
+                fail(is);
+                return;
+            }
+            read_steps(is, vec, count, depth + 1, is_bulk<type>());
+        }
+    }
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value>::type write_compact(output& os, type& obj) {
+        compact::write_value(os, obj);
+    }
+
+    template<class input, class type>
+    typename std::enable_if<is_binary_input<input>::value>::type read_compact(input& is, type& obj) {
+        compact::read_value(is, obj, 0);
+    }
+
+} // serialization
@@ -0,0 +1,312 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define JSON_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace serialization
+{
+    /*
+     * Stage 1 of JSON parsing: finds where every token starts, 64 bytes at a
+     * time. Each block is classified into bitmasks (quotes, backslashes,
+     * structural characters, whitespace, control characters) by a SIMD kernel;
+     * the rest is scalar bit arithmetic on the masks: escaped characters, the
+     * inside of strings as a prefix XOR of the unescaped quotes, and the start
+     * of every number or literal.
+     *
+     * The index holds the offsets of { } [ ] : , outside strings, of both
+     * quotes of every string and of the first character of every number or
+     * literal. The scanner is streaming: state carries over between scan()
+     * calls, so input can be indexed a chunk at a time. A control character
+     * inside a string or an unterminated string sets error().
+     */
+    namespace json_scan
+    {
+        enum kernel {
+            scalar_kernel,
+            sse2_kernel,
+            avx2_kernel,
+            best_kernel
+        };
+
+        struct block_masks {
+            uint64_t quote;
+            uint64_t backslash;
+            uint64_t op;
+            uint64_t space;
+            uint64_t control;
+        };
+
+        enum byte_class {
+            quote_class = 1,
+            backslash_class = 2,
+            op_class = 4,
+            space_class = 8,
+            control_class = 16
+        };
+
+        inline const unsigned char* class_table() {
+            static const struct table_t {
+                table_t() {
+                    memset(classes, 0, sizeof(classes));
+                    for(int c = 0; c < 0x20; ++c) {
+                        classes[c] = control_class;
+                    }
+                    classes[int('"')] = quote_class;
+                    classes[int('\\')] = backslash_class;
+                    const char ops[] = "{}[]:,";
+                    for(const char* op = ops; *op; ++op) {
+                        classes[static_cast<unsigned char>(*op)] = op_class;
+                    }
+                    classes[int(' ')] = space_class;
+                    classes[int('\t')] = space_class | control_class;
+                    classes[int('\n')] = space_class | control_class;
+                    classes[int('\r')] = space_class | control_class;
+                }
+                unsigned char classes[256];
+            } table;
+            return table.classes;
+        }
+
+        inline block_masks classify_scalar(const char* block) {
+            const unsigned char* classes = class_table();
+            block_masks masks = { 0, 0, 0, 0, 0 };
+            for(int i = 0; i < 64; ++i) {
+                unsigned char c = classes[static_cast<unsigned char>(block[i])];
+                uint64_t bit = uint64_t(1) << i;
+                masks.quote |= (c & quote_class) ? bit : 0;
+                masks.backslash |= (c & backslash_class) ? bit : 0;
+                masks.op |= (c & op_class) ? bit : 0;
+                masks.space |= (c & space_class) ? bit : 0;
+                masks.control |= (c & control_class) ? bit : 0;
+            }
+            return masks;
+        }
+
+#ifdef JSON_SCAN_X86
+        // [ and ] differ from { and } only in bit 0x20.
+        inline block_masks classify_sse2(const char* block) {
+            block_masks masks = { 0, 0, 0, 0, 0 };
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i case_bit = _mm_set1_epi8(0x20);
+            const __m128i open = _mm_set1_epi8('{');
+            const __m128i close = _mm_set1_epi8('}');
+            const __m128i colon = _mm_set1_epi8(':');
+            const __m128i comma = _mm_set1_epi8(',');
+            const __m128i space = _mm_set1_epi8(' ');
+            const __m128i tab = _mm_set1_epi8('\t');
+            const __m128i newline = _mm_set1_epi8('\n');
+            const __m128i carriage = _mm_set1_epi8('\r');
+            const __m128i last_control = _mm_set1_epi8(0x1f);
+            for(int i = 0; i < 4; ++i) {
+                __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + i * 16));
+                __m128i folded = _mm_or_si128(bytes, case_bit);
+                __m128i op = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(folded, open), _mm_cmpeq_epi8(folded, close)),
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, colon), _mm_cmpeq_epi8(bytes, comma)));
+                __m128i blank = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(bytes, space), _mm_cmpeq_epi8(bytes, tab)),
+                    _mm_or_si128(_mm_cmpeq_epi8(bytes, newline), _mm_cmpeq_epi8(bytes, carriage)));
+                __m128i control = _mm_cmpeq_epi8(_mm_max_epu8(bytes, last_control), last_control);
+                int shift = i * 16;
+                masks.quote |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)))) << shift;
+                masks.backslash |= uint64_t(uint16_t(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, backslash)))) << shift;
+                masks.op |= uint64_t(uint16_t(_mm_movemask_epi8(op))) << shift;
+                masks.space |= uint64_t(uint16_t(_mm_movemask_epi8(blank))) << shift;
+                masks.control |= uint64_t(uint16_t(_mm_movemask_epi8(control))) << shift;
+            }
+            return masks;
+        }
+
+        __attribute__((target("avx2")))
+        inline block_masks classify_avx2(const char* block) {
+            block_masks masks = { 0, 0, 0, 0, 0 };
+            const __m256i quote = _mm256_set1_epi8('"');
+            const __m256i backslash = _mm256_set1_epi8('\\');
+            const __m256i case_bit = _mm256_set1_epi8(0x20);
+            const __m256i open = _mm256_set1_epi8('{');
+            const __m256i close = _mm256_set1_epi8('}');
+            const __m256i colon = _mm256_set1_epi8(':');
+            const __m256i comma = _mm256_set1_epi8(',');
+            const __m256i space = _mm256_set1_epi8(' ');
+            const __m256i tab = _mm256_set1_epi8('\t');
+            const __m256i newline = _mm256_set1_epi8('\n');
+            const __m256i carriage = _mm256_set1_epi8('\r');
+            const __m256i last_control = _mm256_set1_epi8(0x1f);
+            for(int i = 0; i < 2; ++i) {
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + i * 32));
+                __m256i folded = _mm256_or_si256(bytes, case_bit);
+                __m256i op = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(folded, open), _mm256_cmpeq_epi8(folded, close)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(bytes, colon), _mm256_cmpeq_epi8(bytes, comma)));
+                __m256i blank = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(bytes, space), _mm256_cmpeq_epi8(bytes, tab)),
+                    _mm256_or_si256(_mm256_cmpeq_epi8(bytes, newline), _mm256_cmpeq_epi8(bytes, carriage)));
+                __m256i control = _mm256_cmpeq_epi8(_mm256_max_epu8(bytes, last_control), last_control);
+                int shift = i * 32;
+                masks.quote |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, quote)))) << shift;
+                masks.backslash |= uint64_t(uint32_t(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, backslash)))) << shift;
+                masks.op |= uint64_t(uint32_t(_mm256_movemask_epi8(op))) << shift;
+                masks.space |= uint64_t(uint32_t(_mm256_movemask_epi8(blank))) << shift;
+                masks.control |= uint64_t(uint32_t(_mm256_movemask_epi8(control))) << shift;
+            }
+            return masks;
+        }
+#endif
+
+        inline bool supported(kernel k) {
+#ifdef JSON_SCAN_X86
+            __builtin_cpu_init();
+#endif
+            switch(k) {
+            case scalar_kernel:
+            case best_kernel:
+                return true;
+#ifdef JSON_SCAN_X86
+            case sse2_kernel:
+                return __builtin_cpu_supports("sse2");
+            case avx2_kernel:
+                return __builtin_cpu_supports("avx2");
+#endif
+            default:
+                return false;
+            }
+        }
+
+        // The widest kernel the CPU runs.
+        inline kernel best() {
+            static const kernel widest = supported(avx2_kernel) ? avx2_kernel
+                : supported(sse2_kernel) ? sse2_kernel : scalar_kernel;
+            return widest;
+        }
+
+        inline uint64_t prefix_xor(uint64_t bits) {
+            bits ^= bits << 1;
+            bits ^= bits << 2;
+            bits ^= bits << 4;
+            bits ^= bits << 8;
+            bits ^= bits << 16;
+            bits ^= bits << 32;
+            return bits;
+        }
+    } // json_scan
+
+    struct json_scanner {
+        explicit json_scanner(json_scan::kernel k = json_scan::best_kernel)
+            : kernel_(select(k == json_scan::best_kernel ? json_scan::best() : k))
+            , escaped_carry_(0)
+            , in_string_carry_(0)
+            , scalar_carry_(0)
+            , error_(false) {
+        }
+
+        /*
+         * Writes the offsets (from data) of the token starts in [data, data + size)
+         * to index, which needs room for size + 64 entries, and returns how many
+         * there are. size has to be a multiple of 64 except for the last call,
+         * which is padded with spaces.
+         */
+        size_t scan(const char* data, size_t size, uint32_t* index) {
+            size_t full = size & ~size_t(63);
+            uint32_t* out = scan_blocks(data, full, index);
+            if(full != size) {
+                char last[64];
+                memset(last, ' ', sizeof(last));
+                memcpy(last, data + full, size - full);
+                out = next_block(json_scan::classify_scalar(last), static_cast<uint32_t>(full), out);
+                finish();
+            }
+            return out - index;
+        }
+
+        // Call after the last block when the input was a multiple of 64 bytes.
+        void finish() {
+            error_ = error_ || in_string_carry_ != 0;
+        }
+
+        bool error() const {
+            return error_;
+        }
+
+    private:
+        static json_scan::kernel select(json_scan::kernel k) {
+            return json_scan::supported(k) ? k : json_scan::scalar_kernel;
+        }
+
+        // One loop per kernel, so that the classifier is inlined into code built for its instruction set.
+        uint32_t* scan_blocks(const char* data, size_t size, uint32_t* out) {
+#ifdef JSON_SCAN_X86
+            if(kernel_ == json_scan::avx2_kernel) {
+                return scan_blocks_avx2(data, size, out);
+            }
+            if(kernel_ == json_scan::sse2_kernel) {
+                return scan_blocks_sse2(data, size, out);
+            }
+#endif
+            for(size_t offset = 0; offset < size; offset += 64) {
+                out = next_block(json_scan::classify_scalar(data + offset), static_cast<uint32_t>(offset), out);
+            }
+            return out;
+        }
+
+#ifdef JSON_SCAN_X86
+        uint32_t* scan_blocks_sse2(const char* data, size_t size, uint32_t* out) {
+            for(size_t offset = 0; offset < size; offset += 64) {
+                out = next_block(json_scan::classify_sse2(data + offset), static_cast<uint32_t>(offset), out);
+            }
+            return out;
+        }
+
+        __attribute__((target("avx2")))
+        uint32_t* scan_blocks_avx2(const char* data, size_t size, uint32_t* out) {
+            for(size_t offset = 0; offset < size; offset += 64) {
+                out = next_block(json_scan::classify_avx2(data + offset), static_cast<uint32_t>(offset), out);
+            }
+            return out;
+        }
+#endif
+
+        uint32_t* next_block(json_scan::block_masks const& masks, uint32_t offset, uint32_t* out) {
+            // A backslash escapes the next character unless it is escaped itself.
+            uint64_t escaped = escaped_carry_;
+            escaped_carry_ = 0;
+            for(uint64_t backslash = masks.backslash; backslash != 0; backslash &= backslash - 1) {
+                unsigned bit = __builtin_ctzll(backslash);
+                if((escaped >> bit & 1) == 0) {
+                    if(bit == 63) {
+                        escaped_carry_ = 1;
+                    }
+                    else {
+                        escaped |= uint64_t(1) << (bit + 1);
+                    }
+                }
+            }
+
+            // Opening quotes and the inside of strings; closing quotes are outside.
+            uint64_t quotes = masks.quote & ~escaped;
+            uint64_t in_string = json_scan::prefix_xor(quotes) ^ in_string_carry_;
+            in_string_carry_ = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> 63);
+
+            uint64_t scalar = ~(masks.op | masks.space | quotes | in_string);
+            uint64_t scalar_starts = scalar & ~(scalar << 1 | scalar_carry_);
+            scalar_carry_ = scalar >> 63;
+
+            error_ = error_ || (masks.control & in_string & ~quotes) != 0;
+
+            uint64_t starts = (masks.op & ~in_string) | quotes | scalar_starts;
+            for(; starts != 0; starts &= starts - 1) {
+                *out++ = offset + __builtin_ctzll(starts);
+            }
+            return out;
+        }
+
+        json_scan::kernel kernel_;
+        uint64_t escaped_carry_;
+        uint64_t in_string_carry_;
+        uint64_t scalar_carry_;
+        bool error_;
+    };
+
+} // serialization
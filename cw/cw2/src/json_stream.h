@@ -0,0 +1,835 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <deque>
+#include <istream>
+#include <type_traits>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+#include "reflection.h"
+#include "binary_buffer.h"
+#include "json_scan.h"
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define JSON_STREAM_TO_CHARS 1
+#endif
+
+namespace serialization
+{
+    /*
+     * Streaming JSON output: as reflect_type() visits the fields they are
+     * written straight to a byte target (buffer_writer or std::ostream), with
+     * no json_value_t tree in between. Numbers are formatted into a stack
+     * buffer. Floating point values use std::to_chars (shortest round trip)
+     * where the standard library has it, and otherwise the shortest of
+     * %.{digits10}g .. %.{max_digits10}g which reads back as the same value.
+     */
+    namespace json_format
+    {
+        const size_t max_number = 64;
+
+        inline const char* digit_pairs() {
+            static const char pairs[] =
+                "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+                "404142434445464748495051525354555657585960616263646566676869707172737475767778798081"
+                "828384858687888990919293949596979899";
+            static_assert(sizeof(pairs) == 2 * 100 + 1, "digit_pairs should hold 00 .. 99");
+            return pairs;
+        }
+
+        inline char* format_unsigned(char* out, uint64_t value) {
+            char digits[24];
+            char* begin = digits + sizeof(digits);
+            while(value >= 100) {
+                const char* pair = digit_pairs() + (value % 100) * 2;
+                value /= 100;
+                *--begin = pair[1];
+                *--begin = pair[0];
+            }
+            if(value >= 10) {
+                const char* pair = digit_pairs() + value * 2;
+                *--begin = pair[1];
+                *--begin = pair[0];
+            }
+            else {
+                *--begin = static_cast<char>('0' + value);
+            }
+            size_t count = digits + sizeof(digits) - begin;
+            memcpy(out, begin, count);
+            return out + count;
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_unsigned<type>::value, char*>::type format_integer(char* out, type value) {
+            return format_unsigned(out, value);
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_signed<type>::value, char*>::type format_integer(char* out, type value) {
+            uint64_t magnitude = static_cast<uint64_t>(value);
+            if(value < 0) {
+                *out++ = '-';
+                magnitude = 0 - magnitude;
+            }
+            return format_unsigned(out, magnitude);
+        }
+
+        // JSON has no NaN or infinity; they are written as null.
+        template<class type>
+        char* format_floating(char* out, type value) {
+            if(!std::isfinite(value)) {
+                memcpy(out, "null", 4);
+                return out + 4;
+            }
+#ifdef JSON_STREAM_TO_CHARS
+            return std::to_chars(out, out + max_number, value).ptr;
+#else
+            int count = 0;
+            for(int precision = std::numeric_limits<type>::digits10; ; ++precision) {
+                count = snprintf(out, max_number, "%.*Lg", precision, static_cast<long double>(value));
+                if(precision >= std::numeric_limits<type>::max_digits10
+                        || static_cast<type>(strtold(out, nullptr)) == value) {
+                    break;
+                }
+            }
+            return out + count;
+#endif
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_integral<type>::value, char*>::type format_number(char* out, type value) {
+            return format_integer(out, value);
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_floating_point<type>::value, char*>::type format_number(char* out, type value) {
+            return format_floating(out, value);
+        }
+    } // json_format
+
+    template<class type>
+    struct is_json_number : std::integral_constant<bool,
+        std::is_arithmetic<type>::value && !std::is_same<type, bool>::value && !std::is_same<type, char>::value> {
+    };
+
+    template<class output>
+    void write_json_string(output& os, const char* text, size_t size) {
+        static const char hex[] = "0123456789abcdef";
+        write_bytes(os, "\"", 1);
+        size_t run = 0;
+        for(size_t i = 0; i < size; ++i) {
+            unsigned char c = static_cast<unsigned char>(text[i]);
+            if(c >= 0x20 && c != '"' && c != '\\') {
+                continue;
+            }
+            write_bytes(os, text + run, i - run);
+            run = i + 1;
+            char escaped[6] = { '\\', static_cast<char>(c), 0, 0, 0, 0 };
+            size_t length = 2;
+            switch(c) {
+            case '"': case '\\': break;
+            case '\b': escaped[1] = 'b'; break;
+            case '\f': escaped[1] = 'f'; break;
+            case '\n': escaped[1] = 'n'; break;
+            case '\r': escaped[1] = 'r'; break;
+            case '\t': escaped[1] = 't'; break;
+            default:
+                memcpy(escaped + 1, "u00", 3);
+                escaped[4] = hex[c >> 4];
+                escaped[5] = hex[c & 15];
+                length = 6;
+            }
+            write_bytes(os, escaped, length);
+        }
+        write_bytes(os, text + run, size - run);
+        write_bytes(os, "\"", 1);
+    }
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && is_json_number<type>::value>::type write_json(output& os, type& obj);
+
+    template<class output>
+    void write_json(output& os, bool& obj);
+
+    template<class output>
+    void write_json(output& os, char& obj);
+
+    template<class output, class traits, class alloc>
+    void write_json(output& os, std::basic_string<char, traits, alloc>& str);
+
+    template<class output, class type, class alloc>
+    void write_json(output& os, std::vector<type, alloc>& vec);
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && !std::is_arithmetic<type>::value>::type write_json(output& os, type& obj);
+
+    // Writes the visited fields as the members of a JSON object.
+    template<class output>
+    struct json_writer {
+        json_writer(output& os)
+            : stream(os)
+            , first(true) {
+        }
+
+        template<class field_type>
+        void operator()(field_type& value, const char* key) {
+            if(!first) {
+                write_bytes(stream, ",", 1);
+            }
+            first = false;
+            write_json_string(stream, key, strlen(key));
+            write_bytes(stream, ":", 1);
+            write_json(stream, value);
+        }
+
+    private:
+        output& stream;
+        bool first;
+    };
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && is_json_number<type>::value>::type write_json(output& os, type& obj) {
+        char number[json_format::max_number];
+        char* end = json_format::format_number(number, obj);
+        write_bytes(os, number, end - number);
+    }
+
+    template<class output>
+    void write_json(output& os, bool& obj) {
+        if(obj) {
+            write_bytes(os, "true", 4);
+        }
+        else {
+            write_bytes(os, "false", 5);
+        }
+    }
+
+    // A char is a one-character string, as in json_value_t.
+    template<class output>
+    void write_json(output& os, char& obj) {
+        write_json_string(os, &obj, 1);
+    }
+
+    template<class output, class traits, class alloc>
+    void write_json(output& os, std::basic_string<char, traits, alloc>& str) {
+        write_json_string(os, str.data(), str.size());
+    }
+
+    template<class output, class type, class alloc>
+    void write_json(output& os, std::vector<type, alloc>& vec) {
+        write_bytes(os, "[", 1);
+        for(size_t i = 0; i < vec.size(); ++i) {
+            if(i != 0) {
+                write_bytes(os, ",", 1);
+            }
+            write_json(os, vec[i]);
+        }
+        write_bytes(os, "]", 1);
+    }
+
+    template<class output, class type>
+    typename std::enable_if<is_binary_output<output>::value && !std::is_arithmetic<type>::value>::type write_json(output& os, type& obj) {
+        write_bytes(os, "{", 1);
+        json_writer<output> proc(os);
+        reflect_type(proc, obj);
+        write_bytes(os, "}", 1);
+    }
+
+    /*
+     * Pull JSON input, the reading side of json_writer. read_json() parses
+     * directly into the object, without building a json_value_t: each key is
+     * resolved through the type's reflection::field_table (a perfect hash of
+     * the names reflect_type() declares) and the value is parsed into that
+     * field. Unknown keys are skipped, and fields missing from the input are
+     * default constructed, as with json_reader_t.
+     *
+     * Input is a contiguous buffer (e.g. a mapped_file) or a std::istream read
+     * through a fixed-size window, so memory stays bounded by the window, the
+     * longest string and the nesting depth.
+     *
+     * A contiguous buffer can also be indexed by json_scanner, 64 KB at a
+     * time: strings without escapes are then copied up to their closing quote
+     * in one go, and skipped values are stepped over token by token. This pays
+     * off for long strings and inputs that are mostly skipped; on dense
+     * numeric records the index costs more than it saves, so it is opt-in.
+     */
+    struct json_pull_reader {
+        json_pull_reader(const char* data, size_t size, bool indexed = false)
+            : pos_(data)
+            , end_(data + size)
+            , source_(nullptr)
+            , window_(0)
+            , depth_(0)
+            , good_(true)
+            , indexed_(indexed)
+            , index_size_(0)
+            , index_pos_(0)
+            , chunk_(data)
+            , scanned_(data) {
+        }
+
+        explicit json_pull_reader(std::istream& is, size_t window = 1 << 16)
+            : pos_(nullptr)
+            , end_(nullptr)
+            , source_(&is)
+            , window_(window != 0 ? window : 1)
+            , depth_(0)
+            , good_(true)
+            , indexed_(false)
+            , index_size_(0)
+            , index_pos_(0)
+            , chunk_(nullptr)
+            , scanned_(nullptr) {
+        }
+
+        json_pull_reader(json_pull_reader const& other) = delete;
+        json_pull_reader& operator=(json_pull_reader const& other) = delete;
+
+        explicit operator bool() const {
+            return good_;
+        }
+
+        void fail() {
+            good_ = false;
+        }
+
+        // Next character after whitespace without consuming it; -1 at the end of input.
+        int peek() {
+            for(;;) {
+                int c = peek_raw();
+                if(c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                    return c;
+                }
+                ++pos_;
+            }
+        }
+
+        bool expect(char c) {
+            if(!good_ || peek() != c) {
+                good_ = false;
+                return false;
+            }
+            ++pos_;
+            return true;
+        }
+
+        // A string value; out is overwritten, keeping its capacity.
+        bool read_string(std::string& out) {
+            out.clear();
+            if(!expect('"')) {
+                return false;
+            }
+            if(indexed_) {
+                const char* close = next_token();
+                if(close != end_ && *close == '"' && memchr(pos_, '\\', close - pos_) == nullptr) {
+                    out.assign(pos_, close);
+                    pos_ = close + 1;
+                    return true;
+                }
+            }
+            for(;;) {
+                const char* run = pos_;
+                while(pos_ != end_ && *pos_ != '"' && *pos_ != '\\'
+                        && static_cast<unsigned char>(*pos_) >= 0x20) {
+                    ++pos_;
+                }
+                out.append(run, pos_);
+                if(pos_ == end_) {
+                    if(!refill()) {
+                        break;
+                    }
+                    continue;
+                }
+                char c = *pos_++;
+                if(c == '"') {
+                    return true;
+                }
+                // a control character or a bad escape
+                if(c != '\\' || !read_escape(out)) {
+                    break;
+                }
+            }
+            good_ = false;
+            return false;
+        }
+
+        // A number or literal (true, false, null) into a NUL-terminated buffer.
+        bool read_token(char* out, size_t capacity, size_t& size) {
+            size = 0;
+            peek();
+            for(int c = peek_raw(); is_token_char(c); c = peek_raw()) {
+                if(size + 1 >= capacity) {
+                    good_ = false;
+                    return false;
+                }
+                out[size++] = static_cast<char>(c);
+                ++pos_;
+            }
+            out[size] = 0;
+            if(size == 0) {
+                good_ = false;
+            }
+            return good_;
+        }
+
+        void skip_value() {
+            int first = peek();
+            if(indexed_ && (first == '{' || first == '[')) {
+                skip_indexed();
+                return;
+            }
+            size_t depth = 0;
+            do {
+                int c = peek();
+                if(c == '"') {
+                    read_string(scratch_);
+                }
+                else if(c == '{' || c == '[') {
+                    ++pos_;
+                    ++depth;
+                }
+                else if(depth != 0 && (c == '}' || c == ']')) {
+                    ++pos_;
+                    --depth;
+                }
+                else if(depth != 0 && (c == ',' || c == ':')) {
+                    ++pos_;
+                }
+                else {
+                    char token[64];
+                    size_t size;
+                    read_token(token, sizeof(token), size);
+                }
+            } while(depth != 0 && good_);
+        }
+
+        // Key buffer of the object being entered, reused by every object at that nesting level.
+        std::string& enter_object() {
+            if(keys_.size() <= depth_) {
+                keys_.resize(depth_ + 1);
+            }
+            return keys_[depth_++];
+        }
+
+        void leave_object() {
+            --depth_;
+        }
+
+    private:
+        static const size_t chunk_size = 1 << 16;
+
+        // First indexed token start at or after pos_, or end_.
+        const char* next_token() {
+            for(;;) {
+                while(index_pos_ < index_size_ && chunk_ + index_[index_pos_] < pos_) {
+                    ++index_pos_;
+                }
+                if(index_pos_ < index_size_) {
+                    return chunk_ + index_[index_pos_];
+                }
+                if(scanned_ == end_ || !index_chunk()) {
+                    return end_;
+                }
+            }
+        }
+
+        // A control character in a string or an unterminated string: the input is invalid.
+        bool index_chunk() {
+            size_t size = end_ - scanned_ < static_cast<ptrdiff_t>(chunk_size) ? end_ - scanned_ : chunk_size;
+            index_.resize(chunk_size + 64);
+            index_pos_ = 0;
+            chunk_ = scanned_;
+            index_size_ = scanner_.scan(scanned_, size, index_.data());
+            scanned_ += size;
+            if(scanned_ == end_) {
+                scanner_.finish();
+            }
+            if(scanner_.error()) {
+                indexed_ = false;
+                good_ = false;
+            }
+            return good_;
+        }
+
+        // Steps over an object or array on the index: both quotes of every string are in it, so their contents are never looked at.
+        void skip_indexed() {
+            size_t depth = 0;
+            for(;;) {
+                const char* token = next_token();
+                if(token == end_) {
+                    good_ = false;
+                    return;
+                }
+                pos_ = token + 1;
+                if(*token == '{' || *token == '[') {
+                    ++depth;
+                }
+                else if(*token == '}' || *token == ']') {
+                    if(--depth == 0) {
+                        return;
+                    }
+                }
+                else if(*token == '"') {
+                    const char* close = next_token();
+                    if(close == end_) {
+                        good_ = false;
+                        return;
+                    }
+                    pos_ = close + 1;
+                }
+            }
+        }
+
+        static bool is_token_char(int c) {
+            return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+        }
+
+        int peek_raw() {
+            if(pos_ == end_ && !refill()) {
+                return -1;
+            }
+            return static_cast<unsigned char>(*pos_);
+        }
+
+        int get_raw() {
+            int c = peek_raw();
+            if(c != -1) {
+                ++pos_;
+            }
+            return c;
+        }
+
+        bool refill() {
+            if(source_ == nullptr || !good_) {
+                return false;
+            }
+            buffer_.resize(window_);
+            source_->read(&buffer_[0], window_);
+            size_t count = static_cast<size_t>(source_->gcount());
+            if(count == 0) {
+                return false;
+            }
+            pos_ = buffer_.data();
+            end_ = pos_ + count;
+            return true;
+        }
+
+        bool read_hex4(uint32_t& code) {
+            code = 0;
+            for(int i = 0; i < 4; ++i) {
+                int c = get_raw();
+                int digit = c >= '0' && c <= '9' ? c - '0'
+                    : c >= 'a' && c <= 'f' ? c - 'a' + 10
+                    : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+                if(digit < 0) {
+                    return false;
+                }
+                code = code * 16 + digit;
+            }
+            return true;
+        }
+
+        bool read_escape(std::string& out) {
+            int c = get_raw();
+            switch(c) {
+            case '"': case '\\': case '/': out += static_cast<char>(c); return true;
+            case 'b': out += '\b'; return true;
+            case 'f': out += '\f'; return true;
+            case 'n': out += '\n'; return true;
+            case 'r': out += '\r'; return true;
+            case 't': out += '\t'; return true;
+            case 'u': break;
+            default: return false;
+            }
+            uint32_t code;
+            if(!read_hex4(code)) {
+                return false;
+            }
+            if(code >= 0xd800 && code < 0xdc00) {
+                uint32_t low;
+                if(get_raw() != '\\' || get_raw() != 'u' || !read_hex4(low) || low < 0xdc00 || low >= 0xe000) {
+                    return false;
+                }
+                code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+            }
+            else if(code >= 0xdc00 && code < 0xe000) {
+                return false;
+            }
+            // UTF-8
+            if(code < 0x80) {
+                out += static_cast<char>(code);
+            }
+            else if(code < 0x800) {
+                out += static_cast<char>(0xc0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else if(code < 0x10000) {
+                out += static_cast<char>(0xe0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            else {
+                out += static_cast<char>(0xf0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (code & 0x3f));
+            }
+            return true;
+        }
+
+        const char* pos_;
+        const char* end_;
+        std::istream* source_;
+        size_t window_;
+        size_t depth_;
+        bool good_;
+        std::vector<char> buffer_;
+        std::deque<std::string> keys_;
+        std::string scratch_;
+        bool indexed_;
+        json_scanner scanner_;
+        std::vector<uint32_t> index_;
+        size_t index_size_;
+        size_t index_pos_;
+        const char* chunk_;
+        const char* scanned_;
+    };
+
+    namespace json_format
+    {
+        inline bool parse_unsigned(const char* text, size_t size, uint64_t& value) {
+            value = 0;
+            if(size == 0) {
+                return false;
+            }
+            for(size_t i = 0; i < size; ++i) {
+                unsigned digit = static_cast<unsigned char>(text[i]) - '0';
+                if(digit > 9 || value > (std::numeric_limits<uint64_t>::max() - digit) / 10) {
+                    return false;
+                }
+                value = value * 10 + digit;
+            }
+            return true;
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_unsigned<type>::value, bool>::type parse_integer(const char* text, size_t size, type& value) {
+            uint64_t magnitude;
+            if(!parse_unsigned(text, size, magnitude) || magnitude > std::numeric_limits<type>::max()) {
+                return false;
+            }
+            value = static_cast<type>(magnitude);
+            return true;
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_signed<type>::value, bool>::type parse_integer(const char* text, size_t size, type& value) {
+            bool negative = size != 0 && text[0] == '-';
+            uint64_t magnitude;
+            if(!parse_unsigned(text + negative, size - negative, magnitude)) {
+                return false;
+            }
+            uint64_t limit = static_cast<uint64_t>(std::numeric_limits<type>::max()) + negative;
+            if(magnitude > limit) {
+                return false;
+            }
+            value = negative ? static_cast<type>(0 - magnitude) : static_cast<type>(magnitude);
+            return true;
+        }
+
+        inline double parse_floating(const char* text, char** end, double) {
+            return strtod(text, end);
+        }
+
+        inline float parse_floating(const char* text, char** end, float) {
+            return strtof(text, end);
+        }
+
+        inline long double parse_floating(const char* text, char** end, long double) {
+            return strtold(text, end);
+        }
+
+        // null, which the writer uses for NaN and infinity, reads as NaN.
+        template<class type>
+        bool parse_floating(const char* text, size_t size, type& value) {
+            if(size == 4 && memcmp(text, "null", 4) == 0) {
+                value = std::numeric_limits<type>::quiet_NaN();
+                return true;
+            }
+#ifdef JSON_STREAM_TO_CHARS
+            std::from_chars_result result = std::from_chars(text, text + size, value);
+            return result.ec == std::errc() && result.ptr == text + size;
+#else
+            char* end = nullptr;
+            value = parse_floating(text, &end, type());
+            return size != 0 && end == text + size;
+#endif
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_integral<type>::value, bool>::type parse_number(const char* text, size_t size, type& value) {
+            return parse_integer(text, size, value);
+        }
+
+        template<class type>
+        typename std::enable_if<std::is_floating_point<type>::value, bool>::type parse_number(const char* text, size_t size, type& value) {
+            return parse_floating(text, size, value);
+        }
+    } // json_format
+
+    template<class type>
+    typename std::enable_if<is_json_number<type>::value>::type read_json(json_pull_reader& is, type& obj);
+
+    inline void read_json(json_pull_reader& is, bool& obj);
+
+    inline void read_json(json_pull_reader& is, char& obj);
+
+    template<class traits, class alloc>
+    void read_json(json_pull_reader& is, std::basic_string<char, traits, alloc>& str);
+
+    template<class type, class alloc>
+    void read_json(json_pull_reader& is, std::vector<type, alloc>& vec);
+
+    template<class type>
+    typename std::enable_if<!std::is_arithmetic<type>::value>::type read_json(json_pull_reader& is, type& obj);
+
+    // Default constructs every field, so that fields missing from the input end up as json_reader_t leaves them.
+    struct json_resetter {
+        template<class field_type>
+        void operator()(field_type& value, const char* key) {
+            value = field_type();
+        }
+    };
+
+    // What a field table entry does with the field: parse the current value into it.
+    struct json_read_binding {
+        typedef json_pull_reader context;
+
+        template<class field_type>
+        static void apply(json_pull_reader& is, field_type& value) {
+            read_json(is, value);
+        }
+    };
+
+    template<class type>
+    typename std::enable_if<is_json_number<type>::value>::type read_json(json_pull_reader& is, type& obj) {
+        char token[json_format::max_number];
+        size_t size;
+        if(is.read_token(token, sizeof(token), size) && !json_format::parse_number(token, size, obj)) {
+            is.fail();
+        }
+    }
+
+    inline void read_json(json_pull_reader& is, bool& obj) {
+        char token[8];
+        size_t size;
+        if(!is.read_token(token, sizeof(token), size)) {
+            return;
+        }
+        if(size == 4 && memcmp(token, "true", 4) == 0) {
+            obj = true;
+        }
+        else if(size == 5 && memcmp(token, "false", 5) == 0) {
+            obj = false;
+        }
+        else {
+            is.fail();
+        }
+    }
+
+    inline void read_json(json_pull_reader& is, char& obj) {
+        std::string& text = is.enter_object();
+        if(is.read_string(text)) {
+            if(text.size() == 1) {
+                obj = text[0];
+            }
+            else {
+                is.fail();
+            }
+        }
+        is.leave_object();
+    }
+
+    template<class traits, class alloc>
+    void read_json(json_pull_reader& is, std::basic_string<char, traits, alloc>& str) {
+        std::string& text = is.enter_object();
+        if(is.read_string(text)) {
+            str.assign(text.data(), text.size());
+        }
+        is.leave_object();
+    }
+
+    template<class type, class alloc>
+    void read_json(json_pull_reader& is, std::vector<type, alloc>& vec) {
+        vec.clear();
+        if(!is.expect('[')) {
+            return;
+        }
+        if(is.peek() == ']') {
+            is.expect(']');
+            return;
+        }
+        do {
+            vec.emplace_back();
+            read_json(is, vec.back());
+        } while(is && is.peek() == ',' && is.expect(','));
+        is.expect(']');
+    }
+
+    template<class type>
+    typename std::enable_if<!std::is_arithmetic<type>::value>::type read_json(json_pull_reader& is, type& obj) {
+        if(!is.expect('{')) {
+            return;
+        }
+        json_resetter reset;
+        reflect_type(reset, obj);
+        typedef reflection::field_table<type, json_read_binding> fields;
+        fields const& table = fields::get();
+        std::string& key = is.enter_object();
+        if(is.peek() != '}') {
+            do {
+                if(!is.read_string(key) || !is.expect(':')) {
+                    break;
+                }
+                const typename fields::info* field = table.find(key.data(), key.size());
+                if(field != nullptr) {
+                    table.apply(*field, is, obj);
+                }
+                else {
+                    is.skip_value();
+                }
+            } while(is && is.peek() == ',' && is.expect(','));
+        }
+        is.leave_object();
+        is.expect('}');
+    }
+
+    // Parses a JSON array one element at a time into the same object, calling f(element) for each.
+    template<class type, class F>
+    bool for_each_json_element(json_pull_reader& is, type& element, F f) {
+        if(!is.expect('[')) {
+            return false;
+        }
+        if(is.peek() == ']') {
+            return is.expect(']');
+        }
+        do {
+            read_json(is, element);
+            if(!is) {
+                return false;
+            }
+            f(element);
+        } while(is.peek() == ',' && is.expect(','));
+        return is.expect(']');
+    }
+
+} // serialization
@@ -0,0 +1,398 @@
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "binary_serialization.h"
+
+namespace serialization
+{
+    /*
+     * Read-only memory mapping of a binary-serialized file. Together with the
+     * views below it gives access to a snapshot without copying it through a
+     * stream: POD fields and arrays of trivially copyable elements are used in
+     * place, reflected structs are only located on open and decoded on first
+     * access. The format writes no padding, so a POD or array that is not
+     * aligned for its type is copied out instead of used in place.
+     */
+    struct mapped_file {
+        explicit mapped_file(const char* path)
+            : data_(nullptr)
+            , size_(0) {
+            int fd = ::open(path, O_RDONLY);
+            if(fd < 0) {
+                throw std::runtime_error(std::string("mapped_file: cannot open ") + path);
+            }
+            struct stat info;
+            if(::fstat(fd, &info) != 0) {
+                ::close(fd);
+                throw std::runtime_error(std::string("mapped_file: cannot stat ") + path);
+            }
+            size_ = static_cast<size_t>(info.st_size);
+            if(size_ != 0) {
+                void* mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if(mapping == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error(std::string("mapped_file: cannot map ") + path);
+                }
+                data_ = static_cast<const char*>(mapping);
+            }
+            ::close(fd);
+        }
+
+        mapped_file(mapped_file&& other)
+            : data_(other.data_)
+            , size_(other.size_) {
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        mapped_file& operator=(mapped_file&& other) {
+            if(this != &other) {
+                unmap();
+                data_ = other.data_;
+                size_ = other.size_;
+                other.data_ = nullptr;
+                other.size_ = 0;
+            }
+            return *this;
+        }
+
+        mapped_file(mapped_file const& other) = delete;
+        mapped_file& operator=(mapped_file const& other) = delete;
+
+        ~mapped_file() {
+            unmap();
+        }
+
+        const char* data() const {
+            return data_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        // The mapping is page aligned, so the reader starts at the strictest alignment.
+        buffer_reader reader() const {
+            return buffer_reader(data_, size_);
+        }
+
+    private:
+        void unmap() {
+            if(data_ != nullptr) {
+                ::munmap(const_cast<char*>(data_), size_);
+                data_ = nullptr;
+            }
+        }
+
+        const char* data_;
+        size_t size_;
+    };
+
+    // Skipping a value: like read(), but only the counts of containers are looked at.
+    template<class type>
+    typename std::enable_if<std::is_pod<type>::value>::type skip(buffer_reader& is, type& obj);
+
+    template<class type>
+    typename std::enable_if<!std::is_pod<type>::value>::type skip(buffer_reader& is, type& obj);
+
+    template<class type, class alloc>
+    void skip(buffer_reader& is, std::vector<type, alloc>& vec);
+
+    template<class type, class traits, class alloc>
+    void skip(buffer_reader& is, std::basic_string<type, traits, alloc>& str);
+
+    struct skipper_t {
+        skipper_t(buffer_reader& is)
+            : stream(is) {
+        }
+
+        template<class field_type>
+        void operator()(field_type& value, const char* key) {
+            skip(stream, value);
+        }
+
+    private:
+        buffer_reader& stream;
+    };
+
+    template<class type>
+    typename std::enable_if<std::is_pod<type>::value>::type skip(buffer_reader& is, type& obj) {
+        is.skip(sizeof(type));
+    }
+
+    template<class type>
+    typename std::enable_if<!std::is_pod<type>::value>::type skip(buffer_reader& is, type& obj) {
+        skipper_t proc(is);
+        reflect_type(proc, obj);
+    }
+
+    template<class type>
+    void skip_elements(buffer_reader& is, uint64_t count, std::true_type) {
+        if(count > is.remaining() / sizeof(type)) {
+            is.fail();
+            return;
+        }
+        is.skip(static_cast<size_t>(count) * sizeof(type));
+    }
+
+    template<class type>
+    void skip_elements(buffer_reader& is, uint64_t count, std::false_type) {
+        type element;
+        for(uint64_t i = 0; i < count && is; ++i) {
+            skip(is, element);
+        }
+    }
+
+    template<class type, class alloc>
+    void skip(buffer_reader& is, std::vector<type, alloc>& vec) {
+        uint64_t size = 0;
+        read(is, size);
+        skip_elements<type>(is, size, std::is_trivially_copyable<type>());
+    }
+
+    template<class type, class traits, class alloc>
+    void skip(buffer_reader& is, std::basic_string<type, traits, alloc>& str) {
+        uint64_t size = 0;
+        read(is, size);
+        skip_elements<type>(is, size, std::true_type());
+    }
+
+    // Claims count elements at the reader's position; fails the reader if they are out of bounds.
+    template<class type>
+    const char* claim(buffer_reader& is, uint64_t count) {
+        const char* at = is.current();
+        if(!is || count > is.remaining() / sizeof(type)) {
+            is.fail();
+            return nullptr;
+        }
+        is.skip(static_cast<size_t>(count) * sizeof(type));
+        return at;
+    }
+
+    // The format has no padding, so a value can be used in place only where it happens to be aligned.
+    template<class type>
+    bool in_place(const char* at) {
+        return reinterpret_cast<uintptr_t>(at) % alignof(type) == 0;
+    }
+
+    // A POD value in place, or a copy of it if it is misaligned.
+    template<class type>
+    struct pod_view {
+        explicit pod_view(buffer_reader& is)
+            : value_(nullptr) {
+            const char* at = claim<type>(is, 1);
+            if(at == nullptr) {
+                return;
+            }
+            if(in_place<type>(at)) {
+                value_ = reinterpret_cast<const type*>(at);
+                return;
+            }
+            copy_.reset(new type());
+            memcpy(copy_.get(), at, sizeof(type));
+            value_ = copy_.get();
+        }
+
+        bool valid() const {
+            return value_ != nullptr;
+        }
+
+        // Whether the value is used in place rather than copied.
+        bool mapped() const {
+            return value_ != nullptr && copy_ == nullptr;
+        }
+
+        const type& operator*() const {
+            return *value_;
+        }
+
+        const type* operator->() const {
+            return value_;
+        }
+
+    private:
+        const type* value_;
+        std::unique_ptr<type> copy_;
+    };
+
+    // A vector or string of trivially copyable elements in place, or a copy of them if they are misaligned.
+    template<class type>
+    struct array_view {
+        explicit array_view(buffer_reader& is)
+            : data_(nullptr)
+            , size_(0) {
+            uint64_t size = 0;
+            read(is, size);
+            const char* at = claim<type>(is, size);
+            if(at == nullptr) {
+                return;
+            }
+            size_ = static_cast<size_t>(size);
+            if(size_ == 0 || in_place<type>(at)) {
+                data_ = reinterpret_cast<const type*>(at);
+                return;
+            }
+            copy_.resize(size_);
+            memcpy(copy_.data(), at, size_ * sizeof(type));
+            data_ = copy_.data();
+        }
+
+        bool valid() const {
+            return data_ != nullptr;
+        }
+
+        // Whether the elements are used in place rather than copied.
+        bool mapped() const {
+            return data_ != nullptr && copy_.empty();
+        }
+
+        const type* data() const {
+            return data_;
+        }
+
+        size_t size() const {
+            return size_;
+        }
+
+        bool empty() const {
+            return size_ == 0;
+        }
+
+        const type& operator[](size_t index) const {
+            return data_[index];
+        }
+
+        const type* begin() const {
+            return data_;
+        }
+
+        const type* end() const {
+            return data_ + size_;
+        }
+
+    private:
+        const type* data_;
+        size_t size_;
+        std::vector<type> copy_;
+    };
+
+    // A reflected struct: located on construction, decoded on first access.
+    template<class type>
+    struct lazy_view {
+        explicit lazy_view(buffer_reader& is)
+            : begin_(is.current())
+            , size_(0) {
+            type probe;
+            skip(is, probe);
+            size_ = is ? static_cast<size_t>(is.current() - begin_) : 0;
+        }
+
+        bool valid() const {
+            return size_ != 0;
+        }
+
+        bool decoded() const {
+            return value_ != nullptr;
+        }
+
+        // Bytes of the encoded value, which are all that decoding touches.
+        size_t encoded_size() const {
+            return size_;
+        }
+
+        const type& operator*() const {
+            if(value_ == nullptr) {
+                value_.reset(new type());
+                buffer_reader is(begin_, size_);
+                read(is, *value_);
+            }
+            return *value_;
+        }
+
+        const type* operator->() const {
+            return &**this;
+        }
+
+    private:
+        const char* begin_;
+        size_t size_;
+        mutable std::unique_ptr<type> value_;
+    };
+
+    template<class value, class enable = void>
+    struct view_of {
+        typedef lazy_view<value> type;
+    };
+
+    template<class type>
+    struct vector_view;
+
+    template<class value>
+    struct view_of<value, typename std::enable_if<std::is_pod<value>::value>::type> {
+        typedef pod_view<value> type;
+    };
+
+    template<class value, class alloc>
+    struct view_of<std::vector<value, alloc>, typename std::enable_if<std::is_trivially_copyable<value>::value>::type> {
+        typedef array_view<value> type;
+    };
+
+    template<class value, class alloc>
+    struct view_of<std::vector<value, alloc>, typename std::enable_if<!std::is_trivially_copyable<value>::value>::type> {
+        typedef vector_view<value> type;
+    };
+
+    template<class value, class traits, class alloc>
+    struct view_of<std::basic_string<value, traits, alloc>> {
+        typedef array_view<value> type;
+    };
+
+    // A vector of other elements: one view per element, so only what is accessed gets decoded.
+    template<class type>
+    struct vector_view {
+        typedef typename view_of<type>::type element_view;
+
+        explicit vector_view(buffer_reader& is) {
+            uint64_t size = 0;
+            read(is, size);
+            for(uint64_t i = 0; i < size && is; ++i) {
+                elements_.emplace_back(is);
+            }
+            if(!is) {
+                elements_.clear();
+            }
+        }
+
+        size_t size() const {
+            return elements_.size();
+        }
+
+        bool empty() const {
+            return elements_.empty();
+        }
+
+        const element_view& operator[](size_t index) const {
+            return elements_[index];
+        }
+
+    private:
+        std::vector<element_view> elements_;
+    };
+
+    // View of the value of the given type at the reader's position; the reader moves past it.
+    template<class type>
+    typename view_of<type>::type view(buffer_reader& is) {
+        return typename view_of<type>::type(is);
+    }
+
+} // serialization
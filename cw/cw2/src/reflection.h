@@ -1,5 +1,11 @@
 #pragma once
 #include <type_traits>
+#include <typeinfo>
+#include <stdexcept>
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <string.h>
 
 namespace reflection
 {
@@ -19,4 +25,204 @@ namespace reflection
     {
         proc(obj, key);
     }
+
+    /*
+     * Field table of a type, derived from its reflect_type() the first time it
+     * is needed: name, offset and type of every field, plus a perfect hash of
+     * the names, so a reader resolves a key to its field with one hash and one
+     * confirming comparison instead of visiting every field.
+     *
+     * binding supplies what a field is used for:
+     *     typedef ... context;
+     *     template<class field_type> static void apply(context&, field_type&);
+     * and every field_info carries apply() instantiated for that field's type.
+     *
+     * Offsets are only meaningful when reflect_type() visits members of the
+     * object itself. If it visits anything else (a pointee, a global), the
+     * table is not in_place() and apply() finds the field by name through
+     * reflect_type() instead.
+     */
+    template<class context>
+    struct field_info
+    {
+        const char* name;
+        size_t name_size;
+        size_t offset;
+        size_t size;
+        const std::type_info* type;
+        void (*apply)(context& ctx, void* field);
+    };
+
+    inline uint32_t field_hash(const char* key, size_t size, uint32_t seed)
+    {
+        uint32_t hash = 2166136261u ^ seed;
+        for(size_t i = 0; i < size; ++i) {
+            hash = (hash ^ static_cast<unsigned char>(key[i])) * 16777619u;
+        }
+        hash ^= hash >> 15;
+        hash *= 0x2c1b3c6du;
+        hash ^= hash >> 12;
+        return hash;
+    }
+
+    template<class type, class binding>
+    struct field_table
+    {
+        typedef typename binding::context context;
+        typedef field_info<context> info;
+
+        static field_table const& get()
+        {
+            static const field_table table;
+            return table;
+        }
+
+        // The field called key, or nullptr.
+        const info* find(const char* key, size_t size) const
+        {
+            uint16_t index = slots_[field_hash(key, size, seed_) & (slots_.size() - 1)];
+            if(index == empty_slot) {
+                return nullptr;
+            }
+            const info& field = fields_[index];
+            return field.name_size == size && memcmp(field.name, key, size) == 0 ? &field : nullptr;
+        }
+
+        // Applies the binding to the given field of obj.
+        void apply(const info& field, context& ctx, type& obj) const
+        {
+            if(in_place_) {
+                field.apply(ctx, reinterpret_cast<char*>(&obj) + field.offset);
+                return;
+            }
+            finder find(field, ctx);
+            reflect_type(find, obj);
+        }
+
+        // Whether every field lies inside the object, so that offsets can be used.
+        bool in_place() const
+        {
+            return in_place_;
+        }
+
+        size_t size() const
+        {
+            return fields_.size();
+        }
+
+        const info& operator[](size_t index) const
+        {
+            return fields_[index];
+        }
+
+    private:
+        static const uint16_t empty_slot = 0xffff;
+
+        struct builder
+        {
+            builder(type& obj, std::vector<info>& fields)
+                : base(reinterpret_cast<char*>(&obj))
+                , fields(fields)
+                , in_place(true)
+            {}
+
+            template<class field_type>
+            static void apply(context& ctx, void* field)
+            {
+                binding::apply(ctx, *static_cast<field_type*>(field));
+            }
+
+            template<class field_type>
+            void operator()(field_type& value, const char* key)
+            {
+                uintptr_t at = reinterpret_cast<uintptr_t>(&value);
+                uintptr_t begin = reinterpret_cast<uintptr_t>(base);
+                bool inside = at >= begin && sizeof(field_type) <= sizeof(type) && at - begin <= sizeof(type) - sizeof(field_type);
+                in_place = in_place && inside;
+                info field = { key, strlen(key), inside ? static_cast<size_t>(at - begin) : 0,
+                    sizeof(field_type), &typeid(field_type), &builder::apply<field_type> };
+                fields.push_back(field);
+            }
+
+            char* base;
+            std::vector<info>& fields;
+            bool in_place;
+        };
+
+        // Applies the binding to the field with the given name, wherever reflect_type() finds it.
+        struct finder
+        {
+            finder(const info& field, context& ctx)
+                : field(field)
+                , ctx(ctx)
+                , found(false)
+            {}
+
+            template<class field_type>
+            void operator()(field_type& value, const char* key)
+            {
+                if(!found && strlen(key) == field.name_size && memcmp(key, field.name, field.name_size) == 0) {
+                    found = true;
+                    binding::apply(ctx, value);
+                }
+            }
+
+            const info& field;
+            context& ctx;
+            bool found;
+        };
+
+        field_table()
+            : seed_(0)
+            , in_place_(true)
+        {
+            type probe;
+            builder build(probe, fields_);
+            reflect_type(build, probe);
+            in_place_ = build.in_place;
+            if(fields_.size() >= empty_slot) {
+                throw std::length_error("reflection::field_table: too many fields");
+            }
+            for(size_t i = 0; i < fields_.size(); ++i) {
+                for(size_t j = 0; j < i; ++j) {
+                    if(fields_[i].name_size == fields_[j].name_size && memcmp(fields_[i].name, fields_[j].name, fields_[i].name_size) == 0) {
+                        throw std::logic_error(std::string("reflection::field_table: duplicate field ") + fields_[i].name);
+                    }
+                }
+            }
+
+            // Twice as many slots as fields, rounded up to a power of two, then a seed without collisions.
+            size_t slot_count = 2;
+            while(slot_count < fields_.size() * 2) {
+                slot_count *= 2;
+            }
+            for(;;) {
+                for(uint32_t seed = 0; seed < 4096; ++seed) {
+                    if(try_seed(seed, slot_count)) {
+                        return;
+                    }
+                }
+                slot_count *= 2;
+            }
+        }
+
+        bool try_seed(uint32_t seed, size_t slot_count)
+        {
+            slots_.assign(slot_count, uint16_t(empty_slot));
+            for(size_t i = 0; i < fields_.size(); ++i) {
+                uint16_t& slot = slots_[field_hash(fields_[i].name, fields_[i].name_size, seed) & (slot_count - 1)];
+                if(slot != empty_slot) {
+                    return false;
+                }
+                slot = static_cast<uint16_t>(i);
+            }
+            seed_ = seed;
+            return true;
+        }
+
+        std::vector<info> fields_;
+        std::vector<uint16_t> slots_;
+        uint32_t seed_;
+        bool in_place_;
+    };
 } // reflection
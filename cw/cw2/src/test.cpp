@@ -3,10 +3,28 @@
 #include <cassert>
 #include <type_traits>
 #include <sstream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <fstream>
+#include <unistd.h>
+#include <limits>
+#include <cstdlib>
+#include <cstddef>
+#include <cstring>
+#include <typeinfo>
+#include <random>
+#include <algorithm>
+#include <stdint.h>
 
 #include "reflection.h"
 #include "binary_serialization.h"
+#include "mapped_file.h"
+#include "compact_serialization.h"
+#include "chunked_serialization.h"
 #include "json_serialization.h"
+#include "json_stream.h"
+#include "json_scan.h"
 
 #define TEST_BIN_SERIALIZATION
 #define TEST_JSON_SERIALIZATION
@@ -88,10 +106,619 @@ void test_binary_not_pod()
 #endif
 }
 
+struct with_containers
+{
+    std::vector<pod_struct> pods;
+    std::vector<not_pod_struct> not_pods;
+    std::vector<std::vector<int>> nested;
+    std::string name;
+};
+
+template<class proc>
+void reflect_type(proc& p, with_containers& wc)
+{
+    using namespace reflection;
+    reflect_field(p, wc.pods, "pods");
+    reflect_field(p, wc.not_pods, "not_pods");
+    reflect_field(p, wc.nested, "nested");
+    reflect_field(p, wc.name, "name");
+}
+
+void test_binary_containers()
+{
+#ifdef TEST_BIN_SERIALIZATION
+    std::stringstream stream;
+    std::ostream &os = stream;
+    std::istream &is = stream;
+
+    with_containers wc;
+    for (int i = 0; i < 1000; ++i)
+    {
+        wc.pods.push_back(pod_struct{ i, i / 2.0 });
+    }
+    wc.not_pods.push_back(not_pod_struct(1, 2.5, { 3, 4.5 }));
+    wc.not_pods.push_back(not_pod_struct(5, 6.5, { 7, 8.5 }));
+    wc.nested = { {}, { 1 }, { 2, 3 } };
+    wc.name = "containers";
+    serialization::write(os, wc);
+    // count + 1000 * pod_struct in one block, no per-element framing
+    assert(stream.str().size() > 8 + 1000 * sizeof(pod_struct));
+
+    with_containers wc_read;
+    wc_read.name = "will be overwritten";
+    serialization::read(is, wc_read);
+
+    assert(wc_read.pods.size() == 1000);
+    assert(wc_read.pods[999].a == 999);
+    assert(wc_read.pods[999].b == 499.5);
+    assert(wc_read.not_pods.size() == 2);
+    assert(wc_read.not_pods[1].a == 5);
+    assert(wc_read.not_pods[1].pod.b == 8.5);
+    assert(wc_read.nested == wc.nested);
+    assert(wc_read.name == "containers");
+#endif
+}
+
+void test_binary_buffer()
+{
+#ifdef TEST_BIN_SERIALIZATION
+    with_containers wc;
+    wc.pods.push_back(pod_struct{ 1, 1.5 });
+    wc.not_pods.push_back(not_pod_struct(2, 2.5, { 3, 3.5 }));
+    wc.nested = { { 4, 5 } };
+    wc.name = "buffer";
+
+    // same bytes as through a stream
+    std::stringstream stream;
+    serialization::write(stream, wc);
+    serialization::buffer_writer writer;
+    serialization::write(writer, wc);
+    assert(writer);
+    assert(std::string(writer.data(), writer.size()) == stream.str());
+
+    serialization::buffer_reader reader(writer.data(), writer.size());
+    with_containers wc_read;
+    serialization::read(reader, wc_read);
+    assert(reader);
+    assert(reader.remaining() == 0);
+    assert(wc_read.pods[0].b == 1.5);
+    assert(wc_read.not_pods[0].pod.a == 3);
+    assert(wc_read.nested == wc.nested);
+    assert(wc_read.name == "buffer");
+
+    // caller supplied buffer which is too small
+    char small[16];
+    serialization::buffer_writer fixed(small, sizeof(small));
+    serialization::write(fixed, wc);
+    assert(!fixed);
+    assert(fixed.size() <= sizeof(small));
+
+    // truncated input
+    serialization::buffer_reader truncated(writer.data(), writer.size() - 1);
+    with_containers wc_truncated;
+    serialization::read(truncated, wc_truncated);
+    assert(!truncated);
+
+    // a corrupt element count fails instead of allocating for it
+    uint64_t huge = uint64_t(1) << 60;
+    serialization::buffer_reader counted(reinterpret_cast<const char*>(&huge), sizeof(huge));
+    std::vector<double> values;
+    serialization::read(counted, values);
+    assert(!counted);
+    std::stringstream corrupt;
+    corrupt.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+    corrupt << "a few bytes";
+    std::string text;
+    serialization::read(corrupt, text);
+    assert(!corrupt);
+    assert(text.size() <= serialization::read_step_bytes);
+    std::stringstream corrupt_nested;
+    corrupt_nested.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+    std::vector<std::vector<int>> nested;
+    serialization::read(corrupt_nested, nested);
+    assert(!corrupt_nested);
+#endif
+}
+
+void test_binary_mapped()
+{
+#ifdef TEST_BIN_SERIALIZATION
+    // pods first: after the 8 byte count they stay 8 byte aligned
+    with_containers wc;
+    for (int i = 0; i < 100; ++i)
+    {
+        wc.pods.push_back(pod_struct{ i, i * 2.0 });
+    }
+    wc.not_pods.push_back(not_pod_struct(1, 2.5, { 3, 4.5 }));
+    wc.not_pods.push_back(not_pod_struct(5, 6.5, { 7, 8.5 }));
+    wc.nested = { { 1 }, { 2, 3 } };
+    wc.name = "mapped";
+
+    char path[] = "/tmp/cw2_mapped_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    close(fd);
+    {
+        std::ofstream file(path, std::ios::binary);
+        serialization::write(file, wc);
+    }
+
+    {
+        serialization::mapped_file file(path);
+        serialization::buffer_reader reader = file.reader();
+
+        auto pods = serialization::view<std::vector<pod_struct>>(reader);
+        assert(pods.valid());
+        assert(pods.size() == 100);
+        assert(pods[99].b == 198.0);
+        // in place, not a copy
+        assert(pods.mapped());
+        assert(reinterpret_cast<const char*>(pods.data()) == file.data() + sizeof(uint64_t));
+
+        auto not_pods = serialization::view<std::vector<not_pod_struct>>(reader);
+        assert(not_pods.size() == 2);
+        assert(!not_pods[0].decoded());
+        assert(not_pods[1]->pod.b == 8.5);
+        assert(not_pods[1].decoded());
+        assert(!not_pods[0].decoded());
+
+        auto nested = serialization::view<std::vector<std::vector<int>>>(reader);
+        assert(nested.size() == 2);
+        assert(nested[1].size() == 2 && nested[1][1] == 3);
+
+        auto name = serialization::view<std::string>(reader);
+        assert(std::string(name.begin(), name.end()) == "mapped");
+        assert(reader);
+        assert(reader.remaining() == 0);
+
+        // the whole struct, decoded on access
+        serialization::buffer_reader again = file.reader();
+        auto whole = serialization::view<with_containers>(again);
+        assert(whole.encoded_size() == file.size());
+        assert(whole->name == "mapped");
+    }
+    unlink(path);
+
+    // misaligned values are copied out, and the reader goes on
+    serialization::buffer_writer writer;
+    char tag = 'x';
+    std::vector<double> values = { 1.0, 2.0 };
+    int32_t count = 7;
+    serialization::write(writer, tag);
+    serialization::write(writer, values);
+    serialization::write(writer, count);
+    serialization::write(writer, values);
+    serialization::buffer_reader reader(writer.data(), writer.size());
+    serialization::view<char>(reader);
+    auto misaligned = serialization::view<std::vector<double>>(reader);
+    assert(misaligned.valid() && !misaligned.mapped());
+    assert(misaligned.size() == 2 && misaligned[1] == 2.0);
+    auto misaligned_pod = serialization::view<int32_t>(reader);
+    assert(misaligned_pod.valid() && !misaligned_pod.mapped());
+    assert(*misaligned_pod == 7);
+    auto after = serialization::view<std::vector<double>>(reader);
+    assert(after.size() == 2 && after[0] == 1.0);
+    assert(reader);
+    assert(reader.remaining() == 0);
+
+    // out of bounds counts are refused
+    serialization::buffer_reader truncated(writer.data() + 1, sizeof(uint64_t) + 1);
+    auto cut = serialization::view<std::vector<char>>(truncated);
+    assert(!cut.valid());
+    assert(!truncated);
+#endif
+}
+
+// a message as first shipped, and as extended later: fields appended, one changed type
+enum class compact_kind : uint8_t { none, small, large = 200 };
+
+struct compact_v1
+{
+    compact_v1()
+        : id(0), delta(0), score(0), kind(compact_kind::none)
+    {}
+
+    int64_t id;
+    int delta;
+    double score;
+    std::string name;
+    compact_kind kind;
+};
+
+template<class proc>
+void reflect_type(proc& p, compact_v1& m)
+{
+    using namespace reflection;
+    reflect_field(p, m.id, "id");
+    reflect_field(p, m.delta, "delta");
+    reflect_field(p, m.score, "score");
+    reflect_field(p, m.name, "name");
+    reflect_field(p, m.kind, "kind");
+}
+
+struct compact_v2
+{
+    compact_v2()
+        : id(0), delta(0), score(0), kind(compact_kind::none), ratio(0)
+    {}
+
+    int64_t id;
+    int delta;
+    std::vector<float> score;
+    std::string name;
+    compact_kind kind;
+    float ratio;
+    std::vector<not_pod_struct> children;
+    pod_struct raw;
+};
+
+template<class proc>
+void reflect_type(proc& p, compact_v2& m)
+{
+    using namespace reflection;
+    reflect_field(p, m.id, "id");
+    reflect_field(p, m.delta, "delta");
+    reflect_field(p, m.score, "score");
+    reflect_field(p, m.name, "name");
+    reflect_field(p, m.kind, "kind");
+    reflect_field(p, m.ratio, "ratio");
+    reflect_field(p, m.children, "children");
+    reflect_field(p, m.raw, "raw");
+}
+
+// POD, but reflected: written field by field all the same
+struct compact_point
+{
+    int x;
+    short y;
+};
+
+template<class proc>
+void reflect_type(proc& p, compact_point& pt)
+{
+    using namespace reflection;
+    reflect_field(p, pt.x, "x");
+    reflect_field(p, pt.y, "y");
+}
+
+struct compact_point3
+{
+    int x;
+    short y;
+    char z;
+};
+
+template<class proc>
+void reflect_type(proc& p, compact_point3& pt)
+{
+    using namespace reflection;
+    reflect_field(p, pt.x, "x");
+    reflect_field(p, pt.y, "y");
+    reflect_field(p, pt.z, "z");
+}
+
+// compact_point3 with its fields reordered and x removed
+struct compact_point_zy
+{
+    char z;
+    short y;
+};
+
+template<class proc>
+void reflect_type(proc& p, compact_point_zy& pt)
+{
+    using namespace reflection;
+    reflect_field(p, pt.z, "z");
+    reflect_field(p, pt.y, "y");
+}
+
+// two names which get the same tag
+struct compact_clash
+{
+    int xi;
+    int fma;
+};
+
+template<class proc>
+void reflect_type(proc& p, compact_clash& c)
+{
+    using namespace reflection;
+    reflect_field(p, c.xi, "xi");
+    reflect_field(p, c.fma, "fma");
+}
+
+template<class type>
+std::string compact_bytes(type value)
+{
+    serialization::buffer_writer writer;
+    serialization::write_compact(writer, value);
+    return std::string(writer.data(), writer.size());
+}
+
+template<class type>
+type compact_round_trip(type value)
+{
+    std::string bytes = compact_bytes(value);
+    serialization::buffer_reader reader(bytes.data(), bytes.size());
+    type result = type();
+    serialization::read_compact(reader, result);
+    assert(reader);
+    assert(reader.remaining() == 0);
+    return result;
+}
+
+void test_binary_compact()
+{
+#ifdef TEST_BIN_SERIALIZATION
+    // varints: small magnitudes take a byte whatever the sign, zig-zag for signed types
+    assert(compact_bytes(0) == std::string(1, '\0'));
+    assert(compact_bytes(-1) == "\x01");
+    assert(compact_bytes(1) == "\x02");
+    assert(compact_bytes(63u) == "\x3f");
+    assert(compact_bytes(300u) == "\xac\x02");
+    assert(compact_bytes(std::numeric_limits<uint64_t>::max()).size() == 10);
+    assert(compact_bytes(1.0) == std::string("\0\0\0\0\0\0\xf0\x3f", 8));
+    assert(compact_round_trip(std::numeric_limits<int64_t>::min()) == std::numeric_limits<int64_t>::min());
+    assert(compact_round_trip(std::numeric_limits<int64_t>::max()) == std::numeric_limits<int64_t>::max());
+    assert(compact_round_trip(std::numeric_limits<int8_t>::min()) == std::numeric_limits<int8_t>::min());
+    assert(compact_round_trip(std::numeric_limits<uint32_t>::max()) == std::numeric_limits<uint32_t>::max());
+    assert(compact_round_trip(compact_kind::large) == compact_kind::large);
+    assert(compact_round_trip(-2.5f) == -2.5f);
+    assert(std::signbit(compact_round_trip(-0.0)));
+    assert(compact_round_trip(true));
+    // char and wchar_t are encoded the same whether the platform makes them signed or not
+    assert(compact_bytes(char(-1)) == "\xff\x01");
+    assert(compact_round_trip(char(-1)) == char(-1));
+    assert(compact_bytes(wchar_t(0x20ac)) == "\xac\x41");
+    assert(compact_round_trip(wchar_t(0x20ac)) == wchar_t(0x20ac));
+
+    // reflected types, nested and in containers; raw POD types keep their bytes
+    with_containers wc;
+    for (int i = 0; i < 10; ++i)
+    {
+        wc.pods.push_back(pod_struct{ i, i / 2.0 });
+    }
+    wc.not_pods.push_back(not_pod_struct(1, 2.5, { 3, 4.5 }));
+    wc.not_pods.push_back(not_pod_struct(-5, 0, { 0, 0 }));
+    wc.nested = { {}, { 1 }, { -2, 300 } };
+    wc.name = "compact";
+    with_containers wc_read = compact_round_trip(wc);
+    assert(wc_read.pods.size() == 10 && wc_read.pods[9].a == 9 && wc_read.pods[9].b == 4.5);
+    assert(wc_read.not_pods.size() == 2);
+    assert(wc_read.not_pods[0].b == 2.5 && wc_read.not_pods[0].pod.b == 4.5);
+    assert(wc_read.not_pods[1].a == -5 && wc_read.not_pods[1].b == 0);
+    assert(wc_read.nested == wc.nested);
+    assert(wc_read.name == "compact");
+
+    // POD types with reflect_type() are tagged too: fields added and removed
+    compact_point3 p3{ 1, -2, 'c' };
+    compact_point p2 = compact_round_trip(compact_point{ 7, 8 });
+    assert(p2.x == 7 && p2.y == 8);
+    assert(compact_bytes(p2).size() == 9);
+    std::string bytes = compact_bytes(p3);
+    serialization::buffer_reader shorter(bytes.data(), bytes.size());
+    serialization::read_compact(shorter, p2);
+    assert(shorter && shorter.remaining() == 0);
+    assert(p2.x == 1 && p2.y == -2);
+    bytes = compact_bytes(compact_point{ 3, 4 });
+    serialization::buffer_reader longer(bytes.data(), bytes.size());
+    serialization::read_compact(longer, p3);
+    assert(longer && longer.remaining() == 0);
+    assert(p3.x == 3 && p3.y == 4 && p3.z == 0);
+
+    // fields out of order: y = -2, then x = 1
+    assert(serialization::compact::tag_of("x") == 36811 && serialization::compact::tag_of("y") == 36344);
+    bytes = std::string("\xc0\xdf\x11\x03\xd8\xfc\x11\x02", 8) + '\0';
+    serialization::buffer_reader unordered(bytes.data(), bytes.size());
+    serialization::read_compact(unordered, p2);
+    assert(unordered && unordered.remaining() == 0);
+    assert(p2.x == 1 && p2.y == -2);
+
+    // tags follow the names, so fields can be reordered and removed
+    bytes = compact_bytes(compact_point3{ 5, -6, 'q' });
+    serialization::buffer_reader reordered(bytes.data(), bytes.size());
+    compact_point_zy zy{ 0, 0 };
+    serialization::read_compact(reordered, zy);
+    assert(reordered && reordered.remaining() == 0);
+    assert(zy.z == 'q' && zy.y == -6);
+    bytes = compact_bytes(compact_point_zy{ 'r', 9 });
+    serialization::buffer_reader restored(bytes.data(), bytes.size());
+    serialization::read_compact(restored, p3);
+    assert(restored && restored.remaining() == 0);
+    assert(p3.x == 0 && p3.y == 9 && p3.z == 'r');
+
+    // names with the same tag are refused
+    bool refused = false;
+    try
+    {
+        compact_bytes(compact_clash{ 1, 2 });
+    }
+    catch (std::logic_error const&)
+    {
+        refused = true;
+    }
+    assert(refused);
+
+    // default values are left out
+    compact_v1 first;
+    assert(compact_bytes(first) == std::string(1, '\0'));
+    first.id = -1234567890123;
+    first.delta = -3;
+    first.score = 0.75;
+    first.name = "first";
+    first.kind = compact_kind::large;
+    compact_v1 first_read = compact_round_trip(first);
+    assert(first_read.id == first.id && first_read.delta == -3 && first_read.score == 0.75);
+    assert(first_read.name == "first" && first_read.kind == compact_kind::large);
+
+    // an old message read as the new one: score changed type and is dropped, new fields are defaults
+    bytes = compact_bytes(first);
+    serialization::buffer_reader old_reader(bytes.data(), bytes.size());
+    compact_v2 second;
+    second.ratio = 1;
+    second.score = { 1, 2 };
+    serialization::read_compact(old_reader, second);
+    assert(old_reader && old_reader.remaining() == 0);
+    assert(second.id == first.id && second.delta == -3 && second.name == "first" && second.kind == compact_kind::large);
+    assert(second.score.empty() && second.ratio == 0 && second.children.empty());
+
+    // a new message read as the old one: unknown tags are skipped, nested groups included
+    second.score = { 0.5f, -1.5f };
+    second.ratio = 0.25f;
+    second.children = wc.not_pods;
+    second.raw = pod_struct{ 9, 9.5 };
+    compact_v2 second_read = compact_round_trip(second);
+    assert(second_read.score == second.score && second_read.ratio == 0.25f);
+    assert(second_read.children.size() == 2 && second_read.children[0].pod.b == 4.5);
+    assert(second_read.raw.a == 9 && second_read.raw.b == 9.5);
+    bytes = compact_bytes(second);
+    serialization::buffer_reader new_reader(bytes.data(), bytes.size());
+    serialization::read_compact(new_reader, first_read);
+    assert(new_reader && new_reader.remaining() == 0);
+    assert(first_read.id == first.id && first_read.score == 0 && first_read.name == "first");
+
+    // streams give the same bytes
+    std::stringstream stream;
+    serialization::write_compact(stream, second);
+    assert(stream.str() == bytes);
+    compact_v2 streamed;
+    serialization::read_compact(stream, streamed);
+    assert(stream);
+    assert(streamed.children.size() == 2 && streamed.raw.b == 9.5 && streamed.score == second.score);
+
+    // a stream cannot bound a length up front, so what a corrupt one allocates is bounded instead
+    std::stringstream huge_string(std::string("\x80\x80\x80\x80\x80\x20" "abc"));
+    std::string text;
+    serialization::read_compact(huge_string, text);
+    assert(!huge_string && text.size() <= serialization::read_step_bytes);
+    std::stringstream huge_vector(std::string("\x80\x80\x80\x80\x80\x80\x02" "\x01\x02"));
+    std::vector<int> numbers;
+    serialization::read_compact(huge_vector, numbers);
+    assert(!huge_vector && numbers.size() <= serialization::read_step_bytes / sizeof(int));
+
+    // every truncation fails the reader, and no input makes it read out of bounds
+    for (size_t size = 0; size < bytes.size(); ++size)
+    {
+        serialization::buffer_reader truncated(bytes.data(), size);
+        compact_v2 partial;
+        serialization::read_compact(truncated, partial);
+        assert(!truncated);
+    }
+    std::mt19937 random(19);
+    for (int round = 0; round < 2000; ++round)
+    {
+        std::string noise = bytes;
+        for (int flips = 0; flips < 4; ++flips)
+        {
+            noise[random() % noise.size()] = char(random());
+        }
+        serialization::buffer_reader reader(noise.data(), noise.size());
+        compact_v2 garbage;
+        serialization::read_compact(reader, garbage);
+    }
+#endif
+}
+
+void test_binary_chunked()
+{
+#ifdef TEST_BIN_SERIALIZATION
+    std::vector<not_pod_struct> objects;
+    for (int i = 0; i < 10001; ++i)
+    {
+        objects.push_back(not_pod_struct(i, i / 4.0, { -i, i * 2.0 }));
+    }
+
+    // the same bytes whatever the number of threads, and through a stream
+    serialization::buffer_writer writer;
+    serialization::write_chunked(writer, objects, 1000, 4);
+    assert(writer);
+    serialization::buffer_writer single;
+    serialization::write_chunked(single, objects, 1000, 1);
+    assert(std::string(writer.data(), writer.size()) == std::string(single.data(), single.size()));
+    std::stringstream stream;
+    serialization::write_chunked(stream, objects, 1000);
+    assert(stream.str() == std::string(writer.data(), writer.size()));
+
+    for (unsigned threads = 1; threads <= 4; threads *= 2)
+    {
+        serialization::buffer_reader reader(writer.data(), writer.size());
+        std::vector<not_pod_struct> result;
+        serialization::read_chunked(reader, result, threads);
+        assert(reader);
+        assert(reader.remaining() == 0);
+        assert(result.size() == objects.size());
+        for (size_t i = 0; i < result.size(); ++i)
+        {
+            assert(result[i].a == objects[i].a && result[i].b == objects[i].b && result[i].pod.b == objects[i].pod.b);
+        }
+    }
+
+    // one chunk, found through the index; the last one is short
+    serialization::buffer_reader reader(writer.data(), writer.size());
+    serialization::chunk_index index(reader);
+    assert(index.valid() && reader.remaining() == 0);
+    assert(index.size() == 11 && index.elements() == 10001);
+    assert(index[7].first == 7000 && index[7].count == 1000);
+    assert(index[10].first == 10000 && index[10].count == 1);
+    std::vector<not_pod_struct> chunk;
+    assert(serialization::read_chunk(index, 7, chunk));
+    assert(chunk.size() == 1000 && chunk[0].a == 7000 && chunk[999].pod.a == -7999);
+
+    // trivially copyable elements and an empty vector
+    std::vector<pod_struct> pods(2500);
+    for (size_t i = 0; i < pods.size(); ++i)
+    {
+        pods[i] = pod_struct{ int(i), i * 1.5 };
+    }
+    serialization::buffer_writer pod_writer;
+    serialization::write_chunked(pod_writer, pods, 1024, 3);
+    std::vector<pod_struct> empty;
+    serialization::write_chunked(pod_writer, empty);
+    serialization::buffer_reader pod_reader(pod_writer.data(), pod_writer.size());
+    std::vector<pod_struct> pods_read, empty_read(3);
+    serialization::read_chunked(pod_reader, pods_read, 2);
+    serialization::read_chunked(pod_reader, empty_read);
+    assert(pod_reader && pod_reader.remaining() == 0);
+    assert(pods_read.size() == 2500 && pods_read[2499].b == 2499 * 1.5);
+    assert(empty_read.empty());
+
+    // truncated input
+    for (size_t size : { size_t(0), size_t(20), writer.size() / 2, writer.size() - 1 })
+    {
+        serialization::buffer_reader truncated(writer.data(), size);
+        std::vector<not_pod_struct> partial;
+        serialization::read_chunked(truncated, partial);
+        assert(!truncated);
+    }
+
+    // counts that the chunk sizes cannot hold are refused before anything is allocated
+    serialization::buffer_writer corrupt;
+    uint64_t header[4] = { uint64_t(1) << 40, 1, uint64_t(1) << 40, 32 };
+    serialization::write(corrupt, header);
+    std::string payload(32, '\0');
+    serialization::write_bytes(corrupt, payload.data(), payload.size());
+    serialization::buffer_reader corrupt_reader(corrupt.data(), corrupt.size());
+    serialization::chunk_index corrupt_index(corrupt_reader);
+    assert(corrupt_index.valid());
+    std::vector<pod_struct> pod_chunk;
+    assert(!serialization::read_chunk(corrupt_index, 0, pod_chunk) && pod_chunk.empty());
+    std::vector<not_pod_struct> object_chunk;
+    assert(!serialization::read_chunk(corrupt_index, 0, object_chunk) && object_chunk.empty());
+    serialization::buffer_reader corrupt_whole(corrupt.data(), corrupt.size());
+    serialization::read_chunked(corrupt_whole, pods_read);
+    assert(!corrupt_whole);
+#endif
+}
+
 void test_binary_serialization()
 {
     test_binary_pod();
     test_binary_not_pod();
+    test_binary_containers();
+    test_binary_buffer();
+    test_binary_mapped();
+    test_binary_compact();
+    test_binary_chunked();
 }
 
 // === json serialization tests ===
@@ -229,12 +856,432 @@ void test_json_field_added()
 #endif
 }
 
+template<class type>
+std::string json_number(type value)
+{
+    serialization::buffer_writer writer;
+    serialization::write_json(writer, value);
+    return std::string(writer.data(), writer.size());
+}
+
+void test_json_stream_numbers()
+{
+#ifdef TEST_JSON_SERIALIZATION
+    assert(json_number(0) == "0");
+    assert(json_number(-7) == "-7");
+    assert(json_number(1234567) == "1234567");
+    assert(json_number(99) == "99");
+    assert(json_number(-1999) == "-1999");
+    assert(json_number(std::numeric_limits<int64_t>::min()) == "-9223372036854775808");
+    assert(json_number(std::numeric_limits<uint64_t>::max()) == "18446744073709551615");
+    assert(json_number(static_cast<unsigned char>(200)) == "200");
+    assert(json_number(0.5) == "0.5");
+    assert(json_number(0.1) == "0.1");
+    assert(json_number(100.0) == "100");
+    assert(json_number(0.25f) == "0.25");
+    assert(json_number(std::numeric_limits<double>::quiet_NaN()) == "null");
+    assert(json_number(std::numeric_limits<double>::infinity()) == "null");
+
+    // shortest text which reads back as the same value
+    double values[] = { 1.0 / 3, 2.0 / 3, 1e300, 5e-324, 123456.789, -0.0 };
+    for (double value : values)
+    {
+        std::string text = json_number(value);
+        assert(std::strtod(text.c_str(), nullptr) == value);
+        assert(text.size() <= 24);
+    }
+    float third = 1.0f / 3;
+    assert(std::strtof(json_number(third).c_str(), nullptr) == third);
+
+    // every two-digit pair, in every position
+    for (int value = -100000; value <= 100000; ++value)
+    {
+        assert(json_number(value) == std::to_string(value));
+    }
+    assert(json_number(99999999u) == "99999999");
+    assert(json_number(uint64_t(9999999999999999999u)) == "9999999999999999999");
+    assert(json_number(int64_t(-990990990990990990)) == "-990990990990990990");
+#endif
+}
+
+struct json_stream_record
+{
+    std::string text;
+    std::vector<int> values;
+    custom_record custom;
+};
+
+template<class proc>
+void reflect_type(proc& p, json_stream_record& r)
+{
+    using namespace reflection;
+    reflect_field(p, r.text, "text");
+    reflect_field(p, r.values, "values");
+    reflect_field(p, r.custom, "custom");
+}
+
+void test_json_stream_struct()
+{
+#ifdef TEST_JSON_SERIALIZATION
+    json_stream_record r;
+    r.text = "a \"quoted\"\\ line\n\x01";
+    r.values = { 1, -2, 3 };
+    r.custom.dvalue = 2.5;
+    r.custom.ivalue = -42;
+    r.custom.small.letter = 'q';
+    r.custom.small.flag = true;
+
+    const char* expected = "{\"text\":\"a \\\"quoted\\\"\\\\ line\\n\\u0001\","
+        "\"values\":[1,-2,3],"
+        "\"custom\":{\"dvalue\":2.5,\"ivalue\":-42,\"small\":{\"letter\":\"q\",\"flag\":true}}}";
+
+    serialization::buffer_writer writer;
+    serialization::write_json(writer, r);
+    assert(std::string(writer.data(), writer.size()) == expected);
+
+    std::stringstream stream;
+    serialization::write_json(stream, r);
+    assert(stream.str() == expected);
+#endif
+}
+
+// parses with and without the structural index, which have to agree
+template<class type>
+bool json_parse(std::string const& text, type& value)
+{
+    type unindexed;
+    serialization::json_pull_reader plain(text.data(), text.size());
+    serialization::read_json(plain, unindexed);
+
+    serialization::json_pull_reader reader(text.data(), text.size(), true);
+    serialization::read_json(reader, value);
+    assert(static_cast<bool>(plain) == static_cast<bool>(reader));
+    return static_cast<bool>(reader);
+}
+
+// byte at a time model of json_scanner
+static std::vector<uint32_t> reference_index(std::string const& text, bool& error)
+{
+    std::vector<uint32_t> index;
+    bool in_string = false, escaped = false, in_scalar = false;
+    error = false;
+    for (size_t i = 0; i < text.size(); ++i)
+    {
+        char c = text[i];
+        bool is_escaped = escaped;
+        escaped = c == '\\' && !is_escaped;
+        if (in_string)
+        {
+            if (c == '"' && !is_escaped)
+            {
+                in_string = false;
+                index.push_back(i);
+            }
+            else if (static_cast<unsigned char>(c) < 0x20)
+            {
+                error = true;
+            }
+            continue;
+        }
+        if (c == '"' && !is_escaped)
+        {
+            in_string = true;
+            in_scalar = false;
+            index.push_back(i);
+        }
+        else if (std::strchr("{}[]:,", c) != nullptr && c != 0)
+        {
+            in_scalar = false;
+            index.push_back(i);
+        }
+        else if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            in_scalar = false;
+        }
+        else
+        {
+            if (!in_scalar)
+            {
+                index.push_back(i);
+            }
+            in_scalar = true;
+        }
+    }
+    error = error || in_string;
+    return index;
+}
+
+void test_json_scanner()
+{
+#ifdef TEST_JSON_SERIALIZATION
+    using namespace serialization;
+    std::string text = "{\"a\\\"]\": [1, true, \"x\"],\"b\":-2.5e3}";
+    std::vector<uint32_t> index(text.size() + 64);
+    json_scanner scanner;
+    index.resize(scanner.scan(text.data(), text.size(), index.data()));
+    assert(!scanner.error());
+    // {  "  "  :  [  1  ,  true  ,  "  "  ]  ,  "  "  :  -2.5e3  }
+    uint32_t expected[] = { 0, 1, 6, 7, 9, 10, 11, 13, 17, 19, 21, 22, 23, 24, 26, 27, 28, 34 };
+    assert(index == std::vector<uint32_t>(expected, expected + sizeof(expected) / sizeof(expected[0])));
+
+    json_scan::kernel kernels[] = { json_scan::scalar_kernel, json_scan::sse2_kernel, json_scan::avx2_kernel };
+    const char alphabet[] = "{}[]:,\"\"\\\\ \t\nab1\x01";
+    std::mt19937 random(12345);
+    for (int round = 0; round < 2000; ++round)
+    {
+        std::string input(random() % 400, ' ');
+        for (auto& c : input)
+        {
+            c = alphabet[random() % (sizeof(alphabet) - 1)];
+            if (random() % 4 == 0)
+            {
+                c = 'z';
+            }
+        }
+        bool expected_error;
+        std::vector<uint32_t> expected_index = reference_index(input, expected_error);
+        for (auto k : kernels)
+        {
+            if (!json_scan::supported(k))
+            {
+                continue;
+            }
+            // in pieces, so state carries over between calls
+            json_scanner pieces(k);
+            std::vector<uint32_t> result;
+            size_t offset = 0;
+            while (offset < input.size())
+            {
+                size_t size = std::min(input.size() - offset, size_t(64) * (1 + random() % 3));
+                std::vector<uint32_t> piece(size + 64);
+                piece.resize(pieces.scan(input.data() + offset, size, piece.data()));
+                for (uint32_t position : piece)
+                {
+                    result.push_back(position + offset);
+                }
+                offset += size;
+            }
+            if (input.size() % 64 == 0)
+            {
+                pieces.finish();
+            }
+            assert(result == expected_index);
+            assert(pieces.error() == expected_error);
+        }
+    }
+#endif
+}
+
+void test_json_pull_values()
+{
+#ifdef TEST_JSON_SERIALIZATION
+    int i = 0;
+    assert(json_parse(" -42 ", i) && i == -42);
+    assert(!json_parse("2147483648", i));
+    assert(!json_parse("1.5", i));
+    int64_t big = 0;
+    assert(json_parse("-9223372036854775808", big) && big == std::numeric_limits<int64_t>::min());
+    uint64_t ubig = 0;
+    assert(json_parse("18446744073709551615", ubig) && ubig == std::numeric_limits<uint64_t>::max());
+    assert(!json_parse("18446744073709551616", ubig));
+    assert(!json_parse("-1", ubig));
+    double d = 0;
+    assert(json_parse("2.5e-3", d) && d == 2.5e-3);
+    assert(json_parse("null", d) && d != d);
+    assert(!json_parse("1.5x", d));
+    bool b = false;
+    assert(json_parse("true", b) && b);
+    assert(!json_parse("yes", b));
+    std::string text;
+    assert(json_parse("\"a\\\"b\\n\\u00e9\\ud83d\\ude00\"", text));
+    assert(text == "a\"b\n\xc3\xa9\xf0\x9f\x98\x80");
+    assert(!json_parse("\"unterminated", text));
+    assert(!json_parse("\"\\ud83d\"", text));
+    std::vector<std::vector<int>> nested;
+    assert(json_parse("[[1,2],[],[3]]", nested));
+    assert(nested.size() == 3 && nested[0][1] == 2 && nested[1].empty() && nested[2][0] == 3);
+    assert(!json_parse("[1,2", nested));
+#endif
+}
+
+void test_json_pull_struct()
+{
+#ifdef TEST_JSON_SERIALIZATION
+    json_stream_record r;
+    r.text = "text \"with\" escapes\n";
+    r.values = { 1, -2, 3 };
+    r.custom.dvalue = 1.0 / 3;
+    r.custom.ivalue = -42;
+    r.custom.small.letter = 'q';
+    r.custom.small.flag = true;
+
+    // round trip through json_writer
+    serialization::buffer_writer writer;
+    serialization::write_json(writer, r);
+    std::string json(writer.data(), writer.size());
+    json_stream_record r_read;
+    assert(json_parse(json, r_read));
+    assert(r_read.text == r.text);
+    assert(r_read.values == r.values);
+    assert(r_read.custom.dvalue == r.custom.dvalue);
+    assert(r_read.custom.ivalue == -42);
+    assert(r_read.custom.small.letter == 'q');
+    assert(r_read.custom.small.flag);
+
+    // the same from a stream through a window smaller than any token
+    std::stringstream stream(json);
+    serialization::json_pull_reader windowed(stream, 3);
+    json_stream_record r_windowed;
+    serialization::read_json(windowed, r_windowed);
+    assert(windowed);
+    assert(r_windowed.text == r.text);
+    assert(r_windowed.custom.dvalue == r.custom.dvalue);
+
+    // any order, unknown keys skipped, missing fields default constructed
+    custom_record cr;
+    cr.ivalue = 7;
+    assert(json_parse("{ \"small\": { \"flag\": true, \"extra\": [1, {\"a\": \"}\"}] },"
+                "\"unknown\": {\"x\": [null, false]},\n \"dvalue\": 2.5 }", cr));
+    assert(cr.dvalue == 2.5);
+    assert(cr.ivalue == 0);
+    assert(cr.small.flag);
+    assert(cr.small.letter == 0);
+
+    // an array parsed one element at a time
+    std::vector<int> seen;
+    small_record element;
+    std::string array = "[{\"letter\":\"a\"},{\"letter\":\"b\",\"flag\":true}]";
+    serialization::json_pull_reader reader(array.data(), array.size(), true);
+    assert(serialization::for_each_json_element(reader, element, [&](small_record const& e) {
+        seen.push_back(e.letter + (e.flag ? 100 : 0));
+    }));
+    assert(seen.size() == 2 && seen[0] == 'a' && seen[1] == 'b' + 100);
+
+    // several index chunks, strings across chunk boundaries
+    std::vector<json_stream_record> many(2000, r);
+    for (size_t i = 0; i < many.size(); ++i)
+    {
+        many[i].text = std::string(i % 97, 'x') + (i % 3 == 0 ? "\\\"" : "");
+        many[i].custom.ivalue = int(i);
+    }
+    serialization::buffer_writer big;
+    serialization::write_json(big, many);
+    assert(big.size() > 3 * (1 << 16));
+    std::vector<json_stream_record> many_read;
+    assert(json_parse(std::string(big.data(), big.size()), many_read));
+    assert(many_read.size() == many.size());
+    assert(many_read[1999].text == many[1999].text);
+    assert(many_read[1998].custom.ivalue == 1998);
+
+    std::vector<small_record> skipped;
+    assert(json_parse("[{\"unknown\": [{\"deep\": \"]}\\\"\"}, 1], \"flag\": true}]", skipped));
+    assert(skipped.size() == 1 && skipped[0].flag);
+
+    assert(!json_parse("{\"dvalue\" 1}", cr));
+    assert(!json_parse("{\"dvalue\": 1,}", cr));
+#endif
+}
+
+// a binding which records what it was applied to
+struct field_probe
+{
+    typedef field_probe context;
+
+    template<class field_type>
+    static void apply(field_probe& probe, field_type& value)
+    {
+        probe.address = &value;
+        probe.size = sizeof(field_type);
+    }
+
+    void* address;
+    size_t size;
+};
+
+// reflects a field which lives outside the object
+struct boxed_record
+{
+    boxed_record()
+        : value(0)
+        , box(new int(0))
+    {}
+
+    boxed_record(boxed_record const& other)
+        : value(other.value)
+        , box(new int(*other.box))
+    {}
+
+    double value;
+    std::unique_ptr<int> box;
+};
+
+template<class proc>
+void reflect_type(proc& p, boxed_record& br)
+{
+    using namespace reflection;
+    reflect_field(p, br.value, "value");
+    reflect_field(p, *br.box, "box");
+}
+
+void test_field_table()
+{
+#ifdef TEST_JSON_SERIALIZATION
+    typedef reflection::field_table<custom_record, field_probe> table_type;
+    table_type const& table = table_type::get();
+    assert(&table == &table_type::get());
+    assert(table.size() == 3);
+    assert(std::string(table[0].name) == "dvalue");
+    assert(table[1].offset == offsetof(custom_record, ivalue));
+    assert(*table[2].type == typeid(small_record));
+
+    custom_record cr;
+    const char* names[] = { "dvalue", "ivalue", "small" };
+    void* addresses[] = { &cr.dvalue, &cr.ivalue, &cr.small };
+    for (int i = 0; i < 3; ++i)
+    {
+        auto field = table.find(names[i], strlen(names[i]));
+        assert(field == &table[i]);
+        field_probe probe = { nullptr, 0 };
+        table.apply(*field, probe, cr);
+        assert(probe.address == addresses[i]);
+        assert(probe.size == table[i].size);
+    }
+    assert(table.find("dvalu", 5) == nullptr);
+    assert(table.find("dvaluee", 7) == nullptr);
+    assert(table.find("", 0) == nullptr);
+
+    typedef reflection::field_table<json_stream_record, field_probe> record_table;
+    assert(record_table::get().find("values", 6) == &record_table::get()[1]);
+    assert(table.in_place());
+
+    // a field outside the probe object has no usable offset, so it is found by name
+    typedef reflection::field_table<boxed_record, field_probe> boxed_table;
+    boxed_table const& boxed = boxed_table::get();
+    assert(!boxed.in_place());
+    boxed_record br;
+    field_probe probe = { nullptr, 0 };
+    boxed.apply(*boxed.find("box", 3), probe, br);
+    assert(probe.address == br.box.get() && probe.size == sizeof(int));
+    boxed.apply(*boxed.find("value", 5), probe, br);
+    assert(probe.address == &br.value);
+
+    assert(json_parse("{\"box\": 7, \"value\": 1.5}", br));
+    assert(*br.box == 7 && br.value == 1.5);
+#endif
+}
+
 void test_json_serialization()
 {
+    test_field_table();
     test_json_arithmetic();
     test_json_struct();
     test_json_field_added();
     test_json_field_removed();
+    test_json_stream_numbers();
+    test_json_stream_struct();
+    test_json_scanner();
+    test_json_pull_values();
+    test_json_pull_struct();
 }
 
 int main()
@@ -1,21 +1,54 @@
-#include <vector>
-#include <list>
+#pragma once
+#include <sys/mman.h>
+#include <stdint.h>
 #include <stdexcept>
+#include <chrono>
 #include <cassert>
+#include <new>
+#include <utility>
 const size_t OS_ALLOC_SIZE = 4096;
 
+/*
+ * Blocks come from slabs of slab_size bytes (a power of two, at least
+ * OS_ALLOC_SIZE), mapped with mmap and aligned to their size, so the slab
+ * header holding the free list and live count of the slab is found from
+ * any of its blocks. A slab whose blocks are all free leaves its class,
+ * unless it is the only one with free blocks, and is kept for reuse by any
+ * class. Empty slabs beyond the retained count are unmapped once they have
+ * stayed empty for the decay time; trim() unmaps all of them at once.
+ */
 struct au_allocator {
-    explicit au_allocator(size_t max_order = 7);
+    explicit au_allocator(size_t max_order = 7, size_t slab_size = DEFAULT_SLAB_SIZE);
     ~au_allocator();
     void* allocate(size_t size);
     void deallocate(void* ptr, size_t size);
 
+    // Unmaps the empty slabs; returns the bytes given back.
+    size_t trim();
+
+    // Empty slabs beyond retained are unmapped after staying empty for delay.
+    void set_decay(std::chrono::milliseconds delay, size_t retained = RETAINED_SLABS);
+
+    // Bytes in mapped slabs.
+    size_t mapped_bytes() const {
+        return slab_count_ * slab_size_;
+    }
+
+    static const size_t DEFAULT_SLAB_SIZE = 16 * OS_ALLOC_SIZE;
+    static const size_t HUGE_PAGE_SIZE = size_t(1) << 21;
+    static const size_t RETAINED_SLABS = 4;
+
     template<typename T, typename... ARGS>
     T* allocate(ARGS&&... args);
 
     template<typename T>
     void deallocate(T* const ptr);
 
+    // Bytes of the block that serves a request of size, up to 2^max_order.
+    static size_t block_size(size_t size) {
+        return class_size(size_class(size));
+    }
+
 #ifndef NDEBUG
     static void get_order_test() {
         assert(get_order(1) == 0);
@@ -24,33 +57,128 @@ struct au_allocator {
         assert(get_order(4) == 2);
         assert(get_order(5) == 3);
     }
+
+    static void size_class_test() {
+        size_t expected[] = { 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256 };
+        for(size_t i = 0; i < sizeof(expected) / sizeof(expected[0]); ++i) {
+            assert(class_size(i) == expected[i]);
+            assert(size_class(expected[i]) == i);
+            assert(size_class(expected[i] - (i == 0 ? 7 : expected[i] - expected[i - 1] - 1)) == i);
+        }
+        assert(size_class(0) == 0);
+        assert(size_class(OS_ALLOC_SIZE) == CLASS_COUNT - 1);
+        for(size_t size = 1; size <= OS_ALLOC_SIZE; ++size) {
+            assert(block_size(size) >= size);
+            assert(size <= 8 || block_size(size - 1) <= block_size(size));
+        }
+    }
 #endif
 
 private:
+    friend struct au_concurrent_allocator;
+
+    // A free block holds the link to the next free block of its size class.
+    struct free_block {
+        free_block* next;
+    };
+
+    /*
+     * Size classes: 8, 16, 24 and 32 bytes, then four per power of two,
+     * a quarter of it apart (40, 48, 56, 64, 80, 96, ...), so a block is
+     * at most 25% larger than the request above 32 bytes. A class size is a
+     * multiple of the alignment of any type whose size falls in it, and the
+     * blocks of a slab sit at multiples of it from the slab start.
+     */
+    static const size_t SMALL_CLASSES = 4;
+    static const size_t SMALL_LIMIT = 32;
+    static const size_t CLASS_COUNT = SMALL_CLASSES + 4 * (12 - 5);  // up to 2^12 == OS_ALLOC_SIZE
+    static_assert(sizeof(free_block) <= 8, "free_block does not fit the smallest block");
+    static const size_t SLAB_HEADER = 64;
+    static const int64_t DECAY_MS = 1000;
+    static_assert(OS_ALLOC_SIZE == size_t(1) << 12, "CLASS_COUNT assumes 4 KB buffers");
 
     static size_t get_order(size_t size) {
-        auto res = static_cast<size_t>(log2(size));
-        if(size != pow(2, res)) {
-            ++res;
-        }
+        return size <= 1 ? 0 : 64 - __builtin_clzll(static_cast<unsigned long long>(size - 1));
+    }
 
-        return res;
+    static size_t size_class(size_t size) {
+        if(size <= SMALL_LIMIT) {
+            return size <= 8 ? 0 : (size - 1) >> 3;
+        }
+        // size in (2^(order-1), 2^order], in steps of 2^(order-3)
+        size_t order = get_order(size);
+        return 4 * order - 24 + ((size - 1) >> (order - 3));
     }
 
-    void allocate_new_block(size_t order) {
-        auto block = new char[OS_ALLOC_SIZE];
-        buffers_.push_back(block);
-        size_t size = 1 << order;
-        size_t offset = 0;
-        while(offset < OS_ALLOC_SIZE) {
-            free_[order].push_back(block + offset);
-            offset += size;
+    static size_t class_size(size_t index) {
+        if(index < SMALL_CLASSES) {
+            return 8 * (index + 1);
         }
+        size_t order = (index - SMALL_CLASSES) / 4 + 6;
+        return (size_t(1) << (order - 1)) + ((index - SMALL_CLASSES) % 4 + 1) * (size_t(1) << (order - 3));
+    }
+
+    // Header in the first SLAB_HEADER bytes of a slab.
+    struct slab {
+        slab* prev;
+        slab* next;
+        free_block* free;
+        char* unused;   // blocks from here on were never handed out
+        size_t live;
+        size_t index;
+        int64_t emptied;   // steady clock nanoseconds, while in empty_
+    };
+    static_assert(sizeof(slab) <= SLAB_HEADER, "slab header does not fit");
+
+    struct slab_list {
+        slab* head;
+        slab* tail;
+        size_t count;
+    };
+
+    static void push_front(slab_list& list, slab* s) {
+        s->prev = nullptr;
+        s->next = list.head;
+        (list.head ? list.head->prev : list.tail) = s;
+        list.head = s;
+        ++list.count;
+    }
+
+    static void remove(slab_list& list, slab* s) {
+        (s->prev ? s->prev->next : list.head) = s->next;
+        (s->next ? s->next->prev : list.tail) = s->prev;
+        --list.count;
+    }
+
+    static size_t first_block(size_t size) {
+        return (SLAB_HEADER + size - 1) / size * size;
+    }
+
+    slab* slab_of(void* ptr) const {
+        return reinterpret_cast<slab*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(slab_size_ - 1));
     }
 
-    size_t order_;
-    std::vector<void*> buffers_;
-    std::vector<std::list<void*>> free_;
+    bool is_full(slab* s) const {
+        return s->free == nullptr && size_t(reinterpret_cast<char*>(s) + slab_size_ - s->unused) < class_size(s->index);
+    }
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void decay(int64_t time);
+    slab* take_slab(size_t index);
+    slab* map_slab();
+    void unmap_slab(slab* s);
+
+    size_t max_size_;
+    size_t slab_size_;
+    size_t retained_;
+    int64_t delay_;
+    size_t slab_count_;
+    slab_list partial_[CLASS_COUNT];   // slabs of a class with free blocks
+    slab_list full_[CLASS_COUNT];
+    slab_list empty_;                  // most recently emptied first
 };
 
 template <typename T, typename ... ARGS>
@@ -66,42 +194,176 @@ void au_allocator::deallocate(T* const ptr) {
     deallocate(ptr, sizeof(T));
 }
 
-inline au_allocator::au_allocator(size_t max_order) 
-    : order_(max_order)
-    , free_(max_order) {
-    if(pow(2, max_order) > OS_ALLOC_SIZE) {
+inline au_allocator::au_allocator(size_t max_order, size_t slab_size)
+    : max_size_(max_order < 8 * sizeof(size_t) ? size_t(1) << max_order : 0)
+    , slab_size_(slab_size)
+    , retained_(RETAINED_SLABS)
+    , delay_(DECAY_MS * 1000000)
+    , slab_count_(0)
+    , empty_() {
+    if(max_size_ == 0 || max_size_ > OS_ALLOC_SIZE) {
         throw std::logic_error("2^(max_order-1) > N");
     }
+    if(slab_size_ < OS_ALLOC_SIZE || (slab_size_ & (slab_size_ - 1)) != 0
+            || first_block(block_size(max_size_)) + block_size(max_size_) > slab_size_) {
+        throw std::logic_error("slab size is not a power of two that holds the largest block");
+    }
+    for(size_t index = 0; index < CLASS_COUNT; ++index) {
+        partial_[index] = full_[index] = slab_list();
+    }
 }
 
 inline au_allocator::~au_allocator() {
-    for(auto buffer : buffers_) {
-        delete[] reinterpret_cast<char*>(buffer);
+    for(size_t index = 0; index < CLASS_COUNT; ++index) {
+        while(partial_[index].head) {
+            auto s = partial_[index].head;
+            remove(partial_[index], s);
+            unmap_slab(s);
+        }
+        while(full_[index].head) {
+            auto s = full_[index].head;
+            remove(full_[index], s);
+            unmap_slab(s);
+        }
     }
+    trim();
 }
 
 inline void* au_allocator::allocate(size_t size) {
-    if(size > pow(2, order_)) {
+    if(size > max_size_) {
         return new char[size];
     }
 
-    auto order = get_order(size);
-
-    if(free_[order].empty()) {
-        allocate_new_block(order);
+    auto index = size_class(size);
+    auto s = partial_[index].head;
+    if(s == nullptr) {
+        s = take_slab(index);
     }
 
-    auto res = free_[order].front();
-    free_[order].pop_front();
+    void* res;
+    if(s->free != nullptr) {
+        res = s->free;
+        s->free = s->free->next;
+    }
+    else {
+        res = s->unused;
+        s->unused += class_size(index);
+    }
+    ++s->live;
+    if(is_full(s)) {
+        remove(partial_[index], s);
+        push_front(full_[index], s);
+    }
     return res;
 }
 
 inline void au_allocator::deallocate(void* ptr, size_t size) {
-    if(size > pow(2, order_)) {
+    if(size > max_size_) {
         delete[] reinterpret_cast<char*>(ptr);
+        return;
+    }
+
+    auto s = slab_of(ptr);
+    auto index = s->index;
+    bool was_full = is_full(s);
+    auto node = static_cast<free_block*>(ptr);
+    node->next = s->free;
+    s->free = node;
+    if(--s->live == 0) {
+        // the only slab of the class with free blocks stays, so a block freed and taken again does not move it
+        if(!was_full && partial_[index].count == 1) {
+            return;
+        }
+        remove(was_full ? full_[index] : partial_[index], s);
+        s->emptied = now();
+        push_front(empty_, s);
+        decay(s->emptied);
+    }
+    else if(was_full) {
+        remove(full_[index], s);
+        push_front(partial_[index], s);
+    }
+}
+
+inline size_t au_allocator::trim() {
+    size_t mapped = slab_count_;
+    for(size_t index = 0; index < CLASS_COUNT; ++index) {
+        for(auto s = partial_[index].head; s != nullptr;) {
+            auto next = s->next;
+            if(s->live == 0) {
+                remove(partial_[index], s);
+                unmap_slab(s);
+            }
+            s = next;
+        }
+    }
+    while(empty_.head) {
+        auto s = empty_.head;
+        remove(empty_, s);
+        unmap_slab(s);
+    }
+    return (mapped - slab_count_) * slab_size_;
+}
+
+inline void au_allocator::set_decay(std::chrono::milliseconds delay, size_t retained) {
+    delay_ = std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count();
+    retained_ = retained;
+    decay(now());
+}
+
+inline void au_allocator::decay(int64_t time) {
+    while(empty_.count > retained_ && time - empty_.tail->emptied >= delay_) {
+        auto oldest = empty_.tail;
+        remove(empty_, oldest);
+        unmap_slab(oldest);
+    }
+}
+
+// The most recently emptied slab, keeping its free list if it served the same class, or a new one.
+inline au_allocator::slab* au_allocator::take_slab(size_t index) {
+    slab* s = empty_.head;
+    bool reuse = s != nullptr && s->index == index;
+    if(s != nullptr) {
+        remove(empty_, s);
     }
     else {
-        auto order = get_order(size);
-        free_[order].push_back(ptr);
+        s = map_slab();
+    }
+    if(!reuse) {
+        s->index = index;
+        s->free = nullptr;
+        s->unused = reinterpret_cast<char*>(s) + first_block(class_size(index));
+    }
+    s->live = 0;
+    push_front(partial_[index], s);
+    return s;
+}
+
+inline au_allocator::slab* au_allocator::map_slab() {
+    // map twice the size and cut it down to the aligned slab inside
+    size_t length = 2 * slab_size_;
+    void* memory = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(memory == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    auto begin = reinterpret_cast<uintptr_t>(memory);
+    auto aligned = (begin + slab_size_ - 1) & ~uintptr_t(slab_size_ - 1);
+    if(aligned != begin) {
+        munmap(memory, aligned - begin);
+    }
+    if(aligned + slab_size_ != begin + length) {
+        munmap(reinterpret_cast<void*>(aligned + slab_size_), begin + length - aligned - slab_size_);
     }
+#ifdef MADV_HUGEPAGE
+    if(slab_size_ >= HUGE_PAGE_SIZE) {
+        madvise(reinterpret_cast<void*>(aligned), slab_size_, MADV_HUGEPAGE);
+    }
+#endif
+    ++slab_count_;
+    return reinterpret_cast<slab*>(aligned);
+}
+
+inline void au_allocator::unmap_slab(slab* s) {
+    munmap(s, slab_size_);
+    --slab_count_;
 }
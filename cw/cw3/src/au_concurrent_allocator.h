@@ -0,0 +1,456 @@
+#pragma once
+#include "au_allocator.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdexcept>
+#include <new>
+#include <utility>
+
+/*
+ * Thread-safe au_allocator: same size classes and interface, and a block
+ * may be freed on any thread.
+ *
+ * Every thread has its own cache: a free list per size class, used without
+ * any synchronization. A miss refills the list with a batch of blocks from
+ * the central pool (one lock per batch, not per block), and a list that
+ * grows past two batches hands one back. Blocks come from 64 KB slabs
+ * aligned to their size, with the owning thread cache in the slab header;
+ * a block freed on another thread goes back to its owner through the
+ * owner's lock-free remote free list, which the owner empties on a miss.
+ *
+ * A cache is orphaned when its thread exits or calls flush(), which also
+ * hands what the cache holds to the central pool: blocks freed to it from
+ * then on go to the freeing thread's cache, and a refill that would
+ * otherwise cut a new slab adopts whatever an orphaned cache's remote list
+ * holds. When the thread has exited, that refill also moves the cache's own
+ * free lists and the uncut rest of its slabs to the central pool. The cache
+ * is the thread's again once it refills, and is picked up by the next
+ * thread that gets the same id.
+ */
+struct au_concurrent_allocator {
+    explicit au_concurrent_allocator(size_t max_order = 7);
+    ~au_concurrent_allocator();
+    void* allocate(size_t size);
+    void deallocate(void* ptr, size_t size);
+
+    template<typename T, typename... ARGS>
+    T* allocate(ARGS&&... args);
+
+    template<typename T>
+    void deallocate(T* const ptr);
+
+    // Moves the calling thread's cached blocks to the central pool and orphans its cache.
+    void flush();
+
+    static const size_t SLAB_SIZE = 16 * OS_ALLOC_SIZE;
+
+private:
+    typedef au_allocator::free_block free_block;
+    static const size_t CLASS_COUNT = au_allocator::CLASS_COUNT;
+    static const size_t CACHE_LINE = 64;
+
+    struct thread_cache;
+
+    // Header in the first cache line of a slab, which is aligned to SLAB_SIZE.
+    struct slab {
+        thread_cache* owner;
+        size_t index;
+    };
+
+    struct free_list {
+        free_block* head;
+        size_t count;
+    };
+
+    // A thread's free blocks of one class, and the part of its last slab not yet cut into blocks.
+    struct magazine : free_list {
+        char* next;
+        char* end;
+    };
+
+    struct thread_cache {
+        explicit thread_cache(std::thread::id thread)
+            : thread(thread)
+            , remote(nullptr)
+            , orphaned(false)
+            , exited(false)
+            , retired(false) {
+            for(auto& list : lists) {
+                list.head = nullptr;
+                list.count = 0;
+                list.next = nullptr;
+                list.end = nullptr;
+            }
+        }
+
+        std::thread::id thread;
+        magazine lists[CLASS_COUNT];
+        char padding[CACHE_LINE];
+        std::atomic<free_block*> remote;
+        // Set while no thread will empty remote.
+        std::atomic<bool> orphaned;
+        // Set when the thread exits and until another thread takes over lists.
+        std::atomic<bool> exited;
+        // Set when the allocator is destroyed.
+        std::atomic<bool> retired;
+    };
+
+    // The caches a thread uses, by allocator id; ids are never reused, so a stale entry cannot match.
+    struct cache_map {
+        struct entry {
+            uint64_t id;
+            thread_cache* cache;
+            std::shared_ptr<thread_cache> keep;
+        };
+
+        // The thread exits: nobody will empty the remote lists of its caches or use their free lists.
+        ~cache_map() {
+            for(auto& entry : entries) {
+                entry.cache->orphaned.store(true, std::memory_order_relaxed);
+                entry.cache->exited.store(true, std::memory_order_release);
+            }
+        }
+
+        std::vector<entry> entries;
+    };
+
+    struct central_list {
+        std::mutex lock;
+        std::vector<free_list> batches;
+    };
+
+    // Blocks moved between a thread cache and the central pool at a time.
+    static size_t batch_size(size_t index) {
+        size_t count = OS_ALLOC_SIZE / au_allocator::class_size(index);
+        return count < 4 ? 4 : count > 64 ? 64 : count;
+    }
+
+    static slab* slab_of(void* ptr) {
+        return reinterpret_cast<slab*>(reinterpret_cast<uintptr_t>(ptr) & ~uintptr_t(SLAB_SIZE - 1));
+    }
+
+    static uint64_t next_id() {
+        static std::atomic<uint64_t> counter(0);
+        return ++counter;
+    }
+
+    thread_cache& local_cache();
+    thread_cache& find_cache();
+    void refill(thread_cache& cache, size_t index);
+    bool take_batch(magazine& list, size_t index);
+    void release(magazine& list, size_t index, size_t count);
+    void take_remote(thread_cache& cache);
+    void take_list(thread_cache& cache, free_block* node);
+    bool adopt_orphans(thread_cache& cache);
+    void reclaim(thread_cache& orphan);
+    void carve(magazine& list, size_t index);
+    void allocate_slab(thread_cache& cache, size_t index);
+
+    const uint64_t id_;
+    size_t max_size_;
+    central_list central_[CLASS_COUNT];
+    std::mutex caches_lock_;
+    std::vector<std::shared_ptr<thread_cache>> caches_;
+    std::vector<void*> slabs_;
+};
+
+template <typename T, typename ... ARGS>
+T* au_concurrent_allocator::allocate(ARGS&&... args) {
+    T* ptr = reinterpret_cast<T*>(allocate(sizeof(T)));
+    new (ptr) T(std::forward<ARGS>(args)...);
+    return ptr;
+}
+
+template <typename T>
+void au_concurrent_allocator::deallocate(T* const ptr) {
+    ptr->~T();
+    deallocate(ptr, sizeof(T));
+}
+
+inline au_concurrent_allocator::au_concurrent_allocator(size_t max_order)
+    : id_(next_id())
+    , max_size_(max_order < 8 * sizeof(size_t) ? size_t(1) << max_order : 0) {
+    if(max_size_ == 0 || max_size_ > OS_ALLOC_SIZE) {
+        throw std::logic_error("2^(max_order-1) > N");
+    }
+}
+
+inline au_concurrent_allocator::~au_concurrent_allocator() {
+    for(auto& cache : caches_) {
+        cache->retired.store(true, std::memory_order_relaxed);
+    }
+    for(auto slab : slabs_) {
+        free(slab);
+    }
+}
+
+inline void* au_concurrent_allocator::allocate(size_t size) {
+    if(size > max_size_) {
+        return new char[size];
+    }
+
+    auto index = au_allocator::size_class(size);
+    auto& cache = local_cache();
+    auto& list = cache.lists[index];
+    if(list.head == nullptr) {
+        refill(cache, index);
+    }
+
+    auto res = list.head;
+    list.head = res->next;
+    --list.count;
+    return res;
+}
+
+inline void au_concurrent_allocator::deallocate(void* ptr, size_t size) {
+    if(size > max_size_) {
+        delete[] reinterpret_cast<char*>(ptr);
+        return;
+    }
+
+    auto node = static_cast<free_block*>(ptr);
+    auto& cache = local_cache();
+    auto owner = slab_of(ptr)->owner;
+    if(owner != &cache && !owner->orphaned.load(std::memory_order_relaxed)) {
+        auto head = owner->remote.load(std::memory_order_relaxed);
+        do {
+            node->next = head;
+        } while(!owner->remote.compare_exchange_weak(head, node, std::memory_order_release, std::memory_order_relaxed));
+        return;
+    }
+
+    auto index = au_allocator::size_class(size);
+    auto& list = cache.lists[index];
+    node->next = list.head;
+    list.head = node;
+    if(++list.count >= 2 * batch_size(index)) {
+        release(list, index, batch_size(index));
+    }
+}
+
+inline void au_concurrent_allocator::flush() {
+    auto& cache = local_cache();
+    cache.orphaned.store(true, std::memory_order_relaxed);
+    take_remote(cache);
+    for(size_t index = 0; index < CLASS_COUNT; ++index) {
+        if(cache.lists[index].count != 0) {
+            release(cache.lists[index], index, cache.lists[index].count);
+        }
+    }
+}
+
+inline au_concurrent_allocator::thread_cache& au_concurrent_allocator::local_cache() {
+    // The last allocator used, checked first; the map, which has a destructor, costs more to reach.
+    static thread_local struct {
+        uint64_t id;
+        thread_cache* cache;
+    } last = { 0, nullptr };
+    if(last.id == id_) {
+        return *last.cache;
+    }
+    last.cache = &find_cache();
+    last.id = id_;
+    return *last.cache;
+}
+
+// The calling thread's cache, from its map or, the first time, from the list of all of them.
+inline au_concurrent_allocator::thread_cache& au_concurrent_allocator::find_cache() {
+    static thread_local cache_map map;
+    for(auto& entry : map.entries) {
+        if(entry.id == id_) {
+            return *entry.cache;
+        }
+    }
+
+    auto thread = std::this_thread::get_id();
+    std::shared_ptr<thread_cache> cache;
+    {
+        std::lock_guard<std::mutex> lock(caches_lock_);
+        for(auto& candidate : caches_) {
+            if(candidate->thread == thread) {
+                cache = candidate;
+                break;
+            }
+        }
+        if(cache == nullptr) {
+            caches_.emplace_back(std::make_shared<thread_cache>(thread));
+            cache = caches_.back();
+        }
+        cache->orphaned.store(false, std::memory_order_relaxed);
+        // what a thread with the same id left behind is this thread's now
+        cache->exited.exchange(false, std::memory_order_acquire);
+    }
+
+    // entries of destroyed allocators go when a new one comes
+    auto& entries = map.entries;
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [](cache_map::entry const& entry) {
+        return entry.cache->retired.load(std::memory_order_relaxed);
+    }), entries.end());
+    cache_map::entry entry = { id_, cache.get(), cache };
+    entries.push_back(entry);
+    return *cache;
+}
+
+// Own blocks freed elsewhere first, then a batch from the central pool, then orphaned blocks, then a new slab.
+inline void au_concurrent_allocator::refill(thread_cache& cache, size_t index) {
+    if(cache.orphaned.load(std::memory_order_relaxed)) {
+        cache.orphaned.store(false, std::memory_order_relaxed);
+    }
+    take_remote(cache);
+    if(cache.lists[index].head != nullptr) {
+        return;
+    }
+
+    if(take_batch(cache.lists[index], index)) {
+        return;
+    }
+    if(adopt_orphans(cache) && (cache.lists[index].head != nullptr || take_batch(cache.lists[index], index))) {
+        return;
+    }
+    if(size_t(cache.lists[index].end - cache.lists[index].next) < au_allocator::class_size(index)) {
+        allocate_slab(cache, index);
+    }
+    carve(cache.lists[index], index);
+}
+
+inline bool au_concurrent_allocator::take_batch(magazine& list, size_t index) {
+    auto& central = central_[index];
+    std::lock_guard<std::mutex> lock(central.lock);
+    if(central.batches.empty()) {
+        return false;
+    }
+    static_cast<free_list&>(list) = central.batches.back();
+    central.batches.pop_back();
+    return true;
+}
+
+// Moves the last count blocks of the list, the longest unused, to the central pool as one batch.
+inline void au_concurrent_allocator::release(magazine& list, size_t index, size_t count) {
+    free_list batch = { list.head, count };
+    list.count -= count;
+    if(list.count != 0) {
+        free_block* last = list.head;
+        for(size_t i = 1; i < list.count; ++i) {
+            last = last->next;
+        }
+        batch.head = last->next;
+        last->next = nullptr;
+    }
+    else {
+        list.head = nullptr;
+    }
+
+    auto& central = central_[index];
+    std::lock_guard<std::mutex> lock(central.lock);
+    central.batches.push_back(batch);
+}
+
+inline void au_concurrent_allocator::take_remote(thread_cache& cache) {
+    if(cache.remote.load(std::memory_order_relaxed) == nullptr) {
+        return;
+    }
+    take_list(cache, cache.remote.exchange(nullptr, std::memory_order_acquire));
+}
+
+// Puts a list of free blocks of any classes into the cache's free lists.
+inline void au_concurrent_allocator::take_list(thread_cache& cache, free_block* node) {
+    while(node != nullptr) {
+        auto next = node->next;
+        auto& list = cache.lists[slab_of(node)->index];
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+        node = next;
+    }
+}
+
+/*
+ * Takes over the remote lists of orphaned caches: blocks freed to a cache
+ * around the time it was orphaned, which nobody else would ever reuse. They
+ * stay in the slabs of the orphan, so whoever frees them later passes them on.
+ * The free lists of a cache whose thread has exited go to the central pool.
+ */
+inline bool au_concurrent_allocator::adopt_orphans(thread_cache& cache) {
+    bool adopted = false;
+    std::lock_guard<std::mutex> lock(caches_lock_);
+    for(auto& orphan : caches_) {
+        if(orphan->orphaned.load(std::memory_order_relaxed) && orphan->remote.load(std::memory_order_relaxed) != nullptr) {
+            auto node = orphan->remote.exchange(nullptr, std::memory_order_acquire);
+            adopted = adopted || node != nullptr;
+            take_list(cache, node);
+        }
+        if(orphan->exited.load(std::memory_order_acquire)) {
+            orphan->exited.store(false, std::memory_order_relaxed);
+            reclaim(*orphan);
+            adopted = true;
+        }
+    }
+    return adopted;
+}
+
+// Cuts the rest of each slab of an exited thread's cache and hands its free lists to the central pool in batches.
+inline void au_concurrent_allocator::reclaim(thread_cache& orphan) {
+    for(size_t index = 0; index < CLASS_COUNT; ++index) {
+        auto& list = orphan.lists[index];
+        while(size_t(list.end - list.next) >= au_allocator::class_size(index)) {
+            carve(list, index);
+        }
+        list.next = nullptr;
+        list.end = nullptr;
+        if(list.head == nullptr) {
+            continue;
+        }
+
+        auto& central = central_[index];
+        std::lock_guard<std::mutex> lock(central.lock);
+        while(list.head != nullptr) {
+            free_list batch = { list.head, 0 };
+            free_block* last = nullptr;
+            for(; list.head != nullptr && batch.count < batch_size(index); ++batch.count) {
+                last = list.head;
+                list.head = list.head->next;
+            }
+            last->next = nullptr;
+            central.batches.push_back(batch);
+        }
+        list.count = 0;
+    }
+}
+
+// Cuts up to a batch of blocks from the rest of the current slab.
+inline void au_concurrent_allocator::carve(magazine& list, size_t index) {
+    size_t size = au_allocator::class_size(index);
+    for(size_t i = batch_size(index); i != 0 && size_t(list.end - list.next) >= size; --i) {
+        auto node = reinterpret_cast<free_block*>(list.next);
+        list.next += size;
+        node->next = list.head;
+        list.head = node;
+        ++list.count;
+    }
+}
+
+inline void au_concurrent_allocator::allocate_slab(thread_cache& cache, size_t index) {
+    void* memory = nullptr;
+    if(posix_memalign(&memory, SLAB_SIZE, SLAB_SIZE) != 0) {
+        throw std::bad_alloc();
+    }
+    {
+        std::lock_guard<std::mutex> lock(caches_lock_);
+        slabs_.push_back(memory);
+    }
+    auto header = static_cast<slab*>(memory);
+    header->owner = &cache;
+    header->index = index;
+
+    // blocks sit at multiples of their size, after the header
+    size_t size = au_allocator::class_size(index);
+    auto& list = cache.lists[index];
+    list.next = static_cast<char*>(memory) + (CACHE_LINE + size - 1) / size * size;
+    list.end = static_cast<char*>(memory) + SLAB_SIZE;
+}
@@ -0,0 +1,106 @@
+#pragma once
+#include "au_allocator.h"
+#include <stddef.h>
+#include <limits>
+#include <new>
+#include <type_traits>
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<memory_resource>)
+#include <memory_resource>
+#define AU_HAS_MEMORY_RESOURCE 1
+#endif
+#endif
+
+/*
+ * Standard Allocator over an au_allocator, for std::vector, std::map and
+ * the other allocator-aware containers. Copies share the au_allocator,
+ * which must outlive every container using it; two adapters are equal
+ * when they share it. Node-sized requests come from its size classes,
+ * larger ones from its new[] fallback.
+ */
+template<typename T>
+struct au_std_allocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    explicit au_std_allocator(au_allocator& alloc)
+        : alloc_(&alloc) {}
+
+    template<typename U>
+    au_std_allocator(au_std_allocator<U> const& other)
+        : alloc_(other.alloc_) {}
+
+    T* allocate(size_t n) {
+        static_assert(alignof(T) <= alignof(max_align_t), "au_allocator does not serve over-aligned types");
+        if(n > std::numeric_limits<size_t>::max() / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        return static_cast<T*>(alloc_->allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* ptr, size_t n) {
+        alloc_->deallocate(ptr, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(au_std_allocator<U> const& other) const {
+        return alloc_ == other.alloc_;
+    }
+
+    template<typename U>
+    bool operator!=(au_std_allocator<U> const& other) const {
+        return alloc_ != other.alloc_;
+    }
+
+private:
+    template<typename U>
+    friend struct au_std_allocator;
+
+    au_allocator* alloc_;
+};
+
+#ifdef AU_HAS_MEMORY_RESOURCE
+/*
+ * std::pmr::memory_resource over an au_allocator, for std::pmr containers.
+ * A block of a class is aligned to the largest power of two dividing the
+ * class size, so a request is rounded up to a multiple of its alignment;
+ * alignments above alignof(max_align_t) go to the aligned operator new.
+ */
+struct au_memory_resource : std::pmr::memory_resource {
+    explicit au_memory_resource(au_allocator& alloc)
+        : alloc_(alloc) {}
+
+    au_allocator& allocator() const {
+        return alloc_;
+    }
+
+private:
+    static size_t padded(size_t bytes, size_t alignment) {
+        return (bytes + alignment - 1) & ~(alignment - 1);
+    }
+
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        if(alignment > alignof(max_align_t)) {
+            return ::operator new(bytes, std::align_val_t(alignment));
+        }
+        return alloc_.allocate(padded(bytes, alignment));
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t alignment) override {
+        if(alignment > alignof(max_align_t)) {
+            ::operator delete(ptr, bytes, std::align_val_t(alignment));
+            return;
+        }
+        alloc_.deallocate(ptr, padded(bytes, alignment));
+    }
+
+    bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override {
+        auto resource = dynamic_cast<au_memory_resource const*>(&other);
+        return resource != nullptr && &resource->alloc_ == &alloc_;
+    }
+
+    au_allocator& alloc_;
+};
+#endif
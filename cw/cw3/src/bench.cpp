@@ -0,0 +1,594 @@
+#include "au_allocator.h"
+#include "au_concurrent_allocator.h"
+#include "au_std_allocator.h"
+#include <cmath>
+#include <list>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <malloc.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds_since(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// keeps the compiler from pairing up and dropping malloc/free
+static void escape(void* ptr)
+{
+    asm volatile("" : : "g"(ptr) : "memory");
+}
+
+struct malloc_allocator
+{
+    void* allocate(size_t size)
+    {
+        return malloc(size);
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        free(ptr);
+    }
+};
+
+// the former au_allocator: one std::list<void*> node per free block
+struct list_allocator
+{
+    explicit list_allocator(size_t max_order = 7)
+        : order_(max_order)
+        , free_(max_order + 1)
+    {}
+
+    ~list_allocator()
+    {
+        for (auto buffer : buffers_)
+        {
+            delete[] buffer;
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        if (size > pow(2, order_))
+        {
+            return new char[size];
+        }
+        auto order = get_order(size);
+        if (free_[order].empty())
+        {
+            auto block = new char[OS_ALLOC_SIZE];
+            buffers_.push_back(block);
+            for (size_t offset = 0; offset < OS_ALLOC_SIZE; offset += size_t(1) << order)
+            {
+                free_[order].push_back(block + offset);
+            }
+        }
+        auto res = free_[order].front();
+        free_[order].pop_front();
+        return res;
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        if (size > pow(2, order_))
+        {
+            delete[] reinterpret_cast<char*>(ptr);
+        }
+        else
+        {
+            free_[get_order(size)].push_back(ptr);
+        }
+    }
+
+private:
+    static size_t get_order(size_t size)
+    {
+        auto res = static_cast<size_t>(log2(size));
+        if (size != pow(2, res))
+        {
+            ++res;
+        }
+        return res;
+    }
+
+    size_t order_;
+    std::vector<char*> buffers_;
+    std::vector<std::list<void*>> free_;
+};
+
+// the former size classes: powers of two, order from log2/pow, intrusive free lists
+struct power_of_two_allocator
+{
+    explicit power_of_two_allocator(size_t max_order = 7)
+        : order_(max_order)
+        , free_(max_order + 1, nullptr)
+    {}
+
+    ~power_of_two_allocator()
+    {
+        for (auto buffer : buffers_)
+        {
+            delete[] buffer;
+        }
+    }
+
+    void* allocate(size_t size)
+    {
+        if (size > pow(2, order_))
+        {
+            return new char[size];
+        }
+        auto order = get_order(size);
+        if (free_[order] == nullptr)
+        {
+            auto block = new char[OS_ALLOC_SIZE];
+            buffers_.push_back(block);
+            for (size_t offset = OS_ALLOC_SIZE; offset > 0; offset -= size_t(1) << order)
+            {
+                auto node = reinterpret_cast<void**>(block + offset - (size_t(1) << order));
+                *node = free_[order];
+                free_[order] = node;
+            }
+        }
+        auto res = free_[order];
+        free_[order] = *reinterpret_cast<void**>(res);
+        return res;
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        if (size > pow(2, order_))
+        {
+            delete[] reinterpret_cast<char*>(ptr);
+        }
+        else
+        {
+            auto order = get_order(size);
+            *reinterpret_cast<void**>(ptr) = free_[order];
+            free_[order] = ptr;
+        }
+    }
+
+    static size_t get_order(size_t size)
+    {
+        if (size <= 8)
+        {
+            return 3;
+        }
+        auto res = static_cast<size_t>(log2(size));
+        if (size != pow(2, res))
+        {
+            ++res;
+        }
+        return res;
+    }
+
+private:
+    size_t order_;
+    std::vector<char*> buffers_;
+    std::vector<void*> free_;
+};
+
+// === allocate + free of one block at a time ===
+template<class allocator>
+static double pairs_run(size_t rounds, size_t& checksum)
+{
+    allocator alloc;
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < rounds; ++i)
+    {
+        char* ptr = static_cast<char*>(alloc.allocate(32));
+        escape(ptr);
+        ptr[0] = char(i);
+        checksum += ptr[0];
+        alloc.deallocate(ptr, 32);
+    }
+    return seconds_since(start) * 1e9 / (rounds * 2);
+}
+
+// === a batch of blocks allocated, then all freed, over and over ===
+template<class allocator>
+static double batch_run(size_t batch, size_t rounds, size_t& checksum)
+{
+    allocator alloc;
+    std::vector<char*> blocks(batch);
+    auto start = bench_clock::now();
+    for (size_t round = 0; round < rounds; ++round)
+    {
+        for (auto& block : blocks)
+        {
+            block = static_cast<char*>(alloc.allocate(64));
+            block[0] = char(round);
+        }
+        for (auto block : blocks)
+        {
+            checksum += block[0];
+            alloc.deallocate(block, 64);
+        }
+    }
+    return seconds_since(start) * 1e9 / (batch * rounds * 2);
+}
+
+// === a working set of live blocks of random sizes, one replaced per step ===
+template<class allocator>
+static double churn_run(size_t live, size_t steps, size_t& checksum)
+{
+    allocator alloc;
+    std::mt19937 random(21);
+    std::vector<char*> blocks(live);
+    std::vector<size_t> sizes(live);
+    for (size_t i = 0; i < live; ++i)
+    {
+        sizes[i] = 1 + random() % 128;
+        blocks[i] = static_cast<char*>(alloc.allocate(sizes[i]));
+        blocks[i][0] = 0;
+    }
+    std::vector<uint32_t> picks(steps);
+    for (auto& pick : picks)
+    {
+        pick = random();
+    }
+    auto start = bench_clock::now();
+    for (size_t step = 0; step < steps; ++step)
+    {
+        size_t slot = picks[step] % live;
+        checksum += blocks[slot][0];
+        alloc.deallocate(blocks[slot], sizes[slot]);
+        sizes[slot] = 1 + (picks[step] >> 12) % 128;
+        blocks[slot] = static_cast<char*>(alloc.allocate(sizes[slot]));
+        blocks[slot][0] = char(step);
+    }
+    double ns = seconds_since(start) * 1e9 / (steps * 2);
+    for (size_t i = 0; i < live; ++i)
+    {
+        alloc.deallocate(blocks[i], sizes[i]);
+    }
+    return ns;
+}
+
+template<class allocator>
+static void bench_allocator(const char* name)
+{
+    size_t checksum = 0;
+    double pairs = pairs_run<allocator>(10000000, checksum);
+    double batch = batch_run<allocator>(100000, 50, checksum);
+    double churn = churn_run<allocator>(100000, 5000000, checksum);
+    std::printf("%-14s ns/op: pairs %6.2f  batch %6.2f  churn %6.2f  (checksum %zu)\n",
+            name, pairs, batch, churn, checksum);
+}
+
+// === internal fragmentation: block bytes per requested byte, including the unused tail of each 4 KB buffer ===
+template<class block_size_of>
+static double overhead(size_t smallest, size_t largest, size_t step, block_size_of block_size)
+{
+    double requested = 0, reserved = 0;
+    for (size_t size = smallest; size <= largest; size += step)
+    {
+        size_t block = block_size(size);
+        requested += size;
+        reserved += double(block) * OS_ALLOC_SIZE / (OS_ALLOC_SIZE / block * block);
+    }
+    return reserved / requested;
+}
+
+static void bench_fragmentation()
+{
+    auto power_of_two = [](size_t size) { return size_t(1) << power_of_two_allocator::get_order(size); };
+    auto quarter = [](size_t size) { return au_allocator::block_size(size); };
+    std::printf("bytes reserved per byte requested  sizes 1..128: powers of two %.3f, quarter classes %.3f;"
+            "  multiples of 8 in 8..128: %.3f, %.3f\n",
+            overhead(1, 128, 1, power_of_two), overhead(1, 128, 1, quarter),
+            overhead(8, 128, 8, power_of_two), overhead(8, 128, 8, quarter));
+}
+
+// au_allocator shared between threads behind one mutex
+struct locked_allocator
+{
+    void* allocate(size_t size)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        return alloc_.allocate(size);
+    }
+
+    void deallocate(void* ptr, size_t size)
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        alloc_.deallocate(ptr, size);
+    }
+
+private:
+    std::mutex lock_;
+    au_allocator alloc_;
+};
+
+// single producer, single consumer ring of blocks
+struct block_ring
+{
+    static const size_t CAPACITY = 1024;
+
+    block_ring()
+        : head(0)
+        , tail(0)
+    {
+    }
+
+    bool push(char* block)
+    {
+        size_t at = tail.load(std::memory_order_relaxed);
+        if (at - head.load(std::memory_order_acquire) == CAPACITY)
+        {
+            return false;
+        }
+        slots[at % CAPACITY] = block;
+        tail.store(at + 1, std::memory_order_release);
+        return true;
+    }
+
+    char* pop()
+    {
+        size_t at = head.load(std::memory_order_relaxed);
+        if (at == tail.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        char* block = slots[at % CAPACITY];
+        head.store(at + 1, std::memory_order_release);
+        return block;
+    }
+
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) std::atomic<size_t> tail;
+    char* slots[CAPACITY];
+};
+
+// === pairs of threads: one allocates blocks of random sizes, the other frees them ===
+template<class allocator>
+static double producer_consumer_run(allocator& alloc, size_t pairs, size_t blocks, size_t& checksum)
+{
+    std::vector<block_ring> rings(pairs);
+    std::vector<size_t> sums(pairs);
+    auto producer = [&](size_t pair) {
+        std::mt19937 random(pair + 23);
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            size_t size = 1 + random() % 128;
+            char* block = static_cast<char*>(alloc.allocate(size));
+            block[0] = char(size - 1);
+            while (!rings[pair].push(block))
+            {
+                std::this_thread::yield();
+            }
+        }
+    };
+    auto consumer = [&](size_t pair) {
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            char* block;
+            while ((block = rings[pair].pop()) == nullptr)
+            {
+                std::this_thread::yield();
+            }
+            size_t size = 1 + static_cast<unsigned char>(block[0]);
+            sums[pair] += size;
+            alloc.deallocate(block, size);
+        }
+    };
+    auto start = bench_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t pair = 0; pair < pairs; ++pair)
+    {
+        threads.emplace_back(producer, pair);
+        threads.emplace_back(consumer, pair);
+    }
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    double ns = seconds_since(start) * 1e9 / (pairs * blocks);
+    for (size_t sum : sums)
+    {
+        checksum += sum;
+    }
+    return ns;
+}
+
+template<class allocator>
+static void bench_producer_consumer(const char* name)
+{
+    size_t checksum = 0;
+    std::printf("%-14s ns/block:", name);
+    for (size_t pairs = 1; pairs <= 4; pairs *= 2)
+    {
+        allocator alloc;
+        std::printf("  %zu pair%s %6.1f", pairs, pairs == 1 ? " " : "s",
+                producer_consumer_run(alloc, pairs, 2000000 / pairs, checksum));
+    }
+    std::printf("  (checksum %zu, %u cores)\n", checksum, std::thread::hardware_concurrency());
+}
+
+// au_allocator unmapping empty slabs without delay
+struct eager_allocator : au_allocator
+{
+    eager_allocator()
+    {
+        set_decay(std::chrono::milliseconds(0));
+    }
+};
+
+// the same on 2 MiB slabs
+struct huge_slab_allocator : au_allocator
+{
+    huge_slab_allocator()
+        : au_allocator(7, au_allocator::HUGE_PAGE_SIZE)
+    {
+        set_decay(std::chrono::milliseconds(0));
+    }
+};
+
+static double resident_mb()
+{
+    size_t pages = 0, resident = 0;
+    FILE* statm = std::fopen("/proc/self/statm", "r");
+    if (statm)
+    {
+        if (std::fscanf(statm, "%zu %zu", &pages, &resident) != 2)
+        {
+            resident = 0;
+        }
+        std::fclose(statm);
+    }
+    return double(resident) * sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+// tagged on whether allocator derives from au_allocator, which an exact template match would otherwise hide
+template<class allocator>
+static void release_free(allocator&, std::false_type)
+{
+}
+
+static void release_free(au_allocator& alloc, std::true_type)
+{
+    alloc.trim();
+}
+
+static void release_free(malloc_allocator&, std::false_type)
+{
+    malloc_trim(0);
+}
+
+// === resident memory over spikes: a burst of blocks, most freed, the last few kept until the end ===
+template<class allocator>
+static void bench_rss(const char* name)
+{
+    const size_t spikes = 3;
+    const size_t blocks = 1000000;
+    const size_t kept = blocks / 50;
+    std::mt19937 random(24);
+    std::vector<char*> burst(blocks);
+    std::vector<std::pair<char*, size_t>> survivors;
+    std::vector<size_t> sizes(blocks);
+    double base = resident_mb();
+    std::printf("%-14s MB over baseline, peak/after each spike:", name);
+    auto start = bench_clock::now();
+    {
+        allocator alloc;
+        for (size_t spike = 0; spike < spikes; ++spike)
+        {
+            for (size_t i = 0; i < blocks; ++i)
+            {
+                sizes[i] = 1 + random() % 128;
+                burst[i] = static_cast<char*>(alloc.allocate(sizes[i]));
+                std::memset(burst[i], char(i), sizes[i]);
+            }
+            double peak = resident_mb() - base;
+            for (size_t i = 0; i < blocks - kept; ++i)
+            {
+                alloc.deallocate(burst[i], sizes[i]);
+            }
+            for (size_t i = blocks - kept; i < blocks; ++i)
+            {
+                survivors.emplace_back(burst[i], sizes[i]);
+            }
+            std::printf("  %5.1f/%5.1f", peak, resident_mb() - base);
+        }
+        release_free(alloc, std::is_base_of<au_allocator, allocator>());
+        std::printf("  trimmed %5.1f", resident_mb() - base);
+        for (auto& survivor : survivors)
+        {
+            alloc.deallocate(survivor.first, survivor.second);
+        }
+    }
+    std::printf("  (%.2f s)\n", seconds_since(start));
+}
+
+// === std::map churn: a working set of keys, one erased and one inserted per step ===
+template<class tree>
+static double map_churn_run(tree& map, size_t live, size_t steps, size_t& checksum)
+{
+    std::mt19937_64 random(25);
+    std::vector<uint64_t> keys(live);
+    for (auto& key : keys)
+    {
+        key = random();
+        map.emplace(key, key);
+    }
+    std::vector<uint64_t> fresh(steps);
+    for (auto& key : fresh)
+    {
+        key = random();
+    }
+    auto start = bench_clock::now();
+    for (size_t step = 0; step < steps; ++step)
+    {
+        size_t slot = fresh[step] % live;
+        checksum += map.erase(keys[slot]);
+        keys[slot] = fresh[step];
+        map.emplace(keys[slot], step);
+    }
+    return seconds_since(start) * 1e9 / steps;
+}
+
+static void bench_map_churn()
+{
+    const size_t live = 100000;
+    const size_t steps = 1000000;
+    size_t checksum = 0;
+    std::printf("std::map churn ns/step:");
+    {
+        std::map<uint64_t, uint64_t> map;
+        std::printf("  std::allocator %5.1f", map_churn_run(map, live, steps, checksum));
+    }
+    {
+        au_allocator alloc;
+        typedef au_std_allocator<std::pair<const uint64_t, uint64_t>> node_allocator;
+        std::map<uint64_t, uint64_t, std::less<uint64_t>, node_allocator> map{node_allocator(alloc)};
+        std::printf("  au_std_allocator %5.1f", map_churn_run(map, live, steps, checksum));
+    }
+#ifdef AU_HAS_MEMORY_RESOURCE
+    {
+        std::pmr::unsynchronized_pool_resource pool;
+        std::pmr::map<uint64_t, uint64_t> map(&pool);
+        std::printf("  pmr pool %5.1f", map_churn_run(map, live, steps, checksum));
+    }
+    {
+        au_allocator alloc;
+        au_memory_resource resource(alloc);
+        std::pmr::map<uint64_t, uint64_t> map(&resource);
+        std::printf("  au_memory_resource %5.1f", map_churn_run(map, live, steps, checksum));
+    }
+#endif
+    std::printf("  (checksum %zu)\n", checksum);
+}
+
+int main()
+{
+    bench_fragmentation();
+    bench_allocator<malloc_allocator>("malloc");
+    bench_allocator<list_allocator>("std::list");
+    bench_allocator<power_of_two_allocator>("powers of two");
+    bench_allocator<au_allocator>("au_allocator");
+    bench_allocator<eager_allocator>("eager release");
+    bench_allocator<au_concurrent_allocator>("concurrent");
+    bench_producer_consumer<malloc_allocator>("malloc");
+    bench_producer_consumer<locked_allocator>("mutex + au");
+    bench_producer_consumer<au_concurrent_allocator>("concurrent");
+    bench_map_churn();
+    bench_rss<au_allocator>("1 s decay");
+    bench_rss<eager_allocator>("64 KiB eager");
+    bench_rss<huge_slab_allocator>("2 MiB eager");
+    bench_rss<power_of_two_allocator>("no release");
+    bench_rss<malloc_allocator>("malloc");
+    return 0;
+}
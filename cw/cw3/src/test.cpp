@@ -1,11 +1,21 @@
 #include "au_allocator.h"
+#include "au_concurrent_allocator.h"
+#include "au_std_allocator.h"
 
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
 #include <array>
 #include <string.h>
+#include <stdint.h>
 #include <algorithm>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 
 static void test_constructor_forwarding()
@@ -115,9 +125,438 @@ static void test_stress()
     });
 }
 
+static void test_free_list_reuse()
+{
+    au_allocator alloc;
+    void *first = alloc.allocate(48);
+    void *second = alloc.allocate(48);
+    assert(first != second);
+    memset(first, 0x55, 48);
+    memset(second, 0x66, 48);
+
+    // freed blocks come back last in, first out
+    alloc.deallocate(first, 48);
+    alloc.deallocate(second, 48);
+    assert(alloc.allocate(48) == second);
+    assert(alloc.allocate(48) == first);
+
+    // a buffer carved for one class holds whole blocks of it
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 3 * OS_ALLOC_SIZE / 64; ++i)
+    {
+        blocks.push_back(alloc.allocate(64));
+    }
+    std::sort(blocks.begin(), blocks.end());
+    assert(std::unique(blocks.begin(), blocks.end()) == blocks.end());
+    for (void *block : blocks)
+    {
+        alloc.deallocate(block, 64);
+    }
+}
+
+static void test_size_classes()
+{
+    // blocks below pointer size still hold the free list link, and the largest class is pooled too
+    au_allocator alloc(2);
+    void *tiny = alloc.allocate(1);
+    void *empty = alloc.allocate(0);
+    void *largest = alloc.allocate(4);
+    assert(tiny != empty && tiny != largest && empty != largest);
+    alloc.deallocate(tiny, 1);
+    alloc.deallocate(empty, 0);
+    alloc.deallocate(largest, 4);
+
+    au_allocator wide;
+    void *block = wide.allocate(128);
+    memset(block, 0x77, 128);
+    wide.deallocate(block, 128);
+    assert(wide.allocate(128) == block);
+    // a size that is a multiple of 16 gets a 16 byte aligned block
+    for (size_t size = 16; size <= 128; size += 16)
+    {
+        void *aligned = wide.allocate(size);
+        assert(reinterpret_cast<uintptr_t>(aligned) % 16 == 0);
+        wide.deallocate(aligned, size);
+    }
+    void *big = wide.allocate(129);
+    memset(big, 0x77, 129);
+    wide.deallocate(big, 129);
+}
+
+static void test_slabs()
+{
+    bool thrown = false;
+    try
+    {
+        au_allocator odd(7, 3 * OS_ALLOC_SIZE);
+    }
+    catch (std::logic_error const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+    thrown = false;
+    try
+    {
+        au_allocator small(12, OS_ALLOC_SIZE);
+    }
+    catch (std::logic_error const&)
+    {
+        thrown = true;
+    }
+    assert(thrown);
+
+    // with no decay time, empty slabs beyond the retained ones go back right away; trim() returns the rest
+    au_allocator alloc;
+    alloc.set_decay(std::chrono::milliseconds(0));
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 20 * au_allocator::DEFAULT_SLAB_SIZE / 64; ++i)
+    {
+        blocks.push_back(alloc.allocate(64));
+        memset(blocks.back(), 0x12, 64);
+    }
+    assert(alloc.mapped_bytes() >= 20 * au_allocator::DEFAULT_SLAB_SIZE);
+    for (void *block : blocks)
+    {
+        alloc.deallocate(block, 64);
+    }
+    assert(alloc.mapped_bytes() <= (au_allocator::RETAINED_SLABS + 1) * au_allocator::DEFAULT_SLAB_SIZE);
+    alloc.trim();
+    assert(alloc.mapped_bytes() == 0);
+
+    // the only slab of a class stays mapped when it empties, until trim(); one live block keeps a slab
+    alloc.set_decay(std::chrono::milliseconds(0), 0);
+    void *small = alloc.allocate(16);
+    void *small2 = alloc.allocate(16);
+    alloc.deallocate(small, 16);
+    alloc.deallocate(small2, 16);
+    assert(alloc.mapped_bytes() == au_allocator::DEFAULT_SLAB_SIZE);
+    void *large = alloc.allocate(96);
+    void *other = alloc.allocate(96);
+    assert(alloc.mapped_bytes() == 2 * au_allocator::DEFAULT_SLAB_SIZE);
+    alloc.deallocate(large, 96);
+    assert(alloc.trim() == au_allocator::DEFAULT_SLAB_SIZE);
+    alloc.deallocate(other, 96);
+    assert(alloc.trim() == au_allocator::DEFAULT_SLAB_SIZE);
+    assert(alloc.mapped_bytes() == 0);
+
+    // by default empty slabs stay mapped for a while
+    au_allocator lazy;
+    blocks.clear();
+    for (size_t i = 0; i < 8 * au_allocator::DEFAULT_SLAB_SIZE / 64; ++i)
+    {
+        blocks.push_back(lazy.allocate(64));
+    }
+    size_t peak = lazy.mapped_bytes();
+    for (void *block : blocks)
+    {
+        lazy.deallocate(block, 64);
+    }
+    assert(lazy.mapped_bytes() == peak);
+    assert(lazy.trim() == peak);
+
+    au_allocator huge(12, au_allocator::HUGE_PAGE_SIZE);
+    for (size_t size = 16; size <= OS_ALLOC_SIZE; size *= 2)
+    {
+        void *block = huge.allocate(size);
+        assert(reinterpret_cast<uintptr_t>(block) % 16 == 0);
+        memset(block, 0x34, size);
+        huge.deallocate(block, size);
+    }
+    // each of the nine classes keeps its emptied slab
+    assert(huge.mapped_bytes() == 9 * au_allocator::HUGE_PAGE_SIZE);
+    assert(huge.trim() == 9 * au_allocator::HUGE_PAGE_SIZE);
+}
+
+static void test_std_allocator()
+{
+    au_allocator alloc;
+    {
+        typedef au_std_allocator<std::pair<const int, int>> pair_allocator;
+        std::map<int, int, std::less<int>, pair_allocator> tree{pair_allocator(alloc)};
+        for (int i = 0; i < 10000; ++i)
+        {
+            tree[i * 7 % 10000] = i;
+        }
+        for (int i = 0; i < 10000; i += 2)
+        {
+            tree.erase(i);
+        }
+        assert(tree.size() == 5000);
+        assert(tree.begin()->first == 1);
+
+        std::unordered_map<int, int, std::hash<int>, std::equal_to<int>, pair_allocator> table{16, std::hash<int>(),
+                std::equal_to<int>(), pair_allocator(alloc)};
+        for (int i = 0; i < 10000; ++i)
+        {
+            table[i] = -i;
+        }
+        assert(table.size() == 10000 && table[1234] == -1234);
+
+        // large requests fall back to new[]
+        std::vector<double, au_std_allocator<double>> values{au_std_allocator<double>(alloc)};
+        for (int i = 0; i < 1000; ++i)
+        {
+            values.push_back(i);
+        }
+        assert(values[999] == 999);
+
+        au_allocator other;
+        assert(au_std_allocator<int>(alloc) == au_std_allocator<double>(alloc));
+        assert(au_std_allocator<int>(alloc) != au_std_allocator<int>(other));
+    }
+    alloc.trim();
+    assert(alloc.mapped_bytes() == 0);
+
+#ifdef AU_HAS_MEMORY_RESOURCE
+    au_memory_resource resource(alloc);
+    {
+        const char *name = "a name longer than the small string buffer";
+        std::pmr::map<int, std::pmr::string> names(&resource);
+        for (int i = 0; i < 1000; ++i)
+        {
+            names.emplace(i, name);
+        }
+        assert(names.size() == 1000 && names[10] == name);
+        assert(names[10].get_allocator().resource() == &resource);
+        for (size_t alignment = 1; alignment <= 64; alignment *= 2)
+        {
+            void *block = resource.allocate(24, alignment);
+            assert(reinterpret_cast<uintptr_t>(block) % alignment == 0);
+            resource.deallocate(block, 24, alignment);
+        }
+        au_memory_resource same(alloc);
+        assert(resource.is_equal(same) && !resource.is_equal(*std::pmr::new_delete_resource()));
+    }
+    alloc.trim();
+    assert(alloc.mapped_bytes() == 0);
+#endif
+}
+
+static void test_concurrent_allocator()
+{
+    au_concurrent_allocator alloc;
+    void *first = alloc.allocate(48);
+    void *second = alloc.allocate(48);
+    assert(first != second);
+    memset(first, 0x55, 48);
+    memset(second, 0x66, 48);
+    alloc.deallocate(first, 48);
+    alloc.deallocate(second, 48);
+    assert(alloc.allocate(48) == second);
+    assert(alloc.allocate(48) == first);
+    alloc.deallocate(first, 48);
+    alloc.deallocate(second, 48);
+    for (size_t size = 16; size <= 128; size += 16)
+    {
+        void *aligned = alloc.allocate(size);
+        assert(reinterpret_cast<uintptr_t>(aligned) % 16 == 0);
+        alloc.deallocate(aligned, size);
+    }
+    void *big = alloc.allocate(129);
+    memset(big, 0x77, 129);
+    alloc.deallocate(big, 129);
+
+    // blocks freed on another thread come back to the thread that allocated them
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 1000; ++i)
+    {
+        blocks.push_back(alloc.allocate(64));
+    }
+    std::thread([&alloc, &blocks]() {
+        for (void *block : blocks)
+        {
+            alloc.deallocate(block, 64);
+        }
+    }).join();
+    // after what is left of the current batch
+    std::vector<void*> again;
+    for (size_t i = 0; i < 1000 + 64; ++i)
+    {
+        again.push_back(alloc.allocate(64));
+    }
+    std::sort(blocks.begin(), blocks.end());
+    std::sort(again.begin(), again.end());
+    assert(std::includes(again.begin(), again.end(), blocks.begin(), blocks.end()));
+    for (void *block : again)
+    {
+        alloc.deallocate(block, 64);
+    }
+}
+
+static void test_concurrent_orphans()
+{
+    // blocks of a thread which flushed and exited are reused once they are freed elsewhere
+    au_concurrent_allocator alloc;
+    std::vector<void*> blocks;
+    std::thread([&alloc, &blocks]() {
+        for (size_t i = 0; i < 1000; ++i)
+        {
+            blocks.push_back(alloc.allocate(64));
+        }
+        alloc.flush();
+    }).join();
+    for (void *block : blocks)
+    {
+        alloc.deallocate(block, 64);
+    }
+    // what the thread cut from its slab but never handed out was flushed too
+    std::vector<void*> again;
+    for (size_t i = 0; i < 1024; ++i)
+    {
+        again.push_back(alloc.allocate(64));
+    }
+    std::sort(blocks.begin(), blocks.end());
+    std::sort(again.begin(), again.end());
+    assert(std::includes(again.begin(), again.end(), blocks.begin(), blocks.end()));
+    for (void *block : again)
+    {
+        alloc.deallocate(block, 64);
+    }
+
+    // blocks freed to a thread which then exits without a flush are adopted by the next refill
+    au_concurrent_allocator other;
+    std::vector<void*> freed;
+    std::atomic<int> step(0);
+    std::thread owner([&other, &freed, &step]() {
+        for (size_t i = 0; i < 100; ++i)
+        {
+            freed.push_back(other.allocate(64));
+        }
+        step = 1;
+        while (step != 2)
+        {
+            std::this_thread::yield();
+        }
+    });
+    while (step != 1)
+    {
+        std::this_thread::yield();
+    }
+    for (void *block : freed)
+    {
+        other.deallocate(block, 64);
+    }
+    step = 2;
+    owner.join();
+    std::vector<void*> adopted;
+    for (size_t i = 0; i < freed.size(); ++i)
+    {
+        adopted.push_back(other.allocate(64));
+    }
+    std::sort(freed.begin(), freed.end());
+    std::sort(adopted.begin(), adopted.end());
+    assert(adopted == freed);
+
+    // a thread which exits without a flush leaves its free lists and the rest of its slab to the next refill
+    au_concurrent_allocator exiting;
+    std::vector<void*> kept;
+    std::vector<void*> cached;
+    std::thread([&exiting, &kept, &cached]() {
+        for (size_t i = 0; i < 100; ++i)
+        {
+            (i < 40 ? kept : cached).push_back(exiting.allocate(64));
+        }
+        for (void *block : cached)
+        {
+            exiting.deallocate(block, 64);
+        }
+    }).join();
+    std::vector<void*> reused;
+    for (size_t i = 0; i < 900; ++i)
+    {
+        reused.push_back(exiting.allocate(64));
+    }
+    uintptr_t slab = reinterpret_cast<uintptr_t>(kept[0]) & ~uintptr_t(au_concurrent_allocator::SLAB_SIZE - 1);
+    for (void *block : reused)
+    {
+        assert((reinterpret_cast<uintptr_t>(block) & ~uintptr_t(au_concurrent_allocator::SLAB_SIZE - 1)) == slab);
+    }
+    std::sort(cached.begin(), cached.end());
+    std::sort(reused.begin(), reused.end());
+    assert(std::includes(reused.begin(), reused.end(), cached.begin(), cached.end()));
+    for (void *block : reused)
+    {
+        exiting.deallocate(block, 64);
+    }
+    for (void *block : kept)
+    {
+        exiting.deallocate(block, 64);
+    }
+
+    // threads alternating between allocators keep a cache in each
+    for (int i = 0; i < 1000; ++i)
+    {
+        void *mine = alloc.allocate(32);
+        void *theirs = other.allocate(32);
+        alloc.deallocate(mine, 32);
+        other.deallocate(theirs, 32);
+    }
+    for (void *block : adopted)
+    {
+        other.deallocate(block, 64);
+    }
+}
+
+static void test_concurrent_stress()
+{
+    // every thread hands the blocks it allocates to the next one, which checks and frees them
+    const size_t threads = 4;
+    const size_t blocks = 50000;
+    au_concurrent_allocator alloc;
+    std::vector<std::vector<char*>> inbox(threads);
+    std::vector<std::mutex> locks(threads);
+    auto drain = [&](size_t self) {
+        std::vector<char*> received;
+        {
+            std::lock_guard<std::mutex> lock(locks[self]);
+            received.swap(inbox[self]);
+        }
+        for (char *block : received)
+        {
+            size_t size = 1 + static_cast<unsigned char>(block[0]) % 128;
+            assert(block[size - 1] == block[0]);
+            alloc.deallocate(block, size);
+        }
+    };
+    auto worker = [&](size_t self) {
+        size_t next = (self + 1) % threads;
+        for (size_t i = 0; i < blocks; ++i)
+        {
+            size_t size = 1 + (i * 7 + self) % 128;
+            char *block = static_cast<char*>(alloc.allocate(size));
+            memset(block, char(size - 1), size);
+            {
+                std::lock_guard<std::mutex> lock(locks[next]);
+                inbox[next].push_back(block);
+            }
+            if (i % 64 == 0)
+            {
+                drain(self);
+            }
+        }
+        drain(self);
+    };
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < threads; ++i)
+    {
+        pool.emplace_back(worker, i);
+    }
+    for (auto &thread : pool)
+    {
+        thread.join();
+    }
+    for (size_t i = 0; i < threads; ++i)
+    {
+        drain(i);
+    }
+    alloc.flush();
+}
+
 void my_tests() {
     au_allocator alloc;
     alloc.get_order_test();
+    alloc.size_class_test();
 }
 
 int main()
@@ -127,5 +566,12 @@ int main()
     test_constructor_forwarding();
     test_destructor_call();
     test_stress();
+    test_free_list_reuse();
+    test_size_classes();
+    test_slabs();
+    test_concurrent_allocator();
+    test_concurrent_orphans();
+    test_concurrent_stress();
+    test_std_allocator();
     return 0;
 }